@@ -0,0 +1,816 @@
+// Loads the plugin into a fresh VapourSynth core, runs every filter over
+// synthetic clips and writes the throughput and per-frame latency of each
+// combination as JSON. Source frames come from a kept BlankClip, so all of the
+// measured time is spent in the filter under test.
+//
+// With --compare, it instead runs the GPU and CPU backend of a filter over the
+// same gradient and writes how far their outputs are apart.
+//
+//   vspl-bench [options] path/to/libvs_placebo.so
+//
+// Options take comma separated lists, see usage() for the names.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <VapourSynth4.h>
+#include <VSScript4.h>
+
+struct bench_size {
+    const char *name;
+    int width, height;
+};
+
+static const struct bench_size sizes[] = {
+    {"720p",  1280,  720},
+    {"1080p", 1920, 1080},
+    {"1440p", 2560, 1440},
+    {"2160p", 3840, 2160},
+    {"4320p", 7680, 4320},
+};
+
+struct bench_format {
+    const char *name;
+    int id;
+};
+
+static const struct bench_format formats[] = {
+    {"yuv420p8",  pfYUV420P8},
+    {"yuv420p16", pfYUV420P16},
+    {"yuv444p16", pfYUV444P16},
+    {"yuv444ps",  pfYUV444PS},
+    {"rgb24",     pfRGB24},
+    {"rgbs",      pfRGBS},
+};
+
+// A simple 3x3 blur, enough to exercise the hook machinery
+static const char bench_shader[] =
+    "//!HOOK MAIN\n"
+    "//!BIND HOOKED\n"
+    "//!DESC vspl-bench blur\n"
+    "vec4 hook() {\n"
+    "    vec4 c = vec4(0.0);\n"
+    "    for (int y = -1; y <= 1; y++)\n"
+    "        for (int x = -1; x <= 1; x++)\n"
+    "            c += HOOKED_texOff(vec2(x, y));\n"
+    "    return c / 9.0;\n"
+    "}\n";
+
+static void set_str(VSMap *args, const char *key, const char *value, const VSAPI *vsapi)
+{
+    vsapi->mapSetData(args, key, value, -1, dtUtf8, maReplace);
+}
+
+static void args_deband(VSMap *args, const struct bench_size *size, const VSAPI *vsapi)
+{
+    set_str(args, "backend", "gpu", vsapi);
+}
+
+static void args_deband_cpu(VSMap *args, const struct bench_size *size, const VSAPI *vsapi)
+{
+    set_str(args, "backend", "cpu", vsapi);
+}
+
+// Halves the size, so 2160p covers 4K to 1080p
+static void args_resample(VSMap *args, const struct bench_size *size, const VSAPI *vsapi)
+{
+    vsapi->mapSetInt(args, "width", size->width / 2, maReplace);
+    vsapi->mapSetInt(args, "height", size->height / 2, maReplace);
+}
+
+// The orthogonal filter the CPU backend supports, on either backend
+static void args_resample_ortho(VSMap *args, const struct bench_size *size, const VSAPI *vsapi)
+{
+    args_resample(args, size, vsapi);
+    set_str(args, "filter", "lanczos", vsapi);
+    vsapi->mapSetInt(args, "linearize", 0, maReplace);
+    vsapi->mapSetInt(args, "sigmoidize", 0, maReplace);
+}
+
+static void args_resample_lanczos(VSMap *args, const struct bench_size *size, const VSAPI *vsapi)
+{
+    args_resample_ortho(args, size, vsapi);
+    set_str(args, "backend", "gpu", vsapi);
+}
+
+static void args_resample_cpu(VSMap *args, const struct bench_size *size, const VSAPI *vsapi)
+{
+    args_resample_ortho(args, size, vsapi);
+    set_str(args, "backend", "cpu", vsapi);
+}
+
+// HDR10 to SDR
+static void args_tonemap(VSMap *args, const struct bench_size *size, const VSAPI *vsapi)
+{
+    vsapi->mapSetInt(args, "src_csp", 1, maReplace);
+    vsapi->mapSetInt(args, "dst_csp", 0, maReplace);
+}
+
+static void args_shader(VSMap *args, const struct bench_size *size, const VSAPI *vsapi)
+{
+    set_str(args, "shader_s", bench_shader, vsapi);
+}
+
+struct bench_filter {
+    const char *name;
+    const char *func;
+    void (*args)(VSMap *args, const struct bench_size *size, const VSAPI *vsapi);
+
+    // Applied to the output of this one, for chains of filters
+    const struct bench_filter *next;
+    // Passes resident=True to every filter of the chain
+    bool resident;
+};
+
+// Deband -> Resample -> Tonemap -> Shader, with and without resident frames,
+// to see whether skipping the uploads pays for the frames they keep alive
+static const struct bench_filter chain_shader = {"", "Shader", args_shader};
+static const struct bench_filter chain_tonemap = {"", "Tonemap", args_tonemap, &chain_shader};
+static const struct bench_filter chain_resample = {"", "Resample", args_resample, &chain_tonemap};
+
+static const struct bench_filter filters[] = {
+    {"deband",           "Deband",   args_deband},
+    {"deband_cpu",       "Deband",   args_deband_cpu},
+    {"resample",         "Resample", args_resample},
+    {"resample_lanczos", "Resample", args_resample_lanczos},
+    {"resample_cpu",     "Resample", args_resample_cpu},
+    {"tonemap",          "Tonemap",  args_tonemap},
+    {"shader",           "Shader",   args_shader},
+    {"chain",            "Deband",   args_deband, &chain_resample},
+    {"chain_resident",   "Deband",   args_deband, &chain_resample, true},
+};
+
+#define ARRAY_SIZE(a) ((int) (sizeof(a) / sizeof((a)[0])))
+
+// Without grain and dithering, the backends only differ by where the deband
+// samples land, and by rounding
+static void args_compare_deband(VSMap *args, const struct bench_size *size, const VSAPI *vsapi)
+{
+    vsapi->mapSetInt(args, "planes", 1 | 2 | 4, maReplace);
+    vsapi->mapSetFloat(args, "grain", 0.0, maReplace);
+    vsapi->mapSetInt(args, "dither", 0, maReplace);
+}
+
+// A GPU filter and its CPU backend, which have to produce the same output
+// within --tolerance
+struct bench_comparison {
+    const char *name;
+    const char *gpu, *cpu;
+    void (*args)(VSMap *args, const struct bench_size *size, const VSAPI *vsapi);
+};
+
+static const struct bench_comparison comparisons[] = {
+    {"deband",   "deband",           "deband_cpu",   args_compare_deband},
+    {"resample", "resample_lanczos", "resample_cpu", NULL},
+};
+
+static const struct bench_filter *find_filter(const char *name)
+{
+    for (int i = 0; i < ARRAY_SIZE(filters); i++) {
+        if (!strcmp(filters[i].name, name))
+            return &filters[i];
+    }
+    return NULL;
+}
+
+// Frame props written by filters created with `profile=True`, averaged over
+// the measured frames
+static const struct {
+    const char *key;
+    const char *prop;
+} stages[] = {
+    {"wait",     "PlaceboWaitNs"},
+    {"upload",   "PlaceboUploadNs"},
+    {"render",   "PlaceboRenderNs"},
+    {"download", "PlaceboDownloadNs"},
+    {"cpu",      "PlaceboCpuNs"},
+};
+
+#define NUM_STAGES ARRAY_SIZE(stages)
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Requests frames [start, end) with at most `max_requests` outstanding, like
+// vspipe does
+struct bench_run {
+    const VSAPI *vsapi;
+    VSNode *node;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int start, end, next;
+    int outstanding, max_requests;
+
+    int64_t *requested;
+    int64_t *latency;
+    int64_t stage_sum[NUM_STAGES];
+    int stage_count[NUM_STAGES];
+    char *error;
+};
+
+static void bench_request(struct bench_run *run);
+
+static void VS_CC bench_frame_done(void *user_data, const VSFrame *f, int n, VSNode *node, const char *error_msg)
+{
+    struct bench_run *run = user_data;
+    const VSAPI *vsapi = run->vsapi;
+    int64_t t = now_ns();
+
+    pthread_mutex_lock(&run->lock);
+
+    run->latency[n - run->start] = t - run->requested[n - run->start];
+
+    if (f) {
+        const VSMap *props = vsapi->getFramePropertiesRO(f);
+        for (int i = 0; i < NUM_STAGES; i++) {
+            int err;
+            int64_t ns = vsapi->mapGetInt(props, stages[i].prop, 0, &err);
+            if (!err) {
+                run->stage_sum[i] += ns;
+                run->stage_count[i]++;
+            }
+        }
+        vsapi->freeFrame(f);
+    } else if (!run->error) {
+        run->error = strdup(error_msg ? error_msg : "unknown error");
+    }
+
+    run->outstanding--;
+    bench_request(run);
+    pthread_cond_signal(&run->cond);
+    pthread_mutex_unlock(&run->lock);
+}
+
+// Called with the lock held
+static void bench_request(struct bench_run *run)
+{
+    while (run->next < run->end && run->outstanding < run->max_requests && !run->error) {
+        int n = run->next++;
+        run->outstanding++;
+        run->requested[n - run->start] = now_ns();
+        run->vsapi->getFrameAsync(n, run->node, bench_frame_done, run);
+    }
+}
+
+// Returns the wall time of the whole range
+static int64_t bench_frames(struct bench_run *run, int start, int end)
+{
+    run->start = run->next = start;
+    run->end = end;
+    memset(run->stage_sum, 0, sizeof(run->stage_sum));
+    memset(run->stage_count, 0, sizeof(run->stage_count));
+
+    pthread_mutex_lock(&run->lock);
+    int64_t t0 = now_ns();
+    bench_request(run);
+    while (run->outstanding > 0 || (run->next < run->end && !run->error))
+        pthread_cond_wait(&run->cond, &run->lock);
+    int64_t t1 = now_ns();
+    pthread_mutex_unlock(&run->lock);
+
+    return t1 - t0;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+// Nearest rank
+static double percentile_ms(const int64_t *sorted, int num, double p)
+{
+    int idx = (int) ceil(p / 100.0 * num) - 1;
+    idx = idx < 0 ? 0 : idx >= num ? num - 1 : idx;
+    return sorted[idx] / 1e6;
+}
+
+static void json_string(FILE *out, const char *s)
+{
+    if (!s) {
+        fputs("null", out);
+        return;
+    }
+
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+struct bench {
+    const VSAPI *vsapi;
+    VSCore *core;
+    VSPlugin *std;
+    VSPlugin *placebo;
+
+    const char *device;
+    int frames;
+    int warmup;
+
+    // Runs of the same case at later thread counts are compared to the first
+    // one, and fail the benchmark if they aren't at least min_speedup faster
+    double base_fps;
+    int base_threads;
+    double min_speedup;
+    bool failed;
+
+    // Compare mode: sources are a banded diagonal gradient, and the mean
+    // difference between backends, relative to the format's range, may be
+    // at most `tolerance`
+    bool gradient;
+    double tolerance;
+
+    FILE *out;
+    int num_results;
+};
+
+static VSNode *bench_create(struct bench *b, const struct bench_filter *filter, const struct bench_format *fmt,
+                            const struct bench_size *size,
+                            void (*extra_args)(VSMap *args, const struct bench_size *size, const VSAPI *vsapi),
+                            char **error)
+{
+    const VSAPI *vsapi = b->vsapi;
+
+    VSMap *args = vsapi->createMap();
+    vsapi->mapSetInt(args, "format", fmt->id, maReplace);
+    vsapi->mapSetInt(args, "width", size->width, maReplace);
+    vsapi->mapSetInt(args, "height", size->height, maReplace);
+    vsapi->mapSetInt(args, "length", b->warmup + b->frames, maReplace);
+    vsapi->mapSetInt(args, "keep", 1, maReplace);
+
+    VSMap *ret = vsapi->invoke(b->std, "BlankClip", args);
+    vsapi->freeMap(args);
+    if (vsapi->mapGetError(ret)) {
+        *error = strdup(vsapi->mapGetError(ret));
+        vsapi->freeMap(ret);
+        return NULL;
+    }
+
+    args = vsapi->createMap();
+    vsapi->mapConsumeNode(args, "clip", vsapi->mapGetNode(ret, "clip", 0, NULL), maReplace);
+    vsapi->freeMap(ret);
+
+    if (b->gradient) {
+        // Steps of one code value every 4096 / 2^bits pixels, or finer in float
+        VSVideoFormat vf;
+        vsapi->getVideoFormatByID(&vf, fmt->id, b->core);
+        char expr[64];
+        snprintf(expr, sizeof(expr), "X Y + %g *",
+                 vf.sampleType == stFloat ? 1.0 / 4096 : (double) (1 << vf.bitsPerSample) / 4096);
+        set_str(args, "expr", expr, vsapi);
+
+        ret = vsapi->invoke(b->std, "Expr", args);
+        vsapi->freeMap(args);
+        if (vsapi->mapGetError(ret)) {
+            *error = strdup(vsapi->mapGetError(ret));
+            vsapi->freeMap(ret);
+            return NULL;
+        }
+
+        args = vsapi->createMap();
+        vsapi->mapConsumeNode(args, "clip", vsapi->mapGetNode(ret, "clip", 0, NULL), maReplace);
+        vsapi->freeMap(ret);
+    }
+
+    const bool resident = filter->resident;
+    for (; filter; filter = filter->next) {
+        filter->args(args, size, vsapi);
+        if (extra_args)
+            extra_args(args, size, vsapi);
+        if (b->device)
+            set_str(args, "device", b->device, vsapi);
+        if (resident)
+            vsapi->mapSetInt(args, "resident", 1, maReplace);
+
+        // Stage timings, if this version of the plugin has them. In a chain,
+        // the last filter's are the ones that end up in the output.
+        VSPluginFunction *func = vsapi->getPluginFunctionByName(filter->func, b->placebo);
+        if (strstr(vsapi->getPluginFunctionArguments(func), "profile:"))
+            vsapi->mapSetInt(args, "profile", 1, maReplace);
+
+        ret = vsapi->invoke(b->placebo, filter->func, args);
+        vsapi->freeMap(args);
+        if (vsapi->mapGetError(ret)) {
+            *error = strdup(vsapi->mapGetError(ret));
+            vsapi->freeMap(ret);
+            return NULL;
+        }
+
+        args = vsapi->createMap();
+        vsapi->mapConsumeNode(args, "clip", vsapi->mapGetNode(ret, "clip", 0, NULL), maReplace);
+        vsapi->freeMap(ret);
+    }
+
+    VSNode *node = vsapi->mapGetNode(args, "clip", 0, NULL);
+    vsapi->freeMap(args);
+    return node;
+}
+
+static void bench_case(struct bench *b, const struct bench_filter *filter, const struct bench_format *fmt,
+                       const struct bench_size *size, int threads)
+{
+    const VSAPI *vsapi = b->vsapi;
+    FILE *out = b->out;
+
+    threads = vsapi->setThreadCount(threads, b->core);
+    fprintf(stderr, "%s %s %s, %d threads\n", filter->name, fmt->name, size->name, threads);
+
+    const int max_frames = b->frames > b->warmup ? b->frames : b->warmup;
+    struct bench_run run = {
+        .vsapi = vsapi,
+        .max_requests = threads,
+        .requested = malloc(max_frames * sizeof(int64_t)),
+        .latency = malloc(max_frames * sizeof(int64_t)),
+    };
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.cond, NULL);
+
+    int64_t elapsed = 0;
+    run.node = bench_create(b, filter, fmt, size, NULL, &run.error);
+    if (run.node) {
+        // Every frame slot compiles its shaders on first use
+        if (b->warmup > 0)
+            bench_frames(&run, 0, b->warmup);
+        if (!run.error)
+            elapsed = bench_frames(&run, b->warmup, b->warmup + b->frames);
+        vsapi->freeNode(run.node);
+    }
+
+    fprintf(out, "%s\n    {\"filter\": ", b->num_results++ ? "," : "");
+    json_string(out, filter->name);
+    fprintf(out, ", \"format\": ");
+    json_string(out, fmt->name);
+    fprintf(out, ", \"width\": %d, \"height\": %d, \"threads\": %d,\n     ", size->width, size->height, threads);
+
+    if (run.error) {
+        fprintf(stderr, "  %s\n", run.error);
+        fprintf(out, "\"error\": ");
+        json_string(out, run.error);
+        fprintf(out, "}");
+    } else {
+        const double fps = b->frames / (elapsed / 1e9);
+        qsort(run.latency, b->frames, sizeof(int64_t), cmp_int64);
+        fprintf(out, "\"frames\": %d, \"fps\": %.3f,\n     ", b->frames, fps);
+        fprintf(out, "\"latency_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}",
+                percentile_ms(run.latency, b->frames, 50), percentile_ms(run.latency, b->frames, 90),
+                percentile_ms(run.latency, b->frames, 99), percentile_ms(run.latency, b->frames, 100));
+
+        if (b->base_fps > 0) {
+            const double speedup = fps / b->base_fps;
+            fprintf(out, ",\n     \"speedup\": %.3f", speedup);
+
+            // Thread counts that resolve to the same number, like the
+            // default on a single core machine, have nothing to show
+            if (b->min_speedup > 0 && threads > b->base_threads && speedup < b->min_speedup) {
+                fprintf(stderr, "  %.2fx the fps of %d threads, expected at least %.2fx\n",
+                        speedup, b->base_threads, b->min_speedup);
+                b->failed = true;
+            }
+        } else {
+            b->base_fps = fps;
+            b->base_threads = threads;
+        }
+
+        bool first = true;
+        fprintf(out, ",\n     \"stages_ms\": {");
+        for (int i = 0; i < NUM_STAGES; i++) {
+            if (!run.stage_count[i])
+                continue;
+            fprintf(out, "%s\"%s\": %.3f", first ? "" : ", ", stages[i].key,
+                    run.stage_sum[i] / 1e6 / run.stage_count[i]);
+            first = false;
+        }
+        fprintf(out, "}}");
+    }
+    fflush(out);
+
+    free(run.error);
+    free(run.requested);
+    free(run.latency);
+    pthread_cond_destroy(&run.cond);
+    pthread_mutex_destroy(&run.lock);
+}
+
+// Adds up the absolute differences of all samples, relative to the range
+static void compare_frames(const VSFrame *x, const VSFrame *y, const VSAPI *vsapi,
+                           double *max_diff, double *sum_diff, int64_t *count)
+{
+    const VSVideoFormat *fmt = vsapi->getVideoFrameFormat(x);
+    const double scale = fmt->sampleType == stFloat ? 1.0 : 1.0 / ((1 << fmt->bitsPerSample) - 1);
+
+    for (int p = 0; p < fmt->numPlanes; p++) {
+        const int w = vsapi->getFrameWidth(x, p), h = vsapi->getFrameHeight(x, p);
+        const ptrdiff_t stride_x = vsapi->getStride(x, p), stride_y = vsapi->getStride(y, p);
+
+        for (int j = 0; j < h; j++) {
+            const uint8_t *row_x = vsapi->getReadPtr(x, p) + j * stride_x;
+            const uint8_t *row_y = vsapi->getReadPtr(y, p) + j * stride_y;
+
+            for (int i = 0; i < w; i++) {
+                double vx, vy;
+                if (fmt->bytesPerSample == 1) {
+                    vx = row_x[i];
+                    vy = row_y[i];
+                } else if (fmt->bytesPerSample == 2) {
+                    vx = ((const uint16_t *) row_x)[i];
+                    vy = ((const uint16_t *) row_y)[i];
+                } else {
+                    vx = ((const float *) row_x)[i];
+                    vy = ((const float *) row_y)[i];
+                }
+
+                const double d = fabs(vx - vy) * scale;
+                *max_diff = d > *max_diff ? d : *max_diff;
+                *sum_diff += d;
+            }
+            *count += w;
+        }
+    }
+}
+
+static void bench_compare(struct bench *b, const struct bench_comparison *cmp, const struct bench_format *fmt,
+                          const struct bench_size *size)
+{
+    const VSAPI *vsapi = b->vsapi;
+    FILE *out = b->out;
+
+    vsapi->setThreadCount(0, b->core);
+    fprintf(stderr, "compare %s %s %s\n", cmp->name, fmt->name, size->name);
+
+    char *error = NULL;
+    VSNode *gpu = bench_create(b, find_filter(cmp->gpu), fmt, size, cmp->args, &error);
+    VSNode *cpu = gpu ? bench_create(b, find_filter(cmp->cpu), fmt, size, cmp->args, &error) : NULL;
+
+    double max_diff = 0, sum_diff = 0;
+    int64_t count = 0;
+    for (int n = 0; cpu && n < b->frames && !error; n++) {
+        char msg[1024] = "";
+        const VSFrame *fx = vsapi->getFrame(n, gpu, msg, sizeof(msg));
+        const VSFrame *fy = fx ? vsapi->getFrame(n, cpu, msg, sizeof(msg)) : NULL;
+        if (fy) {
+            compare_frames(fx, fy, vsapi, &max_diff, &sum_diff, &count);
+        } else {
+            error = strdup(msg);
+        }
+        vsapi->freeFrame(fx);
+        vsapi->freeFrame(fy);
+    }
+    vsapi->freeNode(gpu);
+    vsapi->freeNode(cpu);
+
+    fprintf(out, "%s\n    {\"compare\": ", b->num_results++ ? "," : "");
+    json_string(out, cmp->name);
+    fprintf(out, ", \"format\": ");
+    json_string(out, fmt->name);
+    fprintf(out, ", \"width\": %d, \"height\": %d,\n     ", size->width, size->height);
+
+    if (error) {
+        fprintf(stderr, "  %s\n", error);
+        fprintf(out, "\"error\": ");
+        json_string(out, error);
+        fprintf(out, "}");
+        b->failed = true;
+    } else {
+        const double mean_diff = count ? sum_diff / count : 0;
+        const bool pass = mean_diff <= b->tolerance;
+        fprintf(out, "\"frames\": %d, \"max_abs_diff\": %.6f, \"mean_abs_diff\": %.6f, "
+                "\"tolerance\": %g, \"pass\": %s}", b->frames, max_diff, mean_diff, b->tolerance,
+                pass ? "true" : "false");
+
+        if (!pass) {
+            fprintf(stderr, "  mean difference %.6f exceeds the tolerance of %g\n", mean_diff, b->tolerance);
+            b->failed = true;
+        }
+    }
+    fflush(out);
+    free(error);
+}
+
+static void VS_CC bench_log(int type, const char *msg, void *user_data)
+{
+    if (type >= mtWarning)
+        fprintf(stderr, "  vs: %s\n", msg);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: vspl-bench [options] PLUGIN\n"
+        "  --filters LIST   deband,deband_cpu,resample,resample_lanczos,resample_cpu,tonemap,shader,\n"
+        "                   chain,chain_resident\n"
+        "  --formats LIST   yuv420p8,yuv420p16,yuv444p16,yuv444ps,rgb24,rgbs\n"
+        "  --sizes LIST     720p,1080p,1440p,2160p,4320p (default 720p,1080p,2160p)\n"
+        "  --threads LIST   thread counts, 0 for the core's default (default 1,0)\n"
+        "  --frames N       measured frames per run (default 100)\n"
+        "  --warmup N       frames run before measuring (default 10)\n"
+        "  --min-speedup X  fail unless every thread count after the first one gets\n"
+        "                   at least X times the fps of the first one\n"
+        "  --compare LIST   deband,resample: compare the GPU and CPU backends\n"
+        "                   instead of benchmarking, over --formats and --sizes\n"
+        "  --tolerance X    largest mean difference between backends, relative to\n"
+        "                   the range of the format (default 0.005)\n"
+        "  --device NAME    Vulkan device passed to the filters\n"
+        "  --output PATH    write the JSON there instead of stdout\n");
+}
+
+// Turns a comma separated list of names into a bitmask of table entries
+#define PARSE_NAMES(table, list, mask) parse_names(list, &(table)[0].name, sizeof((table)[0]), ARRAY_SIZE(table), mask)
+
+static bool parse_names(const char *list, const char *const *names, size_t stride, int num, unsigned *mask)
+{
+    *mask = 0;
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        int i;
+        for (i = 0; i < num; i++) {
+            const char *name = *(const char *const *) ((const char *) names + i * stride);
+            if (strlen(name) == len && !strncmp(name, list, len))
+                break;
+        }
+        if (i == num) {
+            fprintf(stderr, "vspl-bench: unknown name '%.*s'\n", (int) len, list);
+            return false;
+        }
+        *mask |= 1u << i;
+        list += len + (list[len] == ',');
+    }
+    return *mask != 0;
+}
+
+#define MAX_THREAD_COUNTS 16
+
+int main(int argc, char **argv)
+{
+    unsigned filter_mask = (1u << ARRAY_SIZE(filters)) - 1;
+    unsigned format_mask = (1u << ARRAY_SIZE(formats)) - 1;
+    unsigned size_mask = 0;
+    PARSE_NAMES(sizes, "720p,1080p,2160p", &size_mask);
+
+    int thread_counts[MAX_THREAD_COUNTS] = {1, 0};
+    int num_thread_counts = 2;
+
+    unsigned compare_mask = 0;
+    struct bench b = {.frames = 100, .warmup = 10, .tolerance = 0.005, .out = stdout};
+    const char *plugin_path = NULL;
+    const char *output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        bool ok = true;
+
+        if (arg[0] != '-') {
+            plugin_path = arg;
+            continue;
+        }
+
+        if (!val) {
+            ok = false;
+        } else if (!strcmp(arg, "--filters")) {
+            ok = PARSE_NAMES(filters, val, &filter_mask);
+        } else if (!strcmp(arg, "--formats")) {
+            ok = PARSE_NAMES(formats, val, &format_mask);
+        } else if (!strcmp(arg, "--sizes")) {
+            ok = PARSE_NAMES(sizes, val, &size_mask);
+        } else if (!strcmp(arg, "--threads")) {
+            num_thread_counts = 0;
+            for (const char *s = val; *s && num_thread_counts < MAX_THREAD_COUNTS; s++) {
+                thread_counts[num_thread_counts++] = atoi(s);
+                s += strcspn(s, ",");
+                if (!*s)
+                    break;
+            }
+            ok = num_thread_counts > 0;
+        } else if (!strcmp(arg, "--frames")) {
+            b.frames = atoi(val);
+            ok = b.frames > 0;
+        } else if (!strcmp(arg, "--warmup")) {
+            b.warmup = atoi(val);
+            ok = b.warmup >= 0;
+        } else if (!strcmp(arg, "--min-speedup")) {
+            b.min_speedup = atof(val);
+            ok = b.min_speedup > 0;
+        } else if (!strcmp(arg, "--compare")) {
+            ok = PARSE_NAMES(comparisons, val, &compare_mask);
+        } else if (!strcmp(arg, "--tolerance")) {
+            b.tolerance = atof(val);
+            ok = b.tolerance >= 0;
+        } else if (!strcmp(arg, "--device")) {
+            b.device = val;
+        } else if (!strcmp(arg, "--output")) {
+            output = val;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            usage();
+            return 2;
+        }
+        i++;
+    }
+
+    if (!plugin_path) {
+        usage();
+        return 2;
+    }
+
+    const VSSCRIPTAPI *vssapi = getVSScriptAPI(VSSCRIPT_API_VERSION);
+    if (!vssapi) {
+        fprintf(stderr, "vspl-bench: Failed initializing VSScript\n");
+        return 1;
+    }
+
+    const VSAPI *vsapi = b.vsapi = vssapi->getVSAPI(VAPOURSYNTH_API_VERSION);
+    // Make sure the plugin under test isn't shadowed by an installed one
+    b.core = vsapi->createCore(ccfDisableAutoLoading);
+    vsapi->addLogHandler(bench_log, NULL, NULL, b.core);
+    b.std = vsapi->getPluginByID("com.vapoursynth.std", b.core);
+
+    VSMap *args = vsapi->createMap();
+    set_str(args, "path", plugin_path, vsapi);
+    VSMap *ret = vsapi->invoke(b.std, "LoadPlugin", args);
+    vsapi->freeMap(args);
+    if (vsapi->mapGetError(ret)) {
+        fprintf(stderr, "vspl-bench: %s\n", vsapi->mapGetError(ret));
+        vsapi->freeMap(ret);
+        vsapi->freeCore(b.core);
+        return 1;
+    }
+    vsapi->freeMap(ret);
+    b.placebo = vsapi->getPluginByID("com.vs.placebo", b.core);
+
+    if (output && !(b.out = fopen(output, "w"))) {
+        fprintf(stderr, "vspl-bench: Failed opening %s\n", output);
+        vsapi->freeCore(b.core);
+        return 1;
+    }
+
+    VSCoreInfo info;
+    vsapi->getCoreInfo(b.core, &info);
+    int version = vsapi->getPluginVersion(b.placebo);
+
+    fprintf(b.out, "{\n  \"plugin_version\": \"%d.%d\",\n  \"vapoursynth\": %d,\n  \"device\": ",
+            version >> 16, version & 0xffff, info.core);
+    json_string(b.out, b.device);
+    fprintf(b.out, ",\n  \"warmup\": %d,\n  \"results\": [", b.warmup);
+
+    b.gradient = compare_mask != 0;
+    for (int ci = 0; ci < ARRAY_SIZE(comparisons); ci++) {
+        if (!(compare_mask & (1u << ci)))
+            continue;
+        for (int pi = 0; pi < ARRAY_SIZE(formats); pi++) {
+            if (!(format_mask & (1u << pi)))
+                continue;
+            for (int si = 0; si < ARRAY_SIZE(sizes); si++) {
+                if (size_mask & (1u << si))
+                    bench_compare(&b, &comparisons[ci], &formats[pi], &sizes[si]);
+            }
+        }
+    }
+
+    for (int fi = 0; fi < ARRAY_SIZE(filters) && !compare_mask; fi++) {
+        if (!(filter_mask & (1u << fi)))
+            continue;
+        for (int pi = 0; pi < ARRAY_SIZE(formats); pi++) {
+            if (!(format_mask & (1u << pi)))
+                continue;
+            for (int si = 0; si < ARRAY_SIZE(sizes); si++) {
+                if (!(size_mask & (1u << si)))
+                    continue;
+                b.base_fps = 0;
+                for (int ti = 0; ti < num_thread_counts; ti++)
+                    bench_case(&b, &filters[fi], &formats[pi], &sizes[si], thread_counts[ti]);
+            }
+        }
+    }
+
+    fprintf(b.out, "\n  ]\n}\n");
+    if (b.out != stdout)
+        fclose(b.out);
+
+    vsapi->freeCore(b.core);
+    return b.failed ? 1 : 0;
+}
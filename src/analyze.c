@@ -0,0 +1,340 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include <VapourSynth4.h>
+
+#include <libplacebo/renderer.h>
+#include <libplacebo/colorspace.h>
+
+#include "vs-placebo.h"
+#include "resident.h"
+#include "analyze.h"
+#include "tonemap.h"
+#include "stats.h"
+
+typedef struct {
+    VSNode *node;
+    const VSVideoInfo *vi;
+    struct priv *vf;
+
+    struct pl_render_params renderParams;
+    struct pl_peak_detect_params peakDetectParams;
+    struct pl_color_space src_pl_csp;
+
+    struct vspl_stats *stats;
+
+    // Tells the instance apart in traces
+    int trace_id;
+} AnalyzeData;
+
+#if PL_API_VER >= 264
+
+bool vspl_analyze_reconfig(void *priv, struct vspl_slot *s, struct pl_plane_data *data,
+                           const struct vspl_resident_ref *res, VSCore *core, const VSAPI *vsapi)
+{
+    struct priv *p = priv;
+
+    pl_fmt fmt = pl_plane_find_fmt(p->gpu, NULL, &data[0]);
+    if (!fmt) {
+        vsapi->logMessage(mtCritical, "Failed configuring filter: no good texture format!\n", core);
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < 3; ++i) {
+        if (vspl_resident_tex(res, i))
+            continue;
+
+        ok &= vspl_tex_pool_recreate(p->pool, &s->tex_in[i], pl_tex_params(
+            .w = data[i].width,
+            .h = data[i].height,
+            .format = fmt,
+            .sampleable = true,
+            .host_writable = true,
+            .blit_src = fmt->caps & PL_FMT_CAP_BLITTABLE,
+        ));
+    }
+
+    // The peak is detected while rendering, the image itself is thrown away
+    pl_fmt out = pl_find_named_fmt(p->gpu, "rgba8");
+    if (!out || !(out->caps & PL_FMT_CAP_RENDERABLE)) {
+        vsapi->logMessage(mtCritical, "Failed configuring filter: no good output texture format!\n", core);
+        return false;
+    }
+
+    ok &= vspl_tex_pool_recreate(p->pool, &s->tex_out[0], pl_tex_params(
+        .w = data[0].width,
+        .h = data[0].height,
+        .format = out,
+        .renderable = true,
+    ));
+
+    if (!ok) {
+        vsapi->logMessage(mtCritical, "Failed creating GPU textures!\n", core);
+        return false;
+    }
+
+    return true;
+}
+
+bool vspl_analyze_filter(AnalyzeData *d, struct vspl_slot *s, struct pl_plane_data *src,
+                         const struct pl_color_repr *src_repr, enum pl_chroma_location chroma_loc,
+                         const struct vspl_resident_ref *res, struct pl_hdr_metadata *hdr,
+                         VSCore *core, const VSAPI *vsapi)
+{
+    struct priv *p = d->vf;
+
+    // Upload planes, unless they are still on the GPU
+    struct pl_frame img = {
+        .num_planes = 3,
+        .repr = *src_repr,
+        .color = d->src_pl_csp,
+    };
+
+    bool ok = true;
+    for (int i = 0; i < 3; ++i) {
+        pl_tex tex = vspl_resident_tex(res, i);
+        if (tex) {
+            img.planes[i] = (struct pl_plane) {
+                .texture = tex,
+                .components = 1,
+                .component_mapping = {i},
+            };
+        } else {
+            ok &= vspl_upload_plane(p->gpu, &s->xfer, &img.planes[i], &s->tex_in[i], &src[i]);
+        }
+    }
+
+    if (!ok) {
+        vsapi->logMessage(mtCritical, "Failed uploading data to the GPU!\n", core);
+        return false;
+    }
+
+    if (d->vi->format.subSamplingW || d->vi->format.subSamplingH)
+        pl_frame_set_chroma_location(&img, chroma_loc);
+
+    // Tone mapping to SDR makes the renderer run the peak detection
+    struct pl_frame out = {
+        .num_planes = 1,
+        .planes = {{
+            .texture = s->tex_out[0],
+            .components = 3,
+            .component_mapping = {0, 1, 2},
+        }},
+        .repr = pl_color_repr_rgb,
+        .color = pl_color_space_bt709,
+    };
+
+    const int64_t trace = vspl_trace_begin();
+    bool rendered = pl_render_image(s->rr, &img, &out, &d->renderParams);
+    vspl_trace_end(VSPL_TRACE_RENDER, trace);
+    if (!rendered) {
+        vsapi->logMessage(mtCritical, "Failed processing planes!\n", core);
+        return false;
+    }
+
+    // The peak detection runs as part of the render, so wait for it before
+    // reading back. With smoothing disabled, this is the measurement of this
+    // frame alone.
+    pl_gpu_finish(p->gpu);
+    if (!pl_renderer_get_hdr_metadata(s->rr, hdr)) {
+        vsapi->logMessage(mtCritical, "Failed reading back the detected peak!\n", core);
+        return false;
+    }
+
+    return true;
+}
+
+static const VSFrame *VS_CC VSPlaceboAnalyzeGetFrame(int n, int activationReason, void *instanceData, void **frameData,
+                                                     VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi)
+{
+    AnalyzeData *d = (AnalyzeData *) instanceData;
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        vspl_counter_add(VSPL_COUNTER_ANALYZE_FRAMES, 1);
+        vspl_trace_frame("Analyze", d->trace_id, n);
+
+        const VSFrame *frame = vsapi->getFrameFilter(n, d->node, frameCtx);
+
+        int err;
+        const VSMap *props = vsapi->getFramePropertiesRO(frame);
+        const VSVideoFormat *src_fmt = vsapi->getVideoFrameFormat(frame);
+
+        struct pl_color_repr src_repr = {
+            .bits = vspl_bit_encoding(src_fmt),
+            .sys = src_fmt->colorFamily == cfRGB ? PL_COLOR_SYSTEM_RGB : PL_COLOR_SYSTEM_BT_2020_NC,
+        };
+
+        int64_t props_levels = vsapi->mapGetInt(props, "_ColorRange", 0, &err);
+        if (!err)
+            src_repr.levels = props_levels ? PL_COLOR_LEVELS_LIMITED : PL_COLOR_LEVELS_FULL;
+
+        enum pl_chroma_location chroma_loc = vsapi->mapGetInt(props, "_ChromaLocation", 0, &err);
+        chroma_loc = err ? PL_CHROMA_LEFT : chroma_loc + 1;
+
+        struct pl_plane_data planes[3] = {};
+        for (int i = 0; i < 3; ++i) {
+            planes[i] = (struct pl_plane_data) {
+                .type = src_fmt->sampleType == stInteger ? PL_FMT_UNORM : PL_FMT_FLOAT,
+                .width = vsapi->getFrameWidth(frame, i),
+                .height = vsapi->getFrameHeight(frame, i),
+                .pixel_stride = src_fmt->bytesPerSample,
+                .row_stride = vsapi->getStride(frame, i),
+                .pixels = vsapi->getReadPtr((VSFrame *) frame, i),
+            };
+
+            planes[i].component_size[0] = src_fmt->bytesPerSample * 8;
+            planes[i].component_pad[0] = 0;
+            planes[i].component_map[0] = i;
+        }
+
+        struct vspl_slot *s = vspl_slot_acquire(d->vf);
+
+        struct vspl_resident_ref res;
+        vspl_resident_ref(d->vf, frame, &res, vsapi);
+
+        struct pl_hdr_metadata hdr = {0};
+        const int64_t trace = vspl_trace_begin();
+        bool ok = vspl_analyze_reconfig(d->vf, s, planes, &res, core, vsapi);
+        vspl_trace_end(VSPL_TRACE_RECONFIG, trace);
+        ok = ok && vspl_analyze_filter(d, s, planes, &src_repr, chroma_loc, &res, &hdr, core, vsapi);
+
+        vspl_resident_unref(&res, vsapi);
+        vspl_slot_release(d->vf, s);
+
+        // Frames are passed through, with their stats attached
+        VSFrame *dst = vsapi->copyFrame(frame, core);
+        vsapi->freeFrame(frame);
+
+        if (ok) {
+            // Every frame has its own record, no locking needed
+            struct vspl_stats_frame *rec = &vspl_stats_frames(d->stats)[n];
+            rec->max_pq = hdr.max_pq_y;
+            rec->avg_pq = hdr.avg_pq_y;
+            rec->flags = VSPL_STATS_VALID;
+
+            VSMap *dst_props = vsapi->getFramePropertiesRW(dst);
+            vsapi->mapSetFloat(dst_props, "PLFrameMax", pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, hdr.max_pq_y), maReplace);
+            vsapi->mapSetFloat(dst_props, "PLFrameAvg", pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, hdr.avg_pq_y), maReplace);
+        }
+
+        return dst;
+    }
+
+    return 0;
+}
+
+static void VS_CC VSPlaceboAnalyzeFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    AnalyzeData *d = (AnalyzeData *) instanceData;
+    vsapi->freeNode(d->node);
+    VSPlaceboUninit(d->vf);
+    vspl_stats_close(&d->stats);
+    free(d);
+}
+
+#endif // PL_API_VER >= 264
+
+void VS_CC VSPlaceboAnalyzeCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+#if PL_API_VER >= 264
+    AnalyzeData d = {0};
+    AnalyzeData *data;
+    int err;
+    struct vspl_init_params init_params;
+    vspl_init_params_read(&init_params, in, core, vsapi);
+    d.trace_id = vspl_trace_id();
+    // Frames are passed through untouched, there is nothing to profile
+    init_params.profile = false;
+
+    d.node = vsapi->mapGetNode(in, "clip", 0, 0);
+    d.vi = vsapi->getVideoInfo(d.node);
+
+    const VSVideoFormat *fmt = &d.vi->format;
+    if ((fmt->colorFamily != cfRGB && fmt->colorFamily != cfYUV) || !vspl_format_supported(fmt) ||
+        (fmt->sampleType == stFloat && fmt->colorFamily != cfRGB)) {
+        vsapi->mapSetError(out, "placebo.Analyze: Input must be 8-16 bit integer RGB/YUV or 32 bit float RGB!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    if (d.vi->numFrames <= 0) {
+        vsapi->mapSetError(out, "placebo.Analyze: Clip must have a known length!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    int src_csp = vsapi->mapGetIntSaturated(in, "src_csp", 0, &err);
+    if (err)
+        src_csp = CSP_HDR10;
+
+    if (src_csp == CSP_SDR || src_csp == CSP_DOVI || !vspl_color_space_from_csp(src_csp, &d.src_pl_csp)) {
+        vsapi->mapSetError(out, "placebo.Analyze: Source colorspace must be HDR10 or HLG!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    // Raw per-frame measurements, the scenes are worked out when reading
+    // the file back
+    d.peakDetectParams = pl_peak_detect_default_params;
+    d.peakDetectParams.smoothing_period = 0.0f;
+    d.peakDetectParams.scene_threshold_low = 0.0f;
+    d.peakDetectParams.scene_threshold_high = 0.0f;
+    d.peakDetectParams.percentile = vsapi->mapGetFloat(in, "percentile", 0, &err);
+    if (err)
+        d.peakDetectParams.percentile = pl_peak_detect_default_params.percentile;
+
+    d.renderParams = pl_render_fast_params;
+    d.renderParams.peak_detect_params = &d.peakDetectParams;
+    d.renderParams.color_map_params = &pl_color_map_default_params;
+
+    struct vspl_stats_clip clip;
+    char fingerprint_err[256];
+    if (!vspl_stats_fingerprint(&clip, d.node, fingerprint_err, sizeof(fingerprint_err), core, vsapi)) {
+        vsapi->mapSetError(out, fingerprint_err);
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    const char *path = vsapi->mapGetData(in, "stats_file", 0, &err);
+    d.stats = vspl_stats_create(path, &clip);
+    if (!d.stats) {
+        vsapi->mapSetError(out, "placebo.Analyze: Failed creating stats_file!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    d.vf = VSPlaceboInit(&init_params);
+    if (!d.vf) {
+        vsapi->mapSetError(out, "placebo.Analyze: Failed initializing libplacebo!");
+        vsapi->freeNode(d.node);
+        vspl_stats_close(&d.stats);
+        return;
+    }
+
+    VSFilterDependency deps[] = {{d.node, rpStrictSpatial}};
+
+    data = malloc(sizeof(d));
+    *data = d;
+
+    // The render params point into the instance data
+    data->renderParams.peak_detect_params = &data->peakDetectParams;
+
+    vsapi->createVideoFilter(
+        out,
+        "Analyze",
+        d.vi,
+        VSPlaceboAnalyzeGetFrame,
+        VSPlaceboAnalyzeFree,
+        fmParallelRequests,
+        deps,
+        1,
+        data,
+        core
+    );
+#else
+    vsapi->mapSetError(out, "placebo.Analyze: Requires libplacebo v5.264 or newer!");
+#endif
+}
@@ -0,0 +1,8 @@
+#ifndef VS_PLACEBO_ANALYZE_H
+#define VS_PLACEBO_ANALYZE_H
+
+#include <VapourSynth4.h>
+
+void VS_CC VSPlaceboAnalyzeCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi);
+
+#endif //VS_PLACEBO_ANALYZE_H
@@ -0,0 +1,270 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <libplacebo/config.h>
+#include <libplacebo/log.h>
+
+#include "cache.h"
+#include "counters.h"
+
+#if PL_API_VER >= 338
+#include <libplacebo/cache.h>
+
+#define CACHE_FILE_NAME "vs-placebo.cache"
+
+struct vspl_cache {
+    pl_log log;
+    pl_gpu gpu;
+    char *path;
+
+    // What was on disk when the cache got opened, NULL without a directory.
+    // Objects move from here to the live cache the first time libplacebo asks
+    // for them.
+    pl_cache disk;
+    // The cache attached to the GPU
+    pl_cache live;
+
+    atomic_uint_fast64_t hits;
+    atomic_uint_fast64_t compiles;
+};
+
+// Called by the live cache for objects it doesn't have, anything not on disk
+// either gets compiled
+static pl_cache_obj vspl_cache_lookup(void *priv, uint64_t key)
+{
+    struct vspl_cache *cache = priv;
+    pl_cache_obj obj = { .key = key };
+
+    if (cache->disk && pl_cache_get(cache->disk, &obj)) {
+        atomic_fetch_add(&cache->hits, 1);
+        vspl_counter_add(VSPL_COUNTER_DISK_CACHE_HITS, 1);
+        return obj;
+    }
+
+    atomic_fetch_add(&cache->compiles, 1);
+    vspl_counter_add(VSPL_COUNTER_SHADER_COMPILES, 1);
+    return (pl_cache_obj) { .key = key };
+}
+
+static uint8_t *vspl_read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+
+    uint8_t *data = NULL;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long len = ftell(f);
+        rewind(f);
+
+        if (len > 0 && (data = malloc(len))) {
+            if (fread(data, 1, len, f) == (size_t) len) {
+                *size = len;
+            } else {
+                free(data);
+                data = NULL;
+            }
+        }
+    }
+
+    fclose(f);
+    return data;
+}
+
+// Serializes `src` into `dst`, so both the on-disk leftovers and the live
+// objects end up in the file that gets written
+static void vspl_cache_merge(pl_cache dst, pl_cache src)
+{
+    size_t size = pl_cache_save(src, NULL, 0);
+    if (!size)
+        return;
+
+    uint8_t *data = malloc(size);
+    if (!data)
+        return;
+
+    size = pl_cache_save(src, data, size);
+    pl_cache_load(dst, data, size);
+    free(data);
+}
+
+static bool vspl_cache_write(struct vspl_cache *cache)
+{
+    bool ok = false;
+    uint8_t *data = NULL;
+
+    const size_t path_len = strlen(cache->path) + 32;
+    char *tmp_path = malloc(path_len);
+    char *lock_path = malloc(path_len);
+    if (!tmp_path || !lock_path)
+        goto done;
+
+    snprintf(tmp_path, path_len, "%s.%d.tmp", cache->path, (int) getpid());
+    snprintf(lock_path, path_len, "%s.lock", cache->path);
+
+#ifndef _WIN32
+    // Serialize the read-merge-write against other processes sharing the
+    // file. Readers don't need this, since the file only ever gets replaced
+    // atomically.
+    int lock_fd = open(lock_path, O_RDWR | O_CREAT, 0644);
+    if (lock_fd >= 0)
+        flock(lock_fd, LOCK_EX);
+#endif
+
+    pl_cache merged = pl_cache_create(pl_cache_params(
+        .log = cache->log,
+        .max_total_size = 256 << 20,
+    ));
+
+    if (merged) {
+        // Pick up whatever other processes added in the meantime
+        size_t size = 0;
+        uint8_t *current = vspl_read_file(cache->path, &size);
+        if (current) {
+            pl_cache_load(merged, current, size);
+            free(current);
+        }
+
+        vspl_cache_merge(merged, cache->disk);
+        vspl_cache_merge(merged, cache->live);
+
+        size = pl_cache_save(merged, NULL, 0);
+        data = size ? malloc(size) : NULL;
+        if (data) {
+            size = pl_cache_save(merged, data, size);
+
+            FILE *f = fopen(tmp_path, "wb");
+            if (f) {
+                ok = fwrite(data, 1, size, f) == size;
+                ok &= fclose(f) == 0;
+            }
+
+#ifdef _WIN32
+            ok = ok && MoveFileExA(tmp_path, cache->path, MOVEFILE_REPLACE_EXISTING);
+#else
+            ok = ok && rename(tmp_path, cache->path) == 0;
+#endif
+            if (!ok)
+                remove(tmp_path);
+        }
+
+        pl_cache_destroy(&merged);
+    }
+
+#ifndef _WIN32
+    if (lock_fd >= 0) {
+        flock(lock_fd, LOCK_UN);
+        close(lock_fd);
+    }
+#endif
+
+done:
+    free(data);
+    free(tmp_path);
+    free(lock_path);
+    return ok;
+}
+
+struct vspl_cache *vspl_cache_open(pl_log log, pl_gpu gpu, const char *dir)
+{
+    struct vspl_cache *cache = calloc(1, sizeof(struct vspl_cache));
+    if (!cache)
+        return NULL;
+
+    cache->log = log;
+    cache->gpu = gpu;
+
+    cache->live = pl_cache_create(pl_cache_params(
+        .log = log,
+        .max_total_size = 256 << 20,
+        .get = vspl_cache_lookup,
+        .priv = cache,
+    ));
+
+    if (!cache->live)
+        goto error;
+
+    if (dir && dir[0]) {
+        const size_t path_len = strlen(dir) + sizeof(CACHE_FILE_NAME) + 1;
+        cache->path = malloc(path_len);
+        if (!cache->path)
+            goto error;
+        snprintf(cache->path, path_len, "%s/%s", dir, CACHE_FILE_NAME);
+
+        cache->disk = pl_cache_create(pl_cache_params(
+            .log = log,
+            .max_total_size = 256 << 20,
+        ));
+        if (!cache->disk)
+            goto error;
+
+        size_t size = 0;
+        uint8_t *data = vspl_read_file(cache->path, &size);
+        if (data) {
+            if (pl_cache_load(cache->disk, data, size) < 0)
+                pl_msg(log, PL_LOG_WARN, "Ignoring invalid shader cache '%s'", cache->path);
+            free(data);
+        }
+    }
+
+    pl_gpu_set_cache(gpu, cache->live);
+    return cache;
+
+error:
+    vspl_cache_close(&cache);
+    return NULL;
+}
+
+void vspl_cache_close(struct vspl_cache **pcache)
+{
+    struct vspl_cache *cache = *pcache;
+    if (!cache)
+        return;
+
+    if (cache->live)
+        pl_gpu_set_cache(cache->gpu, NULL);
+
+    if (cache->live && cache->disk) {
+        // Only rewrite the file if something new got compiled
+        if (atomic_load(&cache->compiles) && !vspl_cache_write(cache))
+            pl_msg(cache->log, PL_LOG_WARN, "Failed saving shader cache '%s'", cache->path);
+
+        pl_msg(cache->log, PL_LOG_INFO, "Shader cache '%s': %" PRIu64 " hits, %" PRIu64 " compiled",
+               cache->path, (uint64_t) atomic_load(&cache->hits), (uint64_t) atomic_load(&cache->compiles));
+    }
+
+    pl_cache_destroy(&cache->live);
+    pl_cache_destroy(&cache->disk);
+    free(cache->path);
+    free(cache);
+    *pcache = NULL;
+}
+
+#else // PL_API_VER < 338
+
+struct vspl_cache *vspl_cache_open(pl_log log, pl_gpu gpu, const char *dir)
+{
+    if (dir && dir[0])
+        pl_msg(log, PL_LOG_WARN, "Shader cache requires libplacebo v6.338 or newer, ignoring");
+    return NULL;
+}
+
+void vspl_cache_close(struct vspl_cache **cache)
+{
+}
+
+#endif // PL_API_VER >= 338
@@ -0,0 +1,15 @@
+#ifndef VS_PLACEBO_CACHE_H
+#define VS_PLACEBO_CACHE_H
+
+#include <libplacebo/gpu.h>
+
+// In-memory cache of compiled shaders and pipelines attached to a GPU, which
+// counts what had to be compiled. With a directory, it is backed by an
+// on-disk cache shared by all contexts and processes using that directory.
+struct vspl_cache;
+
+// `dir` may be NULL for just the in-memory cache
+struct vspl_cache *vspl_cache_open(pl_log log, pl_gpu gpu, const char *dir);
+void vspl_cache_close(struct vspl_cache **cache);
+
+#endif //VS_PLACEBO_CACHE_H
@@ -0,0 +1,66 @@
+#include <stdatomic.h>
+
+#include "counters.h"
+#include "profile.h"
+
+static atomic_int_fast64_t vspl_counters[VSPL_NUM_COUNTERS];
+
+// Keys of the map returned by placebo.Stats()
+static const char *const vspl_counter_names[VSPL_NUM_COUNTERS] = {
+    [VSPL_COUNTER_DEBAND_FRAMES]         = "deband_frames",
+    [VSPL_COUNTER_RESAMPLE_FRAMES]       = "resample_frames",
+    [VSPL_COUNTER_TONEMAP_FRAMES]        = "tonemap_frames",
+    [VSPL_COUNTER_SHADER_FRAMES]         = "shader_frames",
+    [VSPL_COUNTER_RENDER_FRAMES]         = "render_frames",
+    [VSPL_COUNTER_ANALYZE_FRAMES]        = "analyze_frames",
+    [VSPL_COUNTER_BYTES_UPLOADED]        = "bytes_uploaded",
+    [VSPL_COUNTER_BYTES_DOWNLOADED]      = "bytes_downloaded",
+    [VSPL_COUNTER_LOCK_WAITS]            = "lock_waits",
+    [VSPL_COUNTER_LOCK_WAIT_NS]          = "lock_wait_ns",
+    [VSPL_COUNTER_LOCK_WAIT_MAX_NS]      = "lock_wait_max_ns",
+    [VSPL_COUNTER_DISK_CACHE_HITS]       = "disk_cache_hits",
+    [VSPL_COUNTER_SHADER_COMPILES]       = "shader_compiles",
+    [VSPL_COUNTER_RENDERER_CACHE_HITS]   = "renderer_cache_hits",
+    [VSPL_COUNTER_RENDERER_CACHE_MISSES] = "renderer_cache_misses",
+    [VSPL_COUNTER_TEXTURE_ALLOCS]        = "texture_allocs",
+    [VSPL_COUNTER_TEXTURE_REUSES]        = "texture_reuses",
+    [VSPL_COUNTER_TEXTURE_BYTES]         = "texture_bytes",
+    [VSPL_COUNTER_CONTEXTS]              = "contexts",
+    [VSPL_COUNTER_INSTANCES]             = "instances",
+};
+
+void vspl_counter_add(enum vspl_counter counter, int64_t value)
+{
+    atomic_fetch_add_explicit(&vspl_counters[counter], value, memory_order_relaxed);
+}
+
+void vspl_counter_max(enum vspl_counter counter, int64_t value)
+{
+    int_fast64_t cur = atomic_load_explicit(&vspl_counters[counter], memory_order_relaxed);
+    while (cur < value && !atomic_compare_exchange_weak_explicit(&vspl_counters[counter], &cur, value,
+                                                                 memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+void vspl_lock(pthread_mutex_t *lock)
+{
+    // The clock is only read when there actually is something to wait for
+    if (pthread_mutex_trylock(lock) == 0)
+        return;
+
+    const int64_t start = vspl_profile_now();
+    pthread_mutex_lock(lock);
+    const int64_t wait = vspl_profile_now() - start;
+
+    vspl_counter_add(VSPL_COUNTER_LOCK_WAITS, 1);
+    vspl_counter_add(VSPL_COUNTER_LOCK_WAIT_NS, wait);
+    vspl_counter_max(VSPL_COUNTER_LOCK_WAIT_MAX_NS, wait);
+}
+
+void VS_CC VSPlaceboStatsCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi)
+{
+    for (int i = 0; i < VSPL_NUM_COUNTERS; i++) {
+        vsapi->mapSetInt(out, vspl_counter_names[i],
+                         atomic_load_explicit(&vspl_counters[i], memory_order_relaxed), maReplace);
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef VS_PLACEBO_COUNTERS_H
+#define VS_PLACEBO_COUNTERS_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <VapourSynth4.h>
+
+// Process-wide counters, cumulative since the plugin got loaded, returned by
+// placebo.Stats(). Updates are relaxed atomics, so bumping them on every
+// frame costs next to nothing.
+enum vspl_counter {
+    VSPL_COUNTER_DEBAND_FRAMES,
+    VSPL_COUNTER_RESAMPLE_FRAMES,
+    VSPL_COUNTER_TONEMAP_FRAMES,
+    VSPL_COUNTER_SHADER_FRAMES,
+    VSPL_COUNTER_RENDER_FRAMES,
+    VSPL_COUNTER_ANALYZE_FRAMES,
+
+    VSPL_COUNTER_BYTES_UPLOADED,
+    VSPL_COUNTER_BYTES_DOWNLOADED,
+
+    // Only contended acquisitions of the locks shared between frames count
+    VSPL_COUNTER_LOCK_WAITS,
+    VSPL_COUNTER_LOCK_WAIT_NS,
+    VSPL_COUNTER_LOCK_WAIT_MAX_NS,
+
+    // Shaders and pipelines found in the cache_dir shader cache, and those
+    // that were in no cache and got compiled
+    VSPL_COUNTER_DISK_CACHE_HITS,
+    VSPL_COUNTER_SHADER_COMPILES,
+
+    // Frames of Tonemap and Render whose HDR metadata did (misses) or didn't
+    // (hits) change from the previous frame of the same renderer, which then
+    // has to regenerate its tone mapping LUT
+    VSPL_COUNTER_RENDERER_CACHE_HITS,
+    VSPL_COUNTER_RENDERER_CACHE_MISSES,
+
+    // Textures created and handed out again by the texture pools, and the
+    // memory held by all of them right now, whether in use or idle
+    VSPL_COUNTER_TEXTURE_ALLOCS,
+    VSPL_COUNTER_TEXTURE_REUSES,
+    VSPL_COUNTER_TEXTURE_BYTES,
+
+    // Vulkan contexts created, and GPU filter instances alive right now
+    VSPL_COUNTER_CONTEXTS,
+    VSPL_COUNTER_INSTANCES,
+
+    VSPL_NUM_COUNTERS,
+};
+
+void vspl_counter_add(enum vspl_counter counter, int64_t value);
+void vspl_counter_max(enum vspl_counter counter, int64_t value);
+
+// pthread_mutex_lock, counting the time spent waiting if the lock is taken
+void vspl_lock(pthread_mutex_t *lock);
+
+void VS_CC VSPlaceboStatsCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi);
+
+#endif //VS_PLACEBO_COUNTERS_H
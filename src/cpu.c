@@ -0,0 +1,17 @@
+#include "cpu.h"
+
+enum vspl_cpu_isa vspl_cpu_isa_detect(void)
+{
+#if VSPL_HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return VSPL_CPU_AVX2;
+#endif
+
+#if VSPL_HAVE_NEON
+    // Part of the baseline on aarch64
+    return VSPL_CPU_NEON;
+#endif
+
+    return VSPL_CPU_SCALAR;
+}
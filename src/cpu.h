@@ -0,0 +1,28 @@
+#ifndef VS_PLACEBO_CPU_H
+#define VS_PLACEBO_CPU_H
+
+// Instruction sets the CPU backends have kernels for. The AVX2 kernels are
+// built with target attributes, so the rest of the plugin still runs on any
+// x86 CPU, and picked at runtime.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define VSPL_HAVE_AVX2 1
+#else
+#define VSPL_HAVE_AVX2 0
+#endif
+
+#if defined(__aarch64__)
+#define VSPL_HAVE_NEON 1
+#else
+#define VSPL_HAVE_NEON 0
+#endif
+
+enum vspl_cpu_isa {
+    VSPL_CPU_SCALAR = 0,
+    VSPL_CPU_AVX2,
+    VSPL_CPU_NEON,
+};
+
+// The best instruction set both built in and supported by this CPU
+enum vspl_cpu_isa vspl_cpu_isa_detect(void);
+
+#endif //VS_PLACEBO_CPU_H
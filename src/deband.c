@@ -7,6 +7,9 @@
 #include <VSHelper4.h>
 
 #include "vs-placebo.h"
+#include "resident.h"
+#include "deband.h"
+#include "deband_cpu.h"
 
 typedef struct {
     VSNode *node;
@@ -15,39 +18,82 @@ typedef struct {
     unsigned int planes;
     int dither;
     struct pl_render_params *render_params;
-    uint8_t frame_index;
+
+    // The CPU backend leaves `vf` NULL
+    enum vspl_backend backend;
+    struct vspl_deband_cpu_params cpu_params;
+    bool profile;
+
+    // Tells the instance apart in traces
+    int trace_id;
 } DebandData;
 
-bool vspl_deband_do_image(DebandData *dbd_data, struct pl_frame *src_img, struct pl_frame *dst_img, VSCore *core, const VSAPI *vsapi)
+static bool vspl_deband_cpu_frame(DebandData *dbd_data, int n, const VSFrame *frame, VSFrame *dst,
+                                  VSCore *core, const VSAPI *vsapi)
+{
+    const VSVideoFormat *fmt = &dbd_data->vi->format;
+    int plane_idx = 0;
+    bool ok = true;
+
+    for (int i = 0; i < fmt->numPlanes; i++) {
+        const uint8_t *src_ptr = vsapi->getReadPtr(frame, i);
+        uint8_t *dst_ptr = vsapi->getWritePtr(dst, i);
+        const int w = vsapi->getFrameWidth(frame, i);
+        const int h = vsapi->getFrameHeight(frame, i);
+
+        if (!((1u << i) & dbd_data->planes)) {
+            vsh_bitblt(dst_ptr, vsapi->getStride(dst, i), src_ptr, vsapi->getStride(frame, i),
+                       w * fmt->bytesPerSample, h);
+            continue;
+        }
+
+        // Seeded like the shaders of the GPU backend
+        ok &= vspl_deband_cpu_plane(&dbd_data->cpu_params, fmt, src_ptr, vsapi->getStride(frame, i),
+                                    dst_ptr, vsapi->getStride(dst, i), w, h,
+                                    (uint8_t) (n * MAX_PLANES + plane_idx));
+        plane_idx++;
+    }
+
+    if (!ok) {
+        vsapi->logMessage(mtCritical, "placebo.Deband: Failed allocating memory!", core);
+    }
+
+    return ok;
+}
+
+bool vspl_deband_do_image(DebandData *dbd_data, struct vspl_slot *s, int n, struct pl_frame *src_img, struct pl_frame *dst_img, VSCore *core, const VSAPI *vsapi)
 {
     struct priv *p = dbd_data->vf;
     bool ok = true;
 
     for (int i = 0; i < src_img->num_planes; i++) {
-        pl_shader sh = pl_dispatch_begin(p->dp);
+        pl_shader sh = pl_dispatch_begin(s->dp);
         pl_shader_reset(sh, pl_shader_params(
             .gpu = p->gpu,
-            .index = dbd_data->frame_index++,
+            // Seed the PRNG from the frame number, so the output doesn't
+            // depend on the order in which parallel requests arrive
+            .index = (uint8_t) (n * MAX_PLANES + i),
         ));
 
         struct pl_sample_src *src = pl_sample_src(
-            .tex = p->tex_in[i]
+            .tex = src_img->planes[i].texture
         );
 
-        int new_depth = p->tex_out[i]->params.format->component_depth[i];
+        int new_depth = s->tex_out[i]->params.format->component_depth[i];
 
         pl_shader_deband(sh, src, dbd_data->render_params->deband_params);
 
         if (dbd_data->dither)
-            pl_shader_dither(sh, new_depth, &p->dither_state, dbd_data->render_params->dither_params);
+            pl_shader_dither(sh, new_depth, &s->dither_state, dbd_data->render_params->dither_params);
 
-        ok &= pl_dispatch_finish(p->dp, pl_dispatch_params(
-            .target = p->tex_out[i],
+        ok &= pl_dispatch_finish(s->dp, pl_dispatch_params(
+            .target = s->tex_out[i],
             .shader = &sh,
+            .timer = s->prof.render,
         ));
     }
 
-    // ok &= pl_render_image(p->rr, src_img, dst_img, dbd_data->render_params);
+    // ok &= pl_render_image(s->rr, src_img, dst_img, dbd_data->render_params);
 
     if (!ok) {
         vsapi->logMessage(mtCritical, "placebo.Deband: Failed processing planes!", core);
@@ -56,7 +102,7 @@ bool vspl_deband_do_image(DebandData *dbd_data, struct pl_frame *src_img, struct
     return ok;
 }
 
-bool vspl_deband_reconfig(DebandData *dbd_data, VSFrame *dst, VSCore *core, const VSAPI *vsapi, int plane_idx, const struct pl_plane_data *data)
+bool vspl_deband_reconfig(DebandData *dbd_data, struct vspl_slot *s, VSFrame *dst, VSCore *core, const VSAPI *vsapi, int plane_idx, const struct pl_plane_data *data, bool upload)
 {
     struct priv *p = dbd_data->vf;
 
@@ -68,21 +114,26 @@ bool vspl_deband_reconfig(DebandData *dbd_data, VSFrame *dst, VSCore *core, cons
         return false;
     }
 
-    ok &= pl_tex_recreate(p->gpu, &p->tex_in[plane_idx], pl_tex_params(
-        .w = data->width,
-        .h = data->height,
-        .format = fmt,
-        .sampleable = true,
-        .host_writable = true,
-    ));
+    if (upload) {
+        ok &= vspl_tex_pool_recreate(p->pool, &s->tex_in[plane_idx], pl_tex_params(
+            .w = data->width,
+            .h = data->height,
+            .format = fmt,
+            .sampleable = true,
+            .host_writable = true,
+            // What pl_upload_plane asks for, so it never has to recreate the texture
+            .blit_src = fmt->caps & PL_FMT_CAP_BLITTABLE,
+        ));
+    }
 
     int vs_plane = data->component_map[0];
-    ok &= pl_tex_recreate(p->gpu, &p->tex_out[plane_idx], pl_tex_params(
+    ok &= vspl_tex_pool_recreate(p->pool, &s->tex_out[plane_idx], pl_tex_params(
         .w = vsapi->getFrameWidth(dst, vs_plane),
         .h = vsapi->getFrameHeight(dst, vs_plane),
         .format = fmt,
         .renderable = true,
         .host_readable = true,
+        .sampleable = p->resident,
     ));
 
     if (!ok) {
@@ -92,13 +143,13 @@ bool vspl_deband_reconfig(DebandData *dbd_data, VSFrame *dst, VSCore *core, cons
     return ok;
 }
 
-bool vspl_deband_upload_plane(DebandData *dbd_data, VSCore *core, const VSAPI *vsapi, int plane_idx, const struct pl_plane_data *data, struct pl_plane *plane)
+bool vspl_deband_upload_plane(DebandData *dbd_data, struct vspl_slot *s, VSCore *core, const VSAPI *vsapi, int plane_idx, const struct pl_plane_data *data, struct pl_plane *plane)
 {
     struct priv *p = dbd_data->vf;
 
     // Upload planes
 
-    bool ok = pl_upload_plane(p->gpu, plane, &p->tex_in[plane_idx], data);
+    bool ok = vspl_upload_plane(p->gpu, &s->xfer, plane, &s->tex_in[plane_idx], data);
 
     if (!ok) {
         vsapi->logMessage(mtCritical, "placebo.Deband: Failed downloading data from the GPU!", core);
@@ -107,7 +158,7 @@ bool vspl_deband_upload_plane(DebandData *dbd_data, VSCore *core, const VSAPI *v
     return ok;
 }
 
-bool vspl_deband_download_planes(DebandData *dbd_data, VSCore *core, const VSAPI *vsapi, VSFrame *vs_dst, const struct pl_plane_data *data, struct pl_frame *dst_img)
+bool vspl_deband_download_planes(DebandData *dbd_data, struct vspl_slot *s, VSCore *core, const VSAPI *vsapi, VSFrame *vs_dst, const struct pl_plane_data *data, struct pl_frame *dst_img)
 {
     struct priv *p = dbd_data->vf;
 
@@ -119,17 +170,19 @@ bool vspl_deband_download_planes(DebandData *dbd_data, VSCore *core, const VSAPI
 
         int vs_plane = target_plane->component_mapping[0];
 
-        pl_fmt out_fmt = p->tex_out[i]->params.format;
+        pl_fmt out_fmt = s->tex_out[i]->params.format;
         uint8_t *dst_ptr = vsapi->getWritePtr(vs_dst, vs_plane);
         int dst_row_pitch = (vsapi->getStride(vs_dst, vs_plane) / data[i].pixel_stride) * out_fmt->texel_size;
 
-        ok &= pl_tex_download(p->gpu, pl_tex_transfer_params(
-            .tex = p->tex_out[i],
+        ok &= vspl_download_async(p->gpu, &s->xfer, pl_tex_transfer_params(
+            .tex = s->tex_out[i],
             .row_pitch = dst_row_pitch,
             .ptr = (void *) dst_ptr,
         ));
     }
 
+    vspl_download_wait(p->gpu, &s->xfer);
+
     if (!ok) {
         vsapi->logMessage(mtCritical, "placebo.Deband: Failed downloading data from the GPU!", core);
     }
@@ -143,6 +196,9 @@ static const VSFrame *VS_CC VSPlaceboDebandGetFrame(int n, int activationReason,
     if (activationReason == arInitial) {
         vsapi->requestFrameFilter(n, dbd_data->node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
+        vspl_counter_add(VSPL_COUNTER_DEBAND_FRAMES, 1);
+        vspl_trace_frame("Deband", dbd_data->trace_id, n);
+
         const VSFrame *frame = vsapi->getFrameFilter(n, dbd_data->node, frameCtx);
 
         int ih = vsapi->getFrameHeight(frame, 0);
@@ -151,6 +207,17 @@ static const VSFrame *VS_CC VSPlaceboDebandGetFrame(int n, int activationReason,
         const VSVideoFormat srcFmt = dbd_data->vi->format;
         VSFrame *dst = vsapi->newVideoFrame(&srcFmt, iw, ih, frame, core);
 
+        if (dbd_data->backend == VSPL_BACKEND_CPU) {
+            const int64_t start = dbd_data->profile ? vspl_profile_now() : 0;
+            const int64_t trace = vspl_trace_begin();
+            vspl_deband_cpu_frame(dbd_data, n, frame, dst, core, vsapi);
+            vspl_trace_end(VSPL_TRACE_CPU, trace);
+            if (dbd_data->profile)
+                vspl_profile_write_cpu(start, vsapi->getFramePropertiesRW(dst), vsapi);
+            vsapi->freeFrame(frame);
+            return dst;
+        }
+
         struct pl_color_repr repr = {
             .bits = {
                 .sample_depth = dbd_data->vi->format.bitsPerSample,
@@ -166,10 +233,14 @@ static const VSFrame *VS_CC VSPlaceboDebandGetFrame(int n, int activationReason,
         };
         struct pl_frame dst_img = src_img;
 
-        pthread_mutex_lock(&vspl_vulkan_mutex);
-
         struct priv *p = dbd_data->vf;
 
+        struct vspl_slot *s = vspl_slot_acquire(p);
+
+        struct vspl_resident_ref res;
+        vspl_resident_ref(p, frame, &res, vsapi);
+        pl_tex *out_tex[MAX_PLANES] = {0};
+
         int numPlanes = srcFmt.numPlanes;
         int plane_idx = 0;
 
@@ -198,14 +269,28 @@ static const VSFrame *VS_CC VSPlaceboDebandGetFrame(int n, int activationReason,
                     .component_map[0] = i,
                 };
 
-                if (vspl_deband_reconfig(dbd_data, dst, core, vsapi, plane_idx, &data[plane_idx])) {
-                    vspl_deband_upload_plane(dbd_data, core, vsapi, plane_idx, &data[plane_idx], &src_img.planes[plane_idx]);
+                pl_tex resident_tex = vspl_resident_tex(&res, i);
+                const int64_t trace = vspl_trace_begin();
+                bool ok = vspl_deband_reconfig(dbd_data, s, dst, core, vsapi, plane_idx, &data[plane_idx], !resident_tex);
+                vspl_trace_end(VSPL_TRACE_RECONFIG, trace);
+                if (ok) {
+                    if (resident_tex) {
+                        src_img.planes[plane_idx] = (struct pl_plane) {
+                            .texture = resident_tex,
+                            .components = 1,
+                            .component_mapping[0] = i,
+                        };
+                    } else {
+                        vspl_deband_upload_plane(dbd_data, s, core, vsapi, plane_idx, &data[plane_idx], &src_img.planes[plane_idx]);
+                    }
                 }
 
+                out_tex[i] = &s->tex_out[plane_idx];
+
                 // Create a plane for target
                 dst_img.planes[plane_idx] = (struct pl_plane) {
-                    .texture = p->tex_out[plane_idx],
-                    .components = p->tex_out[plane_idx]->params.format->num_components,
+                    .texture = s->tex_out[plane_idx],
+                    .components = s->tex_out[plane_idx]->params.format->num_components,
                     .component_mapping[0] = i,
                 };
 
@@ -215,11 +300,17 @@ static const VSFrame *VS_CC VSPlaceboDebandGetFrame(int n, int activationReason,
 
         dst_img.num_planes = src_img.num_planes;
 
-        if (vspl_deband_do_image(dbd_data, &src_img, &dst_img, core, vsapi)) {
-            vspl_deband_download_planes(dbd_data, core, vsapi, dst, data, &dst_img);
+        const int64_t trace = vspl_trace_begin();
+        bool rendered = vspl_deband_do_image(dbd_data, s, n, &src_img, &dst_img, core, vsapi);
+        vspl_trace_end(VSPL_TRACE_RENDER, trace);
+        if (rendered) {
+            vspl_deband_download_planes(dbd_data, s, core, vsapi, dst, data, &dst_img);
         }
 
-        pthread_mutex_unlock(&vspl_vulkan_mutex);
+        vspl_resident_unref(&res, vsapi);
+        vspl_resident_export(p, dst, out_tex, core, vsapi);
+        vspl_slot_profile(p, s, dst, vsapi);
+        vspl_slot_release(p, s);
 
         vsapi->freeFrame(frame);
         return dst;
@@ -231,22 +322,53 @@ static const VSFrame *VS_CC VSPlaceboDebandGetFrame(int n, int activationReason,
 static void VS_CC VSPlaceboDebandFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     DebandData *d = (DebandData *) instanceData;
     vsapi->freeNode(d->node);
-    VSPlaceboUninit(d->vf);
+    if (d->vf)
+        VSPlaceboUninit(d->vf);
     free((void *) d->render_params->dither_params);
     free((void *) d->render_params->deband_params);
     free(d->render_params);
     free(d);
 }
 
+struct pl_deband_params *vspl_deband_params_read(const VSMap *in, const char *prefix, const VSAPI *vsapi)
+{
+    int err;
+    char key[64];
+    struct pl_deband_params *debandParams = malloc(sizeof(struct pl_deband_params));
+    *debandParams = pl_deband_default_params;
+
+#define DB_PARAM(par, type) snprintf(key, sizeof(key), "%s%s", prefix, #par); \
+        debandParams->par = vsapi->mapGet##type(in, key, 0, &err); \
+        if (err) debandParams->par = pl_deband_default_params.par;
+
+    DB_PARAM(iterations, Int)
+    DB_PARAM(threshold, Float)
+    DB_PARAM(radius, Float)
+    DB_PARAM(grain, Float)
+
+    return debandParams;
+}
+
+struct pl_dither_params *vspl_dither_params_read(const VSMap *in, const VSAPI *vsapi)
+{
+    int err;
+    struct pl_dither_params *plDitherParams = malloc(sizeof(struct pl_dither_params));
+    *plDitherParams = pl_dither_default_params;
+
+    plDitherParams->method = vsapi->mapGetInt(in, "dither_algo", 0, &err);
+    if (err)
+        plDitherParams->method = pl_dither_default_params.method;
+
+    return plDitherParams;
+}
+
 void VS_CC VSPlaceboDebandCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
     DebandData d;
     DebandData *data;
     int err;
-    enum pl_log_level log_level;
-
-    log_level = vsapi->mapGetInt(in, "log_level", 0, &err);
-    if (err)
-        log_level = PL_LOG_ERR;
+    struct vspl_init_params init_params;
+    vspl_init_params_read(&init_params, in, core, vsapi);
+    d.trace_id = vspl_trace_id();
 
     d.node = vsapi->mapGetNode(in, "clip", 0, 0);
     d.vi = vsapi->getVideoInfo(d.node);
@@ -256,7 +378,19 @@ void VS_CC VSPlaceboDebandCreate(const VSMap *in, VSMap *out, void *userData, VS
         vsapi->freeNode(d.node);
     }
 
-    d.vf = VSPlaceboInit(log_level);
+    if (!vspl_backend_read(&d.backend, in, vsapi)) {
+        vsapi->mapSetError(out, "placebo.Deband: backend must be \"gpu\", \"cpu\" or \"auto\"!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    d.vf = vspl_backend_init(&d.backend, &init_params);
+    d.profile = init_params.profile;
+    if (d.backend == VSPL_BACKEND_GPU && !d.vf) {
+        vsapi->mapSetError(out, "placebo.Deband: Failed initializing libplacebo!");
+        vsapi->freeNode(d.node);
+        return;
+    }
 
     d.dither = vsapi->mapGetInt(in, "dither", 0, &err) && d.vi->format.bitsPerSample == 8;
     if (err)
@@ -266,23 +400,8 @@ void VS_CC VSPlaceboDebandCreate(const VSMap *in, VSMap *out, void *userData, VS
     if (err)
         d.planes = 1u;
 
-    struct pl_deband_params *debandParams = malloc(sizeof(struct pl_deband_params));
-    *debandParams = pl_deband_default_params;
-
-#define DB_PARAM(par, type) debandParams->par = vsapi->mapGet##type(in, #par, 0, &err); \
-        if (err) debandParams->par = pl_deband_default_params.par;
-
-    DB_PARAM(iterations, Int)
-    DB_PARAM(threshold, Float)
-    DB_PARAM(radius, Float)
-    DB_PARAM(grain, Float)
-
-    struct pl_dither_params *plDitherParams = malloc(sizeof(struct pl_dither_params));
-    *plDitherParams = pl_dither_default_params;
-
-    plDitherParams->method = vsapi->mapGetInt(in, "dither_algo", 0, &err);
-    if (err)
-        plDitherParams->method = pl_dither_default_params.method;
+    struct pl_deband_params *debandParams = vspl_deband_params_read(in, "", vsapi);
+    struct pl_dither_params *plDitherParams = vspl_dither_params_read(in, vsapi);
 
     struct pl_render_params *render_params = malloc(sizeof(struct pl_render_params));
     *render_params = pl_render_fast_params;
@@ -291,7 +410,22 @@ void VS_CC VSPlaceboDebandCreate(const VSMap *in, VSMap *out, void *userData, VS
     render_params->deband_params = debandParams;
 
     d.render_params = render_params;
-    d.frame_index = 0;
+
+    if (d.backend == VSPL_BACKEND_CPU && debandParams->iterations > VSPL_DEBAND_CPU_MAX_ITERATIONS) {
+        vsapi->mapSetError(out, "placebo.Deband: The CPU backend supports at most 16 iterations!");
+        vsapi->freeNode(d.node);
+        free(debandParams);
+        free(plDitherParams);
+        free(render_params);
+        return;
+    }
+
+    d.cpu_params = (struct vspl_deband_cpu_params) {
+        .deband = *debandParams,
+        .dither = d.dither,
+        .dither_method = plDitherParams->method,
+        .isa = vspl_cpu_isa_detect(),
+    };
 
     data = malloc(sizeof(d));
     *data = d;
@@ -304,7 +438,8 @@ void VS_CC VSPlaceboDebandCreate(const VSMap *in, VSMap *out, void *userData, VS
         d.vi,
         VSPlaceboDebandGetFrame,
         VSPlaceboDebandFree,
-        fmParallelRequests,
+        // Without slots to wait for, frames run fully in parallel
+        d.backend == VSPL_BACKEND_CPU ? fmParallel : fmParallelRequests,
         deps,
         1,
         data,
@@ -3,6 +3,15 @@
 
 #include <VapourSynth4.h>
 
+#include <libplacebo/shaders/sampling.h>
+#include <libplacebo/shaders/dithering.h>
+
+// Parse the deband and dithering arguments, the results are malloc'd. The
+// deband argument names are prefixed with `prefix`, for filters where e.g.
+// `radius` already means something else.
+struct pl_deband_params *vspl_deband_params_read(const VSMap *in, const char *prefix, const VSAPI *vsapi);
+struct pl_dither_params *vspl_dither_params_read(const VSMap *in, const VSAPI *vsapi);
+
 void VS_CC VSPlaceboDebandCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi);
 
 #endif //VS_PLACEBO_DEBAND_H
@@ -0,0 +1,381 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "deband_cpu.h"
+
+#if VSPL_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#if VSPL_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+// Sample directions, instead of taking the cosine and sine of a random angle
+#define VSPL_DEBAND_DIRS 64
+
+struct vspl_deband_ctx {
+    // The whole plane, normalized
+    const float *src;
+    int w, h;
+
+    int iterations;
+    float radius;
+    float threshold;
+    float grain;
+
+    float cos_dir[VSPL_DEBAND_DIRS];
+    float sin_dir[VSPL_DEBAND_DIRS];
+
+    // Per row: the grain, then one for each iteration
+    uint32_t keys[VSPL_DEBAND_CPU_MAX_ITERATIONS + 1];
+};
+
+static inline uint32_t vspl_hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static inline uint32_t vspl_deband_key(uint32_t seed, int y, int i)
+{
+    return vspl_hash(seed ^ vspl_hash((uint32_t) y * 0x9e3779b9u ^ (uint32_t) i * 0x85ebca6bu));
+}
+
+// Random number in [0, 1) from the top 24 bits of a hash
+static inline float vspl_unorm24(uint32_t h)
+{
+    return (float) (h >> 8) * (1.0f / 16777216.0f);
+}
+
+static inline int vspl_clamp(int v, int max)
+{
+    return v < 0 ? 0 : v > max ? max : v;
+}
+
+static float vspl_deband_pixel(const struct vspl_deband_ctx *c, int x, int y)
+{
+    const float *src = c->src;
+    const int w = c->w;
+    float color = src[(size_t) y * w + x];
+
+    for (int i = 1; i <= c->iterations; i++) {
+        uint32_t h = vspl_hash((uint32_t) x + c->keys[i]);
+        float dist = vspl_unorm24(h) * (c->radius * i);
+        int dir = h & (VSPL_DEBAND_DIRS - 1);
+
+        int ox = (int) lrintf(dist * c->cos_dir[dir]);
+        int oy = (int) lrintf(dist * c->sin_dir[dir]);
+
+        int xa = vspl_clamp(x + ox, w - 1), xb = vspl_clamp(x - ox, w - 1);
+        size_t ya = (size_t) vspl_clamp(y + oy, c->h - 1) * w;
+        size_t yb = (size_t) vspl_clamp(y - oy, c->h - 1) * w;
+
+        float avg = 0.25f * (((src[ya + xa] + src[ya + xb]) + src[yb + xb]) + src[yb + xa]);
+
+        // Keep the original if it differs too much from its surroundings
+        if (!(fabsf(color - avg) > c->threshold / i))
+            color = avg;
+    }
+
+    if (c->grain > 0) {
+        uint32_t h = vspl_hash((uint32_t) x + c->keys[0]);
+        color = color + c->grain * (vspl_unorm24(h) - 0.5f);
+    }
+
+    return color;
+}
+
+static void vspl_deband_row_c(const struct vspl_deband_ctx *c, int y, int x, float *out)
+{
+    for (; x < c->w; x++)
+        out[x] = vspl_deband_pixel(c, x, y);
+}
+
+#if VSPL_HAVE_AVX2
+
+#define VSPL_AVX2 __attribute__((target("avx2")))
+
+VSPL_AVX2 static inline __m256i vspl_hash_avx2(__m256i x)
+{
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int) 0x7feb352du));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int) 0x846ca68bu));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    return x;
+}
+
+VSPL_AVX2 static inline __m256 vspl_unorm24_avx2(__m256i h)
+{
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(h, 8)), _mm256_set1_ps(1.0f / 16777216.0f));
+}
+
+VSPL_AVX2 static inline __m256i vspl_clamp_avx2(__m256i v, __m256i max)
+{
+    return _mm256_max_epi32(_mm256_min_epi32(v, max), _mm256_setzero_si256());
+}
+
+VSPL_AVX2 static void vspl_deband_row_avx2(const struct vspl_deband_ctx *c, int y, float *out)
+{
+    const float *src = c->src;
+    const float *row = src + (size_t) y * c->w;
+
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i max_x = _mm256_set1_epi32(c->w - 1);
+    const __m256i max_y = _mm256_set1_epi32(c->h - 1);
+    const __m256i stride = _mm256_set1_epi32(c->w);
+    const __m256i dir_mask = _mm256_set1_epi32(VSPL_DEBAND_DIRS - 1);
+    const __m256i vy = _mm256_set1_epi32(y);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+
+    int x = 0;
+    for (; x + 8 <= c->w; x += 8) {
+        const __m256i vx = _mm256_add_epi32(_mm256_set1_epi32(x), lanes);
+        __m256 color = _mm256_loadu_ps(row + x);
+
+        for (int i = 1; i <= c->iterations; i++) {
+            __m256i h = vspl_hash_avx2(_mm256_add_epi32(vx, _mm256_set1_epi32((int) c->keys[i])));
+            __m256 dist = _mm256_mul_ps(vspl_unorm24_avx2(h), _mm256_set1_ps(c->radius * i));
+            __m256i dir = _mm256_and_si256(h, dir_mask);
+
+            __m256i ox = _mm256_cvtps_epi32(_mm256_mul_ps(dist, _mm256_i32gather_ps(c->cos_dir, dir, 4)));
+            __m256i oy = _mm256_cvtps_epi32(_mm256_mul_ps(dist, _mm256_i32gather_ps(c->sin_dir, dir, 4)));
+
+            __m256i xa = vspl_clamp_avx2(_mm256_add_epi32(vx, ox), max_x);
+            __m256i xb = vspl_clamp_avx2(_mm256_sub_epi32(vx, ox), max_x);
+            __m256i ya = _mm256_mullo_epi32(vspl_clamp_avx2(_mm256_add_epi32(vy, oy), max_y), stride);
+            __m256i yb = _mm256_mullo_epi32(vspl_clamp_avx2(_mm256_sub_epi32(vy, oy), max_y), stride);
+
+            __m256 sum = _mm256_add_ps(_mm256_i32gather_ps(src, _mm256_add_epi32(ya, xa), 4),
+                                       _mm256_i32gather_ps(src, _mm256_add_epi32(ya, xb), 4));
+            sum = _mm256_add_ps(sum, _mm256_i32gather_ps(src, _mm256_add_epi32(yb, xb), 4));
+            sum = _mm256_add_ps(sum, _mm256_i32gather_ps(src, _mm256_add_epi32(yb, xa), 4));
+            __m256 avg = _mm256_mul_ps(quarter, sum);
+
+            __m256 diff = _mm256_and_ps(_mm256_sub_ps(color, avg), abs_mask);
+            __m256 keep = _mm256_cmp_ps(diff, _mm256_set1_ps(c->threshold / i), _CMP_GT_OQ);
+            color = _mm256_blendv_ps(avg, color, keep);
+        }
+
+        if (c->grain > 0) {
+            __m256i h = vspl_hash_avx2(_mm256_add_epi32(vx, _mm256_set1_epi32((int) c->keys[0])));
+            __m256 noise = _mm256_sub_ps(vspl_unorm24_avx2(h), _mm256_set1_ps(0.5f));
+            color = _mm256_add_ps(color, _mm256_mul_ps(_mm256_set1_ps(c->grain), noise));
+        }
+
+        _mm256_storeu_ps(out + x, color);
+    }
+
+    vspl_deband_row_c(c, y, x, out);
+}
+
+#endif // VSPL_HAVE_AVX2
+
+#if VSPL_HAVE_NEON
+
+static inline uint32x4_t vspl_hash_neon(uint32x4_t x)
+{
+    x = veorq_u32(x, vshrq_n_u32(x, 16));
+    x = vmulq_u32(x, vdupq_n_u32(0x7feb352du));
+    x = veorq_u32(x, vshrq_n_u32(x, 15));
+    x = vmulq_u32(x, vdupq_n_u32(0x846ca68bu));
+    x = veorq_u32(x, vshrq_n_u32(x, 16));
+    return x;
+}
+
+static inline float32x4_t vspl_unorm24_neon(uint32x4_t h)
+{
+    return vmulq_f32(vcvtq_f32_u32(vshrq_n_u32(h, 8)), vdupq_n_f32(1.0f / 16777216.0f));
+}
+
+static inline int32x4_t vspl_clamp_neon(int32x4_t v, int32x4_t max)
+{
+    return vmaxq_s32(vminq_s32(v, max), vdupq_n_s32(0));
+}
+
+// No gathers on NEON
+static inline float32x4_t vspl_gather_neon(const float *base, int32x4_t idx)
+{
+    int32_t i[4];
+    vst1q_s32(i, idx);
+
+    const float v[4] = {base[i[0]], base[i[1]], base[i[2]], base[i[3]]};
+    return vld1q_f32(v);
+}
+
+static void vspl_deband_row_neon(const struct vspl_deband_ctx *c, int y, float *out)
+{
+    const float *src = c->src;
+    const float *row = src + (size_t) y * c->w;
+
+    const int32_t lane_init[4] = {0, 1, 2, 3};
+    const int32x4_t lanes = vld1q_s32(lane_init);
+    const int32x4_t max_x = vdupq_n_s32(c->w - 1);
+    const int32x4_t max_y = vdupq_n_s32(c->h - 1);
+    const int32x4_t stride = vdupq_n_s32(c->w);
+    const int32x4_t vy = vdupq_n_s32(y);
+
+    int x = 0;
+    for (; x + 4 <= c->w; x += 4) {
+        const int32x4_t vx = vaddq_s32(vdupq_n_s32(x), lanes);
+        float32x4_t color = vld1q_f32(row + x);
+
+        for (int i = 1; i <= c->iterations; i++) {
+            uint32x4_t h = vspl_hash_neon(vaddq_u32(vreinterpretq_u32_s32(vx), vdupq_n_u32(c->keys[i])));
+            float32x4_t dist = vmulq_f32(vspl_unorm24_neon(h), vdupq_n_f32(c->radius * i));
+            int32x4_t dir = vreinterpretq_s32_u32(vandq_u32(h, vdupq_n_u32(VSPL_DEBAND_DIRS - 1)));
+
+            int32x4_t ox = vcvtnq_s32_f32(vmulq_f32(dist, vspl_gather_neon(c->cos_dir, dir)));
+            int32x4_t oy = vcvtnq_s32_f32(vmulq_f32(dist, vspl_gather_neon(c->sin_dir, dir)));
+
+            int32x4_t xa = vspl_clamp_neon(vaddq_s32(vx, ox), max_x);
+            int32x4_t xb = vspl_clamp_neon(vsubq_s32(vx, ox), max_x);
+            int32x4_t ya = vmulq_s32(vspl_clamp_neon(vaddq_s32(vy, oy), max_y), stride);
+            int32x4_t yb = vmulq_s32(vspl_clamp_neon(vsubq_s32(vy, oy), max_y), stride);
+
+            float32x4_t sum = vaddq_f32(vspl_gather_neon(src, vaddq_s32(ya, xa)),
+                                        vspl_gather_neon(src, vaddq_s32(ya, xb)));
+            sum = vaddq_f32(sum, vspl_gather_neon(src, vaddq_s32(yb, xb)));
+            sum = vaddq_f32(sum, vspl_gather_neon(src, vaddq_s32(yb, xa)));
+            float32x4_t avg = vmulq_f32(vdupq_n_f32(0.25f), sum);
+
+            uint32x4_t keep = vcgtq_f32(vabdq_f32(color, avg), vdupq_n_f32(c->threshold / i));
+            color = vbslq_f32(keep, color, avg);
+        }
+
+        if (c->grain > 0) {
+            uint32x4_t h = vspl_hash_neon(vaddq_u32(vreinterpretq_u32_s32(vx), vdupq_n_u32(c->keys[0])));
+            float32x4_t noise = vsubq_f32(vspl_unorm24_neon(h), vdupq_n_f32(0.5f));
+            color = vaddq_f32(color, vmulq_f32(vdupq_n_f32(c->grain), noise));
+        }
+
+        vst1q_f32(out + x, color);
+    }
+
+    vspl_deband_row_c(c, y, x, out);
+}
+
+#endif // VSPL_HAVE_NEON
+
+// Bit-reversed interleaving of x ^ y and y, i.e. a Bayer matrix
+static int vspl_bayer16(int x, int y)
+{
+    int a = x ^ y, v = 0;
+    for (int bit = 0; bit < 4; bit++)
+        v = (v << 2) | (((a >> bit) & 1) << 1) | ((y >> bit) & 1);
+
+    return v;
+}
+
+static void vspl_deband_store_row(const struct vspl_deband_cpu_params *params, const VSVideoFormat *fmt,
+                                  const float *in, uint8_t *dst, int w, int y, uint32_t seed)
+{
+    if (fmt->sampleType == stFloat) {
+        memcpy(dst, in, w * sizeof(float));
+        return;
+    }
+
+    const float max = (float) ((1 << fmt->bitsPerSample) - 1);
+
+    // Rounding, unless dithered
+    float bias[16];
+    for (int x = 0; x < 16; x++)
+        bias[x] = params->dither ? (vspl_bayer16(x, y & 15) + 0.5f) / 256.0f : 0.5f;
+
+    const bool white_noise = params->dither && params->dither_method == PL_DITHER_WHITE_NOISE;
+    const uint32_t key = vspl_deband_key(seed, y, VSPL_DEBAND_CPU_MAX_ITERATIONS + 1);
+
+    for (int x = 0; x < w; x++) {
+        float b = white_noise ? vspl_unorm24(vspl_hash((uint32_t) x + key)) : bias[x & 15];
+        float v = floorf(in[x] * max + b);
+        v = v < 0 ? 0 : v > max ? max : v;
+
+        if (fmt->bytesPerSample == 1) {
+            dst[x] = (uint8_t) v;
+        } else {
+            ((uint16_t *) dst)[x] = (uint16_t) v;
+        }
+    }
+}
+
+static void vspl_deband_load(const VSVideoFormat *fmt, const uint8_t *src, ptrdiff_t stride,
+                             float *out, int w, int h)
+{
+    const float scale = fmt->sampleType == stFloat ? 1.0f : 1.0f / ((1 << fmt->bitsPerSample) - 1);
+
+    for (int y = 0; y < h; y++, src += stride, out += w) {
+        if (fmt->sampleType == stFloat) {
+            memcpy(out, src, w * sizeof(float));
+        } else if (fmt->bytesPerSample == 1) {
+            for (int x = 0; x < w; x++)
+                out[x] = src[x] * scale;
+        } else {
+            const uint16_t *src16 = (const uint16_t *) src;
+            for (int x = 0; x < w; x++)
+                out[x] = src16[x] * scale;
+        }
+    }
+}
+
+bool vspl_deband_cpu_plane(const struct vspl_deband_cpu_params *params, const VSVideoFormat *fmt,
+                           const uint8_t *src, ptrdiff_t src_stride, uint8_t *dst, ptrdiff_t dst_stride,
+                           int w, int h, uint32_t seed)
+{
+    float *plane = malloc((size_t) w * h * sizeof(float));
+    float *row = malloc((size_t) w * sizeof(float));
+    if (!plane || !row) {
+        free(plane);
+        free(row);
+        return false;
+    }
+
+    vspl_deband_load(fmt, src, src_stride, plane, w, h);
+
+    // Same units as the shader
+    struct vspl_deband_ctx c = {
+        .src = plane,
+        .w = w,
+        .h = h,
+        .iterations = params->deband.iterations,
+        .radius = params->deband.radius,
+        .threshold = params->deband.threshold / 1000.0f,
+        .grain = params->deband.grain / 1000.0f,
+    };
+
+    if (c.iterations > VSPL_DEBAND_CPU_MAX_ITERATIONS)
+        c.iterations = VSPL_DEBAND_CPU_MAX_ITERATIONS;
+
+    for (int i = 0; i < VSPL_DEBAND_DIRS; i++) {
+        const float angle = 6.28318530717958647692f * i / VSPL_DEBAND_DIRS;
+        c.cos_dir[i] = cosf(angle);
+        c.sin_dir[i] = sinf(angle);
+    }
+
+    for (int y = 0; y < h; y++) {
+        for (int i = 0; i <= c.iterations; i++)
+            c.keys[i] = vspl_deband_key(seed, y, i);
+
+        switch (params->isa) {
+#if VSPL_HAVE_AVX2
+        case VSPL_CPU_AVX2: vspl_deband_row_avx2(&c, y, row); break;
+#endif
+#if VSPL_HAVE_NEON
+        case VSPL_CPU_NEON: vspl_deband_row_neon(&c, y, row); break;
+#endif
+        default: vspl_deband_row_c(&c, y, 0, row); break;
+        }
+
+        vspl_deband_store_row(params, fmt, row, dst + y * dst_stride, w, y, seed);
+    }
+
+    free(row);
+    free(plane);
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef VS_PLACEBO_DEBAND_CPU_H
+#define VS_PLACEBO_DEBAND_CPU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <VapourSynth4.h>
+
+#include <libplacebo/shaders/dithering.h>
+#include <libplacebo/shaders/sampling.h>
+
+#include "cpu.h"
+
+// The algorithm of pl_shader_deband, followed by pl_shader_dither, on the
+// CPU. Unlike the GPU, samples are taken at whole pixel offsets, and the
+// random numbers are a hash of the position and frame, so every instruction
+// set gives the same result no matter how the work is split up. The output
+// differs from the GPU's by the noise only.
+#define VSPL_DEBAND_CPU_MAX_ITERATIONS 16
+
+struct vspl_deband_cpu_params {
+    struct pl_deband_params deband;
+
+    // Only the white noise method has its own kernel, everything else is
+    // dithered with a fixed 16x16 ordered matrix
+    bool dither;
+    enum pl_dither_method dither_method;
+
+    enum vspl_cpu_isa isa;
+};
+
+// Debands one plane of an 8 or 16 bit integer, or 32 bit float, format.
+// `seed` plays the role of the shader index, returns false if out of memory.
+bool vspl_deband_cpu_plane(const struct vspl_deband_cpu_params *params, const VSVideoFormat *fmt,
+                           const uint8_t *src, ptrdiff_t src_stride, uint8_t *dst, ptrdiff_t dst_stride,
+                           int w, int h, uint32_t seed);
+
+#endif //VS_PLACEBO_DEBAND_CPU_H
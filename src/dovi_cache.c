@@ -0,0 +1,328 @@
+#include "dovi_cache.h"
+
+#ifdef HAVE_DOVI
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdovi/rpu_parser.h>
+
+#include "counters.h"
+#include "dovi_meta.h"
+
+// Refcounted, so entries can be evicted while frames still render with them
+struct vspl_dovi_meta {
+    struct pl_dovi_metadata meta;
+    int refcount;
+};
+
+struct vspl_dovi_entry {
+    uint64_t hash;
+    size_t size;
+    uint8_t *data;
+    uint64_t last_used;
+
+    struct vspl_dovi_rpu rpu;
+    // The parts the RPU carries (DOVI_META_*), the others are zeroed
+    int parts;
+    struct vspl_dovi_meta *meta;
+};
+
+// The RPU of a frame, for the frames after it that keep parts of it
+struct vspl_dovi_frame {
+    bool known;
+    int parts;
+    struct vspl_dovi_meta *meta;
+};
+
+struct vspl_dovi_cache {
+    pthread_mutex_t lock;
+    uint64_t clock;
+
+    int num_entries;
+    struct vspl_dovi_entry entries[VSPL_DOVI_CACHE_SIZE];
+
+    // What the stream starts from, before any RPU set the coefficients
+    struct vspl_dovi_meta *initial;
+
+    int num_frames;
+    struct vspl_dovi_frame *frames;
+};
+
+static uint64_t vspl_dovi_hash(const uint8_t *data, size_t size)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static struct vspl_dovi_meta *vspl_dovi_meta_ref(struct vspl_dovi_meta *meta)
+{
+    meta->refcount++;
+    return meta;
+}
+
+static void vspl_dovi_meta_unref(struct vspl_dovi_meta *meta)
+{
+    if (meta && --meta->refcount == 0)
+        free(meta);
+}
+
+struct vspl_dovi_cache *vspl_dovi_cache_create(int num_frames)
+{
+    struct vspl_dovi_cache *cache = calloc(1, sizeof(*cache));
+    pthread_mutex_init(&cache->lock, NULL);
+
+    cache->initial = calloc(1, sizeof(*cache->initial));
+    cache->initial->refcount = 1;
+
+    cache->num_frames = num_frames > 0 ? num_frames : 0;
+    cache->frames = calloc(cache->num_frames ? cache->num_frames : 1, sizeof(*cache->frames));
+
+    return cache;
+}
+
+void vspl_dovi_cache_destroy(struct vspl_dovi_cache **cache)
+{
+    struct vspl_dovi_cache *c = *cache;
+    if (!c)
+        return;
+
+    for (int i = 0; i < c->num_entries; i++) {
+        free(c->entries[i].data);
+        vspl_dovi_meta_unref(c->entries[i].meta);
+    }
+
+    for (int i = 0; i < c->num_frames; i++)
+        vspl_dovi_meta_unref(c->frames[i].meta);
+
+    vspl_dovi_meta_unref(c->initial);
+    pthread_mutex_destroy(&c->lock);
+    free(c->frames);
+    free(c);
+    *cache = NULL;
+}
+
+static struct vspl_dovi_entry *vspl_dovi_find(struct vspl_dovi_cache *cache, uint64_t hash,
+                                              const uint8_t *data, size_t size)
+{
+    for (int i = 0; i < cache->num_entries; i++) {
+        struct vspl_dovi_entry *e = &cache->entries[i];
+        if (e->hash == hash && e->size == size && !memcmp(e->data, data, size))
+            return e;
+    }
+
+    return NULL;
+}
+
+static struct vspl_dovi_entry *vspl_dovi_insert(struct vspl_dovi_cache *cache)
+{
+    if (cache->num_entries < VSPL_DOVI_CACHE_SIZE)
+        return &cache->entries[cache->num_entries++];
+
+    // Evict the least recently used entry
+    struct vspl_dovi_entry *lru = &cache->entries[0];
+    for (int i = 1; i < cache->num_entries; i++) {
+        if (cache->entries[i].last_used < lru->last_used)
+            lru = &cache->entries[i];
+    }
+
+    free(lru->data);
+    vspl_dovi_meta_unref(lru->meta);
+    memset(lru, 0, sizeof(*lru));
+    return lru;
+}
+
+// Everything that needs the parser. Only depends on the RPU itself, whatever
+// it keeps from earlier frames is filled in per frame.
+static bool vspl_dovi_parse(const uint8_t *data, size_t size, struct vspl_dovi_entry *out)
+{
+    DoviRpuOpaque *rpu = dovi_parse_unspec62_nalu(data, size);
+    const DoviRpuDataHeader *header = dovi_rpu_get_header(rpu);
+
+    if (!header) {
+        fprintf(stderr, "Failed parsing RPU: %s\n", dovi_rpu_get_error(rpu));
+        dovi_rpu_free(rpu);
+        return false;
+    }
+
+    out->rpu.profile = header->guessed_profile;
+
+    out->meta = calloc(1, sizeof(*out->meta));
+    out->meta->refcount = 1;
+    out->parts = update_dovi_meta(&out->meta->meta, rpu, header);
+
+    if (header->vdr_dm_metadata_present_flag) {
+        const DoviVdrDmData *vdr_dm_data = dovi_rpu_get_vdr_dm_data(rpu);
+
+        if (vdr_dm_data) {
+            out->rpu.has_dm = true;
+            out->rpu.source_min_pq = vdr_dm_data->source_min_pq / 4095.0f;
+            out->rpu.source_max_pq = vdr_dm_data->source_max_pq / 4095.0f;
+
+            if (vdr_dm_data->dm_data.level1) {
+                const DoviExtMetadataBlockLevel1 *l1 = vdr_dm_data->dm_data.level1;
+                out->rpu.has_l1 = true;
+                out->rpu.avg_pq = l1->avg_pq / 4095.0f;
+                out->rpu.max_pq = l1->max_pq / 4095.0f;
+            }
+
+            if (vdr_dm_data->dm_data.level6) {
+                const DoviExtMetadataBlockLevel6 *l6 = vdr_dm_data->dm_data.level6;
+                out->rpu.has_l6 = true;
+                out->rpu.max_cll = l6->max_content_light_level;
+                out->rpu.max_fall = l6->max_frame_average_light_level;
+            }
+
+            dovi_rpu_free_vdr_dm_data(vdr_dm_data);
+        }
+    }
+
+    dovi_rpu_free_header(header);
+    dovi_rpu_free(rpu);
+    return true;
+}
+
+// Finds the RPU in the cache, or parses and adds it, and records it as frame
+// `n`'s. Called with the lock held, which is dropped while parsing.
+static struct vspl_dovi_entry *vspl_dovi_lookup(struct vspl_dovi_cache *cache, int n, const uint8_t *data, size_t size)
+{
+    const uint64_t hash = vspl_dovi_hash(data, size);
+
+    struct vspl_dovi_entry *e = vspl_dovi_find(cache, hash, data, size);
+    if (!e) {
+        pthread_mutex_unlock(&cache->lock);
+
+        // Parse without holding the lock, other frames may hit meanwhile
+        struct vspl_dovi_entry parsed = {0};
+        bool ok = vspl_dovi_parse(data, size, &parsed);
+
+        vspl_lock(&cache->lock);
+        if (!ok)
+            return NULL;
+
+        // Another frame with the same RPU may have won the race
+        e = vspl_dovi_find(cache, hash, data, size);
+        if (e) {
+            vspl_dovi_meta_unref(parsed.meta);
+        } else {
+            // Share the metadata with any RPU that has the same coefficients,
+            // which is the case for most frames of a scene, where only the DM
+            // data changes
+            for (int i = 0; i < cache->num_entries; i++) {
+                const struct vspl_dovi_entry *other = &cache->entries[i];
+                if (other->parts == parsed.parts &&
+                    !memcmp(&other->meta->meta, &parsed.meta->meta, sizeof(other->meta->meta))) {
+                    vspl_dovi_meta_unref(parsed.meta);
+                    parsed.meta = vspl_dovi_meta_ref(other->meta);
+                    break;
+                }
+            }
+
+            e = vspl_dovi_insert(cache);
+            *e = parsed;
+            e->hash = hash;
+            e->size = size;
+            e->data = malloc(size);
+            memcpy(e->data, data, size);
+        }
+    }
+
+    e->last_used = ++cache->clock;
+
+    if (n >= 0 && n < cache->num_frames) {
+        struct vspl_dovi_frame *f = &cache->frames[n];
+        vspl_dovi_meta_unref(f->meta);
+        *f = (struct vspl_dovi_frame) {
+            .known = true,
+            .parts = e->parts,
+            .meta = vspl_dovi_meta_ref(e->meta),
+        };
+    }
+
+    return e;
+}
+
+static void vspl_dovi_copy_parts(struct pl_dovi_metadata *dst, const struct pl_dovi_metadata *src, int parts)
+{
+    if (parts & DOVI_META_MAPPING)
+        memcpy(dst->comp, src->comp, sizeof(dst->comp));
+
+    if (parts & DOVI_META_DM) {
+        memcpy(dst->nonlinear_offset, src->nonlinear_offset, sizeof(dst->nonlinear_offset));
+        dst->nonlinear = src->nonlinear;
+        dst->linear = src->linear;
+    }
+}
+
+// Frame `n`'s metadata, with a reference for the caller. Parts its RPU
+// doesn't carry come from the frames before it, as far back as their RPUs
+// have been seen.
+static struct vspl_dovi_meta *vspl_dovi_resolve(struct vspl_dovi_cache *cache, int n)
+{
+    const struct vspl_dovi_frame *cur = &cache->frames[n];
+    if (cur->parts == DOVI_META_ALL)
+        return vspl_dovi_meta_ref(cur->meta);
+
+    struct vspl_dovi_meta *m = calloc(1, sizeof(*m));
+    m->meta = cache->initial->meta;
+    m->refcount = 1;
+
+    int missing = DOVI_META_ALL;
+    for (int i = n; i >= 0 && missing && cache->frames[i].known; i--) {
+        const struct vspl_dovi_frame *f = &cache->frames[i];
+        vspl_dovi_copy_parts(&m->meta, &f->meta->meta, f->parts & missing);
+        missing &= ~f->parts;
+    }
+
+    return m;
+}
+
+const struct pl_dovi_metadata *vspl_dovi_cache_get(struct vspl_dovi_cache *cache, int n,
+                                                   const uint8_t *data, size_t size,
+                                                   const uint8_t *prev_data, size_t prev_size,
+                                                   struct vspl_dovi_rpu *rpu)
+{
+    vspl_lock(&cache->lock);
+
+    const struct vspl_dovi_entry *e = vspl_dovi_lookup(cache, n, data, size);
+    if (!e) {
+        pthread_mutex_unlock(&cache->lock);
+        return NULL;
+    }
+
+    *rpu = e->rpu;
+
+    const struct pl_dovi_metadata *ret;
+    if (n < 0 || n >= cache->num_frames) {
+        // Nothing to resolve it against
+        ret = &vspl_dovi_meta_ref(e->meta)->meta;
+    } else {
+        if (e->parts != DOVI_META_ALL && prev_data && n > 0)
+            vspl_dovi_lookup(cache, n - 1, prev_data, prev_size);
+        ret = &vspl_dovi_resolve(cache, n)->meta;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+    return ret;
+}
+
+void vspl_dovi_cache_release(struct vspl_dovi_cache *cache, const struct pl_dovi_metadata *meta)
+{
+    if (!meta)
+        return;
+
+    vspl_lock(&cache->lock);
+    // The metadata is the first member
+    vspl_dovi_meta_unref((struct vspl_dovi_meta *) meta);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+#endif // HAVE_DOVI
@@ -0,0 +1,61 @@
+#ifndef VS_PLACEBO_DOVI_CACHE_H
+#define VS_PLACEBO_DOVI_CACHE_H
+
+#include "config_vsplacebo.h"
+
+#ifdef HAVE_DOVI
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libplacebo/colorspace.h>
+
+// Parsed Dolby Vision RPUs of one filter instance. RPUs are looked up by their
+// bytes, which rarely change within a scene, so most frames skip parsing
+// entirely. Reshaping metadata is shared between all RPUs that produce the
+// same coefficients, and never modified once created. The RPU of each frame
+// is remembered, so RPUs that keep coefficients of the frame before them
+// (use_prev_vdr_rpu_flag, or no mapping or DM data) resolve them by frame
+// number rather than from whichever frame was parsed last.
+#define VSPL_DOVI_CACHE_SIZE 64
+
+// What the filters need from the RPU besides the reshaping metadata
+struct vspl_dovi_rpu {
+    uint8_t profile;
+
+    bool has_dm;
+    float source_min_pq;
+    float source_max_pq;
+
+    // L1, in PQ (0-1)
+    bool has_l1;
+    float avg_pq;
+    float max_pq;
+
+    // L6, in nits
+    bool has_l6;
+    uint16_t max_cll;
+    uint16_t max_fall;
+};
+
+struct vspl_dovi_cache;
+
+struct vspl_dovi_cache *vspl_dovi_cache_create(int num_frames);
+void vspl_dovi_cache_destroy(struct vspl_dovi_cache **cache);
+
+// Returns the reshaping metadata of frame `n`'s RPU and fills `rpu`, or
+// returns NULL if it can't be parsed. `prev_data` is the RPU of frame n - 1,
+// if any; coefficients that earlier frames carry are taken from the RPUs seen
+// so far, and are only left at their initial values before the first frame
+// or past a frame whose RPU was never seen. The result stays valid until
+// released with vspl_dovi_cache_release.
+const struct pl_dovi_metadata *vspl_dovi_cache_get(struct vspl_dovi_cache *cache, int n,
+                                                   const uint8_t *data, size_t size,
+                                                   const uint8_t *prev_data, size_t prev_size,
+                                                   struct vspl_dovi_rpu *rpu);
+void vspl_dovi_cache_release(struct vspl_dovi_cache *cache, const struct pl_dovi_metadata *meta);
+
+#endif // HAVE_DOVI
+
+#endif //VS_PLACEBO_DOVI_CACHE_H
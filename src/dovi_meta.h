@@ -5,17 +5,28 @@
 #ifdef HAVE_DOVI
 #include <libdovi/rpu_parser.h>
 
-static struct pl_dovi_metadata *create_dovi_meta(DoviRpuOpaque *rpu,
-                                                const DoviRpuDataHeader *hdr)
+// Parts of the metadata an RPU can carry
+#define DOVI_META_MAPPING (1 << 0) // comp
+#define DOVI_META_DM      (1 << 1) // nonlinear_offset, nonlinear, linear
+#define DOVI_META_ALL     (DOVI_META_MAPPING | DOVI_META_DM)
+
+// Updates `dovi_meta` with the reshaping and DM coefficients of the RPU, and
+// returns which parts it carried. The others are left as they are, and are
+// the previous frame's in the stream.
+static int update_dovi_meta(struct pl_dovi_metadata *dovi_meta, DoviRpuOpaque *rpu,
+                            const DoviRpuDataHeader *hdr)
 {
-    static struct pl_dovi_metadata dovi_meta; // persist state
+    int parts = 0;
+
     if (hdr->use_prev_vdr_rpu_flag)
-        goto done;
+        return parts;
 
     const DoviRpuDataMapping *mapping = dovi_rpu_get_data_mapping(rpu);
     if (!mapping)
         goto skip_mapping;
 
+    parts |= DOVI_META_MAPPING;
+
     const uint8_t bits = hdr->bl_bit_depth_minus8 + 8;
     const float scale = 1.0f / (1 << hdr->coefficient_log2_denom);
 
@@ -23,7 +34,7 @@ static struct pl_dovi_metadata *create_dovi_meta(DoviRpuOpaque *rpu,
     for (int c = 0; c < 3; c++) {
         const DoviReshapingCurve curve = mapping->curves[c];
 
-        struct pl_reshape_data *cmp = &dovi_meta.comp[c];
+        struct pl_reshape_data *cmp = &dovi_meta->comp[c];
         cmp->num_pivots = curve.pivots.len;
         memset(cmp->method, curve.mapping_idc, sizeof(cmp->method));
 
@@ -64,7 +75,7 @@ static struct pl_dovi_metadata *create_dovi_meta(DoviRpuOpaque *rpu,
     }
 #else
     for (int c = 0; c < 3; c++) {
-        struct pl_reshape_data *cmp = &dovi_meta.comp[c];
+        struct pl_reshape_data *cmp = &dovi_meta->comp[c];
         uint16_t pivot = 0;
         cmp->num_pivots = hdr->num_pivots_minus_2[c] + 2;
         for (int pivot_idx = 0; pivot_idx < cmp->num_pivots; pivot_idx++) {
@@ -108,29 +119,28 @@ skip_mapping:
     if (hdr->vdr_dm_metadata_present_flag) {
         const DoviVdrDmData *dm_data = dovi_rpu_get_vdr_dm_data(rpu);
         if (!dm_data)
-            goto done;
+            return parts;
+
+        parts |= DOVI_META_DM;
 
         const uint32_t *off = &dm_data->ycc_to_rgb_offset0;
         for (int i = 0; i < 3; i++)
-            dovi_meta.nonlinear_offset[i] = (float) off[i] / (1 << 28);
+            dovi_meta->nonlinear_offset[i] = (float) off[i] / (1 << 28);
 
         const int16_t *src = &dm_data->ycc_to_rgb_coef0;
-        float *dst = &dovi_meta.nonlinear.m[0][0];
+        float *dst = &dovi_meta->nonlinear.m[0][0];
         for (int i = 0; i < 9; i++)
             dst[i] = src[i] / 8192.0;
 
         src = &dm_data->rgb_to_lms_coef0;
-        dst = &dovi_meta.linear.m[0][0];
+        dst = &dovi_meta->linear.m[0][0];
         for (int i = 0; i < 9; i++)
             dst[i] = src[i] / 16384.0;
 
         dovi_rpu_free_vdr_dm_data(dm_data);
     }
 
-done: ;
-    struct pl_dovi_metadata *ret = malloc(sizeof(dovi_meta));
-    memcpy(ret, &dovi_meta, sizeof(dovi_meta));
-    return ret;
+    return parts;
 }
 
 #endif // HAVE_DOVI
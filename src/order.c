@@ -0,0 +1,154 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "counters.h"
+#include "order.h"
+#include "trace.h"
+
+// Frame states
+enum {
+    VSPL_ORDER_NONE,
+    VSPL_ORDER_REQUESTED,
+    // Holds a slot and is about to render
+    VSPL_ORDER_SLOTTED,
+};
+
+struct vspl_order {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // Frames before it already rendered, any still coming are late and
+    // nothing waits for them
+    int next;
+
+    int waiters;
+    int max_waiters;
+
+    int num_frames;
+    uint8_t *state;
+};
+
+struct vspl_order *vspl_order_create(int num_frames, VSCore *core, const VSAPI *vsapi)
+{
+    VSCoreInfo info;
+    vsapi->getCoreInfo(core, &info);
+
+    struct vspl_order *order = calloc(1, sizeof(*order));
+    pthread_mutex_init(&order->lock, NULL);
+    pthread_cond_init(&order->cond, NULL);
+    order->max_waiters = info.numThreads - 1;
+    order->num_frames = num_frames;
+    order->state = calloc(num_frames > 0 ? num_frames : 1, 1);
+    return order;
+}
+
+void vspl_order_destroy(struct vspl_order **order)
+{
+    struct vspl_order *o = *order;
+    if (!o)
+        return;
+
+    pthread_cond_destroy(&o->cond);
+    pthread_mutex_destroy(&o->lock);
+    free(o->state);
+    free(o);
+    *order = NULL;
+}
+
+void vspl_order_request(struct vspl_order *order, int n)
+{
+    if (n < 0 || n >= order->num_frames)
+        return;
+
+    vspl_lock(&order->lock);
+    order->state[n] = VSPL_ORDER_REQUESTED;
+    pthread_mutex_unlock(&order->lock);
+}
+
+// Whether a frame before `n` is still in `state`
+static bool vspl_order_blocked(const struct vspl_order *order, int n, int state)
+{
+    for (int i = order->next; i < n; i++) {
+        if (order->state[i] == state)
+            return true;
+    }
+
+    return false;
+}
+
+static void vspl_order_set(struct vspl_order *order, int n, int state)
+{
+    if (n >= 0 && n < order->num_frames)
+        order->state[n] = state;
+    pthread_cond_broadcast(&order->cond);
+}
+
+struct vspl_slot *vspl_order_slot_acquire(struct vspl_order *order, struct priv *p, int n)
+{
+    vspl_lock(&order->lock);
+
+    if (vspl_order_blocked(order, n, VSPL_ORDER_REQUESTED)) {
+        // The frames waited for still have to be fetched, which needs a
+        // thread that isn't waiting here
+        if (order->waiters >= order->max_waiters) {
+            vspl_order_set(order, n, VSPL_ORDER_NONE);
+            pthread_mutex_unlock(&order->lock);
+            return NULL;
+        }
+
+        const int64_t trace = vspl_trace_begin();
+        order->waiters++;
+        while (vspl_order_blocked(order, n, VSPL_ORDER_REQUESTED))
+            pthread_cond_wait(&order->cond, &order->lock);
+        order->waiters--;
+        vspl_trace_end(VSPL_TRACE_ORDER, trace);
+    }
+
+    // Frames after this one keep waiting until it has its slot. The slots
+    // are only held by earlier frames, which render without waiting for
+    // anything that doesn't hold one.
+    pthread_mutex_unlock(&order->lock);
+    struct vspl_slot *s = vspl_slot_acquire(p);
+
+    vspl_lock(&order->lock);
+    vspl_order_set(order, n, VSPL_ORDER_SLOTTED);
+    pthread_mutex_unlock(&order->lock);
+    return s;
+}
+
+void vspl_order_begin(struct vspl_order *order, int n)
+{
+    vspl_lock(&order->lock);
+
+    if (!vspl_order_blocked(order, n, VSPL_ORDER_SLOTTED))
+        return;
+
+    // Frames requested after this one got its slot render after it
+    const int64_t trace = vspl_trace_begin();
+    while (vspl_order_blocked(order, n, VSPL_ORDER_SLOTTED))
+        pthread_cond_wait(&order->cond, &order->lock);
+    vspl_trace_end(VSPL_TRACE_ORDER, trace);
+}
+
+void vspl_order_end(struct vspl_order *order, int n)
+{
+    // Late frames (re-requested, or requested after later frames took their
+    // slots) don't move it back
+    if (n + 1 > order->next)
+        order->next = n + 1;
+
+    vspl_order_set(order, n, VSPL_ORDER_NONE);
+    pthread_mutex_unlock(&order->lock);
+}
+
+void vspl_order_cancel(struct vspl_order *order, int n)
+{
+    if (n < 0 || n >= order->num_frames)
+        return;
+
+    vspl_lock(&order->lock);
+    vspl_order_set(order, n, VSPL_ORDER_NONE);
+    pthread_mutex_unlock(&order->lock);
+}
@@ -0,0 +1,41 @@
+#ifndef VS_PLACEBO_ORDER_H
+#define VS_PLACEBO_ORDER_H
+
+#include <stdbool.h>
+
+#include <VapourSynth4.h>
+
+#include "vs-placebo.h"
+
+// Feeds frames to a stateful stage (the renderer, when peak detection is on)
+// in frame order, while everything around it runs in parallel. Frames take
+// their slots in frame order, then render in frame order; a frame only waits
+// for earlier frames that were actually requested, so seeking doesn't stall.
+// Since the slots are handed out in order, a frame waiting for its turn to
+// render only ever waits for frames that already hold a slot, and the wait
+// for a slot is bounded by fewer frames than there are threads, so the frames
+// waited for can still be fetched.
+
+struct vspl_order;
+
+struct vspl_order *vspl_order_create(int num_frames, VSCore *core, const VSAPI *vsapi);
+void vspl_order_destroy(struct vspl_order **order);
+
+// Called when frame `n` is requested (arInitial)
+void vspl_order_request(struct vspl_order *order, int n);
+
+// vspl_slot_acquire, once every requested frame before `n` holds a slot.
+// Returns NULL if as many frames as there are threads would be waiting, in
+// which case the frame must fail, it has already been cancelled.
+struct vspl_slot *vspl_order_slot_acquire(struct vspl_order *order, struct priv *p, int n);
+
+// Waits for the turn of frame `n`, and holds the order until
+// vspl_order_end, so only one frame is in between at a time
+void vspl_order_begin(struct vspl_order *order, int n);
+void vspl_order_end(struct vspl_order *order, int n);
+
+// For requested frames that won't go through vspl_order_begin/end, because
+// they failed or their request errored out, so later frames stop waiting
+void vspl_order_cancel(struct vspl_order *order, int n);
+
+#endif //VS_PLACEBO_ORDER_H
@@ -0,0 +1,92 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "profile.h"
+
+void vspl_profile_init(pl_gpu gpu, struct vspl_profile *prof)
+{
+    *prof = (struct vspl_profile) {
+        .upload = pl_timer_create(gpu),
+        .render = pl_timer_create(gpu),
+        .download = pl_timer_create(gpu),
+    };
+}
+
+void vspl_profile_uninit(pl_gpu gpu, struct vspl_profile *prof)
+{
+    pl_timer_destroy(gpu, &prof->upload);
+    pl_timer_destroy(gpu, &prof->render);
+    pl_timer_destroy(gpu, &prof->download);
+}
+
+int64_t vspl_profile_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void vspl_profile_begin(struct vspl_profile *prof, int64_t wait_start)
+{
+    prof->wait_ns = vspl_profile_now() - wait_start;
+    prof->num_passes = 0;
+}
+
+static void vspl_profile_add_pass(struct vspl_profile *prof, const struct pl_dispatch_info *info)
+{
+    if (prof->num_passes == VSPL_PROFILE_MAX_PASSES)
+        return;
+
+    struct vspl_profile_pass *pass = &prof->passes[prof->num_passes++];
+    const char *desc = info->shader && info->shader->description ? info->shader->description : "unknown";
+    snprintf(pass->desc, sizeof(pass->desc), "%s", desc);
+    pass->ns = info->last;
+}
+
+void vspl_profile_dispatch_cb(void *priv, const struct pl_dispatch_info *info)
+{
+    vspl_profile_add_pass(priv, info);
+}
+
+void vspl_profile_render_cb(void *priv, const struct pl_render_info *info)
+{
+    vspl_profile_add_pass(priv, info->pass);
+}
+
+// A timer used several times per frame has a result for each use
+static uint64_t vspl_timer_sum(pl_gpu gpu, pl_timer timer)
+{
+    uint64_t sum = 0, ns;
+    while (timer && (ns = pl_timer_query(gpu, timer)))
+        sum += ns;
+    return sum;
+}
+
+void vspl_profile_write(pl_gpu gpu, struct vspl_profile *prof, VSMap *props, const VSAPI *vsapi)
+{
+    uint64_t render = vspl_timer_sum(gpu, prof->render);
+    if (!render) {
+        for (int i = 0; i < prof->num_passes; i++)
+            render += prof->passes[i].ns;
+    }
+
+    vsapi->mapSetInt(props, "PlaceboWaitNs", prof->wait_ns, maReplace);
+    vsapi->mapSetInt(props, "PlaceboUploadNs", (int64_t) vspl_timer_sum(gpu, prof->upload), maReplace);
+    vsapi->mapSetInt(props, "PlaceboRenderNs", (int64_t) render, maReplace);
+    vsapi->mapSetInt(props, "PlaceboDownloadNs", (int64_t) vspl_timer_sum(gpu, prof->download), maReplace);
+
+    vsapi->mapDeleteKey(props, "PlaceboPassNs");
+    vsapi->mapDeleteKey(props, "PlaceboPassDesc");
+    for (int i = 0; i < prof->num_passes; i++) {
+        vsapi->mapSetInt(props, "PlaceboPassNs", (int64_t) prof->passes[i].ns, maAppend);
+        vsapi->mapSetData(props, "PlaceboPassDesc", prof->passes[i].desc, -1, dtUtf8, maAppend);
+    }
+}
+
+void vspl_profile_write_cpu(int64_t start, VSMap *props, const VSAPI *vsapi)
+{
+    vsapi->mapSetInt(props, "PlaceboCpuNs", vspl_profile_now() - start, maReplace);
+}
@@ -0,0 +1,59 @@
+#ifndef VS_PLACEBO_PROFILE_H
+#define VS_PLACEBO_PROFILE_H
+
+#include <stdint.h>
+
+#include <VapourSynth4.h>
+
+#include <libplacebo/dispatch.h>
+#include <libplacebo/gpu.h>
+#include <libplacebo/renderer.h>
+
+// GPU time spent on the frame a slot is working on, for filters created with
+// `profile=True`. The timers belong to the slot, so they only ever measure
+// that slot's frames, and everything they measured is done by the time the
+// frame's downloads are. libplacebo only learns how long a shader pass took
+// the next time it runs, so the per-pass times are those of the slot's
+// previous frame.
+#define VSPL_PROFILE_MAX_PASSES 32
+
+struct vspl_profile_pass {
+    char desc[64];
+    uint64_t ns;
+};
+
+struct vspl_profile {
+    pl_timer upload;
+    pl_timer render;
+    pl_timer download;
+
+    // CPU time spent waiting for the slot to become free
+    int64_t wait_ns;
+
+    int num_passes;
+    struct vspl_profile_pass passes[VSPL_PROFILE_MAX_PASSES];
+};
+
+// Missing timers (e.g. no timestamp queries) just measure nothing
+void vspl_profile_init(pl_gpu gpu, struct vspl_profile *prof);
+void vspl_profile_uninit(pl_gpu gpu, struct vspl_profile *prof);
+
+int64_t vspl_profile_now(void);
+
+// Starts a new frame, after waiting for the slot since `wait_start`
+void vspl_profile_begin(struct vspl_profile *prof, int64_t wait_start);
+
+// pl_dispatch_callback and pl_render_params.info_callback, with the profile
+// as their priv
+void vspl_profile_dispatch_cb(void *priv, const struct pl_dispatch_info *info);
+void vspl_profile_render_cb(void *priv, const struct pl_render_info *info);
+
+// Sets PlaceboWaitNs, PlaceboUploadNs, PlaceboRenderNs, PlaceboDownloadNs,
+// PlaceboPassNs and PlaceboPassDesc. The render time is the sum of the passes
+// when nothing was dispatched with the render timer, i.e. for pl_render_image.
+void vspl_profile_write(pl_gpu gpu, struct vspl_profile *prof, VSMap *props, const VSAPI *vsapi);
+
+// Sets PlaceboCpuNs, the time a CPU backend took for the frame since `start`
+void vspl_profile_write_cpu(int64_t start, VSMap *props, const VSAPI *vsapi);
+
+#endif //VS_PLACEBO_PROFILE_H
@@ -0,0 +1,690 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <VapourSynth4.h>
+
+#include <libplacebo/renderer.h>
+#include <libplacebo/colorspace.h>
+
+#include "vs-placebo.h"
+#include "resident.h"
+#include "render.h"
+#include "deband.h"
+#include "tonemap.h"
+#include "resample.h"
+#include "shader.h"
+#include "order.h"
+
+typedef struct {
+    VSNode *node;
+    const VSVideoInfo *vi;
+    VSVideoInfo vi_out;
+    struct priv *vf;
+
+    // Every stage of the pipeline, applied by a single pl_render_image call
+    struct pl_render_params *renderParams;
+    struct pl_sample_filter_params *sampleParams;
+    struct pl_deband_params *debandParams;
+    struct pl_dither_params *ditherParams;
+    struct pl_color_map_params *colorMapParams;
+    struct pl_peak_detect_params *peakDetectParams;
+
+    enum supported_colorspace src_csp;
+    struct pl_color_space src_pl_csp;
+    struct pl_color_space dst_pl_csp;
+
+    float original_src_max;
+    float original_src_min;
+
+    // VapourSynth _ChromaLocation value, or -1 to keep the source's
+    int dst_chroma_loc;
+
+    // Custom shader, parsed by each slot
+    char *shader;
+    size_t shader_len;
+
+    // With peak detection, a single renderer sees every frame, in order
+    pl_renderer rr;
+    struct vspl_order *order;
+
+    // Only with an HDR source
+    int metadata_steps;
+    struct vspl_hdr_tracker *hdr_tracker;
+
+    // Tells the instance apart in traces
+    int trace_id;
+} RenderData;
+
+// VapourSynth _Matrix values to libplacebo
+static enum pl_color_system vspl_render_matrix(int64_t matrix)
+{
+    switch (matrix) {
+        case 0: return PL_COLOR_SYSTEM_RGB;
+        case 1: return PL_COLOR_SYSTEM_BT_709;
+        case 5:
+        case 6: return PL_COLOR_SYSTEM_BT_601;
+        case 7: return PL_COLOR_SYSTEM_SMPTE_240M;
+        case 9: return PL_COLOR_SYSTEM_BT_2020_NC;
+        case 10: return PL_COLOR_SYSTEM_BT_2020_C;
+        default: return PL_COLOR_SYSTEM_UNKNOWN;
+    }
+}
+
+// And back, for the systems picked for the output
+static int vspl_render_vs_matrix(enum pl_color_system sys)
+{
+    switch (sys) {
+        case PL_COLOR_SYSTEM_RGB: return 0;
+        case PL_COLOR_SYSTEM_BT_709: return 1;
+        case PL_COLOR_SYSTEM_BT_601: return 6;
+        case PL_COLOR_SYSTEM_SMPTE_240M: return 7;
+        case PL_COLOR_SYSTEM_BT_2020_C: return 10;
+        default: return 9;
+    }
+}
+
+// libplacebo colorimetry to VapourSynth _Transfer/_Primaries values, -1 if
+// there is no equivalent
+static int vspl_render_vs_transfer(enum pl_color_transfer trc)
+{
+    switch (trc) {
+        case PL_COLOR_TRC_BT_1886: return 1;
+        case PL_COLOR_TRC_LINEAR: return 8;
+        case PL_COLOR_TRC_SRGB: return 13;
+        case PL_COLOR_TRC_PQ: return 16;
+        case PL_COLOR_TRC_HLG: return 18;
+        default: return -1;
+    }
+}
+
+static int vspl_render_vs_primaries(enum pl_color_primaries prim)
+{
+    switch (prim) {
+        case PL_COLOR_PRIM_BT_709: return 1;
+        case PL_COLOR_PRIM_BT_601_625: return 5;
+        case PL_COLOR_PRIM_BT_601_525: return 6;
+        case PL_COLOR_PRIM_BT_2020: return 9;
+        case PL_COLOR_PRIM_DCI_P3: return 11;
+        case PL_COLOR_PRIM_DISPLAY_P3: return 12;
+        default: return -1;
+    }
+}
+
+bool vspl_render_reconfig(void *priv, struct vspl_slot *s, struct pl_plane_data *data, const VSVideoInfo *vi_out,
+                          const struct vspl_resident_ref *res, VSCore *core, const VSAPI *vsapi)
+{
+    struct priv *p = priv;
+
+    pl_fmt fmt = pl_plane_find_fmt(p->gpu, NULL, &data[0]);
+    if (!fmt) {
+        vsapi->logMessage(mtCritical, "Failed configuring filter: no good texture format!\n", core);
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < 3; ++i) {
+        if (vspl_resident_tex(res, i))
+            continue;
+
+        ok &= vspl_tex_pool_recreate(p->pool, &s->tex_in[i], pl_tex_params(
+            .w = data[i].width,
+            .h = data[i].height,
+            .format = fmt,
+            .sampleable = true,
+            .host_writable = true,
+            .blit_src = fmt->caps & PL_FMT_CAP_BLITTABLE,
+        ));
+    }
+
+    const VSVideoFormat *dst_fmt = &vi_out->format;
+    pl_fmt out = vspl_find_plane_fmt(p->gpu, dst_fmt, PL_FMT_CAP_RENDERABLE | PL_FMT_CAP_HOST_READABLE);
+    if (!out) {
+        vsapi->logMessage(mtCritical, "Failed configuring filter: no good output texture format!\n", core);
+        return false;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        ok &= vspl_tex_pool_recreate(p->pool, &s->tex_out[i], pl_tex_params(
+            .w = i ? vi_out->width >> dst_fmt->subSamplingW : vi_out->width,
+            .h = i ? vi_out->height >> dst_fmt->subSamplingH : vi_out->height,
+            .format = out,
+            .renderable = true,
+            .host_readable = true,
+            .storable = out->caps & PL_FMT_CAP_STORABLE,
+            .blit_dst = out->caps & PL_FMT_CAP_BLITTABLE,
+            .sampleable = p->resident,
+        ));
+    }
+
+    if (!ok) {
+        vsapi->logMessage(mtCritical, "Failed creating GPU textures!\n", core);
+        return false;
+    }
+
+    return true;
+}
+
+bool vspl_render_filter(RenderData *d, struct vspl_slot *s, int n, VSFrame *dst, struct pl_plane_data *src,
+                        const struct pl_color_repr *src_repr, const struct pl_color_repr *dst_repr,
+                        const struct pl_color_space *src_csp, const struct pl_color_space *dst_csp,
+                        enum pl_chroma_location chroma_loc, enum pl_chroma_location dst_chroma_loc,
+                        const struct pl_hdr_metadata *raw_hdr, const struct vspl_resident_ref *res,
+                        VSCore *core, const VSAPI *vsapi)
+{
+    struct priv *p = d->vf;
+
+    // Upload planes, unless they are still on the GPU
+    struct pl_frame img = {
+        .num_planes = 3,
+        .repr = *src_repr,
+        .color = *src_csp,
+    };
+
+    bool ok = true;
+    for (int i = 0; i < 3; ++i) {
+        pl_tex tex = vspl_resident_tex(res, i);
+        if (tex) {
+            img.planes[i] = (struct pl_plane) {
+                .texture = tex,
+                .components = 1,
+                .component_mapping = {i},
+            };
+        } else {
+            ok &= vspl_upload_plane(p->gpu, &s->xfer, &img.planes[i], &s->tex_in[i], &src[i]);
+        }
+    }
+
+    if (!ok) {
+        vsapi->logMessage(mtCritical, "Failed uploading data to the GPU!\n", core);
+        if (d->order)
+            vspl_order_cancel(d->order, n);
+        return false;
+    }
+
+    if (d->vi->format.subSamplingW || d->vi->format.subSamplingH)
+        pl_frame_set_chroma_location(&img, chroma_loc);
+
+    struct pl_frame out = {
+        .num_planes = 3,
+        .repr = *dst_repr,
+        .color = *dst_csp,
+    };
+
+    for (int i = 0; i < 3; i++) {
+        out.planes[i] = (struct pl_plane) {
+            .texture = s->tex_out[i],
+            .components = 1,
+            .component_mapping = {i},
+        };
+    }
+
+    if (d->vi_out.format.subSamplingW || d->vi_out.format.subSamplingH)
+        pl_frame_set_chroma_location(&out, dst_chroma_loc);
+
+    // The hook belongs to the slot, the rest is shared
+    struct pl_render_params params = *d->renderParams;
+    if (s->hook) {
+        params.hooks = &s->hook;
+        params.num_hooks = 1;
+    }
+    vspl_slot_render_params(p, s, &params);
+
+    pl_renderer rr = s->rr;
+    int renderer = 1 + (int) (s - p->slots);
+    if (d->order) {
+        vspl_order_begin(d->order, n);
+        rr = d->rr;
+        renderer = 0;
+    }
+
+    if (d->hdr_tracker)
+        vspl_hdr_tracker_update(d->hdr_tracker, renderer, raw_hdr, &src_csp->hdr);
+
+    const int64_t trace = vspl_trace_begin();
+    bool rendered = pl_render_image(rr, &img, &out, &params);
+    vspl_trace_end(VSPL_TRACE_RENDER, trace);
+
+    if (d->order)
+        vspl_order_end(d->order, n);
+
+    if (!rendered) {
+        vsapi->logMessage(mtCritical, "Failed processing planes!\n", core);
+        return false;
+    }
+
+    // Download planes
+    for (int i = 0; i < 3; ++i) {
+        ok &= vspl_download_async(p->gpu, &s->xfer, pl_tex_transfer_params(
+            .tex = s->tex_out[i],
+            .row_pitch = vsapi->getStride(dst, i),
+            .ptr = vsapi->getWritePtr(dst, i),
+        ));
+    }
+    vspl_download_wait(p->gpu, &s->xfer);
+
+    if (!ok) {
+        vsapi->logMessage(mtCritical, "Failed downloading data from the GPU!\n", core);
+        return false;
+    }
+
+    return true;
+}
+
+static const VSFrame *VS_CC VSPlaceboRenderGetFrame(int n, int activationReason, void *instanceData, void **frameData,
+                                                    VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi)
+{
+    RenderData *d = (RenderData *) instanceData;
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+
+        if (d->order)
+            vspl_order_request(d->order, n);
+    } else if (activationReason == arAllFramesReady) {
+        vspl_counter_add(VSPL_COUNTER_RENDER_FRAMES, 1);
+        vspl_trace_frame("Render", d->trace_id, n);
+
+        const VSFrame *frame = vsapi->getFrameFilter(n, d->node, frameCtx);
+
+        int err;
+        const VSMap *props = vsapi->getFramePropertiesRO(frame);
+
+        const VSVideoFormat *src_fmt = vsapi->getVideoFrameFormat(frame);
+        const VSVideoFormat *dst_fmt = &d->vi_out.format;
+
+        VSFrame *dst = vsapi->newVideoFrame(dst_fmt, d->vi_out.width, d->vi_out.height, frame, core);
+        VSMap *dst_props = vsapi->getFramePropertiesRW(dst);
+
+        // Per-frame copies, the HDR metadata comes from the props
+        struct pl_color_space src_csp = d->src_pl_csp;
+        struct pl_color_space dst_csp = d->dst_pl_csp;
+
+        struct pl_color_repr src_repr = {
+            .bits = vspl_bit_encoding(src_fmt),
+            .sys = PL_COLOR_SYSTEM_RGB,
+            .levels = PL_COLOR_LEVELS_FULL,
+        };
+
+        if (src_fmt->colorFamily == cfYUV) {
+            src_repr.sys = vspl_render_matrix(vsapi->mapGetInt(props, "_Matrix", 0, &err));
+            if (err || src_repr.sys == PL_COLOR_SYSTEM_UNKNOWN || src_repr.sys == PL_COLOR_SYSTEM_RGB) {
+                src_repr.sys = src_csp.transfer == PL_COLOR_TRC_BT_1886
+                               ? PL_COLOR_SYSTEM_BT_709
+                               : PL_COLOR_SYSTEM_BT_2020_NC;
+            }
+
+            src_repr.levels = PL_COLOR_LEVELS_LIMITED;
+        }
+
+        int64_t props_levels = vsapi->mapGetInt(props, "_ColorRange", 0, &err);
+        if (!err)
+            src_repr.levels = props_levels ? PL_COLOR_LEVELS_LIMITED : PL_COLOR_LEVELS_FULL;
+
+        // The renderer dithers down to the output's color depth
+        struct pl_color_repr dst_repr = {
+            .bits = vspl_bit_encoding(dst_fmt),
+            .sys = PL_COLOR_SYSTEM_RGB,
+            .levels = PL_COLOR_LEVELS_FULL,
+            .alpha = PL_ALPHA_PREMULTIPLIED,
+        };
+
+        if (dst_fmt->colorFamily == cfYUV) {
+            // Keep the matrix if the colorimetry doesn't change
+            if (src_fmt->colorFamily == cfYUV && src_csp.transfer == dst_csp.transfer &&
+                src_csp.primaries == dst_csp.primaries) {
+                dst_repr.sys = src_repr.sys;
+            } else {
+                dst_repr.sys = dst_csp.transfer == PL_COLOR_TRC_BT_1886
+                               ? PL_COLOR_SYSTEM_BT_709
+                               : PL_COLOR_SYSTEM_BT_2020_NC;
+            }
+
+            dst_repr.levels = src_fmt->colorFamily == cfYUV ? src_repr.levels : PL_COLOR_LEVELS_LIMITED;
+        }
+
+        struct pl_hdr_metadata raw_hdr = src_csp.hdr;
+        if (d->src_csp != CSP_SDR) {
+            vspl_hdr_metadata_read(props, &src_csp, d->original_src_max < 1, d->original_src_min <= 0, vsapi);
+            raw_hdr = src_csp.hdr;
+            vspl_hdr_metadata_quantize(&src_csp.hdr, d->metadata_steps);
+        }
+
+        pl_color_space_infer_map(&src_csp, &dst_csp);
+
+        enum pl_chroma_location chroma_loc = vsapi->mapGetInt(props, "_ChromaLocation", 0, &err);
+
+        // FFMS2 prop is -1 to match zimg
+        // However, libplacebo matches AVChromaLocation
+        if (!err) {
+            chroma_loc += 1;
+        } else {
+            // Same default as VapourSynth's resizers
+            chroma_loc = PL_CHROMA_LEFT;
+        }
+
+        enum pl_chroma_location dst_chroma_loc = d->dst_chroma_loc >= 0 ? d->dst_chroma_loc + 1 : chroma_loc;
+
+        // Describe what actually got rendered
+        if (dst_fmt->subSamplingW || dst_fmt->subSamplingH)
+            vsapi->mapSetInt(dst_props, "_ChromaLocation", dst_chroma_loc - 1, maReplace);
+        else
+            vsapi->mapDeleteKey(dst_props, "_ChromaLocation");
+
+        vsapi->mapSetInt(dst_props, "_ColorRange", dst_repr.levels == PL_COLOR_LEVELS_LIMITED, maReplace);
+        vsapi->mapSetInt(dst_props, "_Matrix", vspl_render_vs_matrix(dst_repr.sys), maReplace);
+
+        int transfer = vspl_render_vs_transfer(dst_csp.transfer);
+        if (transfer >= 0)
+            vsapi->mapSetInt(dst_props, "_Transfer", transfer, maReplace);
+        else
+            vsapi->mapDeleteKey(dst_props, "_Transfer");
+
+        int primaries = vspl_render_vs_primaries(dst_csp.primaries);
+        if (primaries >= 0)
+            vsapi->mapSetInt(dst_props, "_Primaries", primaries, maReplace);
+        else
+            vsapi->mapDeleteKey(dst_props, "_Primaries");
+
+        struct pl_plane_data planes[3] = {};
+        for (int i = 0; i < 3; ++i) {
+            planes[i] = (struct pl_plane_data) {
+                .type = src_fmt->sampleType == stInteger ? PL_FMT_UNORM : PL_FMT_FLOAT,
+                .width = vsapi->getFrameWidth(frame, i),
+                .height = vsapi->getFrameHeight(frame, i),
+                .pixel_stride = src_fmt->bytesPerSample,
+                .row_stride = vsapi->getStride(frame, i),
+                .pixels = vsapi->getReadPtr((VSFrame *) frame, i),
+            };
+
+            planes[i].component_size[0] = src_fmt->bytesPerSample * 8;
+            planes[i].component_pad[0] = 0;
+            planes[i].component_map[0] = i;
+        }
+
+        struct vspl_slot *s = d->order ? vspl_order_slot_acquire(d->order, d->vf, n)
+                                       : vspl_slot_acquire(d->vf);
+        if (!s) {
+            vsapi->setFilterError("placebo.Render: Too many frames waiting to be rendered in order, "
+                                  "request fewer frames at a time!", frameCtx);
+            vsapi->freeFrame(dst);
+            vsapi->freeFrame(frame);
+            return NULL;
+        }
+
+        struct vspl_resident_ref res;
+        vspl_resident_ref(d->vf, frame, &res, vsapi);
+
+        if (d->shader && !s->hook)
+            s->hook = pl_mpv_user_shader_parse(d->vf->gpu, d->shader, d->shader_len);
+
+        bool ok = false;
+        if (d->shader && !s->hook) {
+            vsapi->logMessage(mtCritical, "Failed parsing shader!\n", core);
+        } else {
+            const int64_t trace = vspl_trace_begin();
+            ok = vspl_render_reconfig(d->vf, s, planes, &d->vi_out, &res, core, vsapi);
+            vspl_trace_end(VSPL_TRACE_RECONFIG, trace);
+            if (ok) {
+                vspl_render_filter(d, s, n, dst, planes, &src_repr, &dst_repr, &src_csp, &dst_csp,
+                                   chroma_loc, dst_chroma_loc, &raw_hdr, &res, core, vsapi);
+            }
+        }
+
+        // Never got to the renderer, later frames mustn't wait for it
+        if (!ok && d->order)
+            vspl_order_cancel(d->order, n);
+
+        vspl_resident_unref(&res, vsapi);
+        vspl_resident_export(d->vf, dst, (pl_tex *[MAX_PLANES]) {&s->tex_out[0], &s->tex_out[1], &s->tex_out[2]},
+                             core, vsapi);
+        vspl_slot_profile(d->vf, s, dst, vsapi);
+        vspl_slot_release(d->vf, s);
+
+        vsapi->freeFrame(frame);
+        return dst;
+    } else if (activationReason == arError) {
+        if (d->order)
+            vspl_order_cancel(d->order, n);
+    }
+
+    return 0;
+}
+
+static void vspl_render_data_free(RenderData *d)
+{
+    free(d->shader);
+    vspl_sample_filter_params_free(d->sampleParams);
+    free(d->debandParams);
+    free(d->ditherParams);
+    free(d->colorMapParams);
+    free(d->peakDetectParams);
+    free(d->renderParams);
+}
+
+static void VS_CC VSPlaceboRenderFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    RenderData *d = (RenderData *) instanceData;
+    vsapi->freeNode(d->node);
+    pl_renderer_destroy(&d->rr);
+    vspl_order_destroy(&d->order);
+    vspl_hdr_tracker_destroy(&d->hdr_tracker, d->vf->log, "placebo.Render");
+    VSPlaceboUninit(d->vf);
+    vspl_render_data_free(d);
+    free(d);
+}
+
+static bool vspl_render_format_supported(const VSVideoFormat *fmt)
+{
+    // Float YUV has its chroma centered around 0, which libplacebo doesn't
+    // know how to decode
+    return (fmt->colorFamily == cfRGB || fmt->colorFamily == cfYUV) && vspl_format_supported(fmt) &&
+           (fmt->sampleType == stInteger || fmt->colorFamily == cfRGB);
+}
+
+void VS_CC VSPlaceboRenderCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    RenderData d = {0};
+    RenderData *data;
+    int err;
+    struct vspl_init_params init_params;
+    vspl_init_params_read(&init_params, in, core, vsapi);
+    d.trace_id = vspl_trace_id();
+
+    d.node = vsapi->mapGetNode(in, "clip", 0, 0);
+    d.vi = vsapi->getVideoInfo(d.node);
+    d.vi_out = *d.vi;
+
+    if (!vspl_render_format_supported(&d.vi->format)) {
+        vsapi->mapSetError(out, "placebo.Render: Input must be 8-16 bit integer RGB/YUV or 32 bit float RGB!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    d.vi_out.width = vsapi->mapGetIntSaturated(in, "width", 0, &err);
+    if (err)
+        d.vi_out.width = d.vi->width;
+
+    d.vi_out.height = vsapi->mapGetIntSaturated(in, "height", 0, &err);
+    if (err)
+        d.vi_out.height = d.vi->height;
+
+    int64_t format_id = vsapi->mapGetInt(in, "format", 0, &err);
+    if (!err && !vsapi->getVideoFormatByID(&d.vi_out.format, format_id, core)) {
+        vsapi->mapSetError(out, "placebo.Render: Invalid output format!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    if (!vspl_render_format_supported(&d.vi_out.format)) {
+        vsapi->mapSetError(out, "placebo.Render: Output format must be 8-16 bit integer RGB/YUV or 32 bit float RGB!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    if (d.vi_out.width <= 0 || d.vi_out.height <= 0 ||
+        (d.vi_out.width % (1 << d.vi_out.format.subSamplingW)) ||
+        (d.vi_out.height % (1 << d.vi_out.format.subSamplingH))) {
+        vsapi->mapSetError(out, "placebo.Render: Output dimensions must be positive and divisible by the output subsampling!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    d.dst_chroma_loc = vsapi->mapGetIntSaturated(in, "dst_chroma_loc", 0, &err);
+    if (err)
+        d.dst_chroma_loc = -1;
+
+    if (d.dst_chroma_loc < -1 || d.dst_chroma_loc > 5) {
+        vsapi->mapSetError(out, "placebo.Render: dst_chroma_loc must be between 0 and 5!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    // Color spaces, the target defaults to the source so nothing gets mapped
+    d.src_csp = vsapi->mapGetIntSaturated(in, "src_csp", 0, &err);
+    if (err)
+        d.src_csp = CSP_SDR;
+
+    int dst_csp = vsapi->mapGetIntSaturated(in, "dst_csp", 0, &err);
+    if (err)
+        dst_csp = d.src_csp;
+
+    if (d.src_csp == CSP_DOVI || !vspl_color_space_from_csp(d.src_csp, &d.src_pl_csp)) {
+        vsapi->mapSetError(out, "placebo.Render: Invalid source colorspace, use Tonemap for Dolby Vision!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    if (dst_csp == CSP_DOVI || !vspl_color_space_from_csp(dst_csp, &d.dst_pl_csp)) {
+        vsapi->mapSetError(out, "placebo.Render: Invalid target colorspace!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    d.original_src_max = vsapi->mapGetFloat(in, "src_max", 0, &err);
+    d.original_src_min = vsapi->mapGetFloat(in, "src_min", 0, &err);
+    d.src_pl_csp.hdr.max_luma = d.original_src_max;
+    d.src_pl_csp.hdr.min_luma = d.original_src_min;
+
+    d.dst_pl_csp.hdr.max_luma = vsapi->mapGetFloat(in, "dst_max", 0, &err);
+    d.dst_pl_csp.hdr.min_luma = vsapi->mapGetFloat(in, "dst_min", 0, &err);
+
+    int64_t dst_prim = vsapi->mapGetInt(in, "dst_prim", 0, &err);
+    if (!err)
+        d.dst_pl_csp.primaries = dst_prim;
+
+    d.metadata_steps = vsapi->mapGetIntSaturated(in, "metadata_steps", 0, &err);
+    if (err)
+        d.metadata_steps = VSPL_HDR_QUANTIZE_STEPS;
+
+    // Peak detection is only useful when tone mapping an HDR source
+    bool peak_detection = vsapi->mapGetInt(in, "dynamic_peak_detection", 0, &err);
+    if (err)
+        peak_detection = d.src_csp != CSP_SDR && d.src_csp != dst_csp;
+
+    // Custom shader
+    if (!vspl_shader_text_read(in, &d.shader, vsapi)) {
+        vsapi->mapSetError(out, "placebo.Render: Failed reading shader file!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    if (d.shader)
+        d.shader_len = strlen(d.shader);
+
+    bool deband = vsapi->mapGetInt(in, "deband", 0, &err);
+    if (err)
+        deband = false;
+
+    bool dither = vsapi->mapGetInt(in, "dither", 0, &err);
+    if (err)
+        dither = true;
+
+    bool linear = vsapi->mapGetInt(in, "linearize", 0, &err);
+    if (err)
+        linear = true;
+
+    bool sigmoid = vsapi->mapGetInt(in, "sigmoidize", 0, &err);
+    if (err)
+        sigmoid = true;
+
+    d.sampleParams = vspl_sample_filter_params_read(in, "ewa_lanczos", core, vsapi);
+    d.debandParams = vspl_deband_params_read(in, "deband_", vsapi);
+    d.ditherParams = vspl_dither_params_read(in, vsapi);
+    d.colorMapParams = vspl_color_map_params_read(in, vsapi);
+    d.peakDetectParams = vspl_peak_detect_params_read(in, vsapi);
+
+    struct pl_render_params *renderParams = malloc(sizeof(struct pl_render_params));
+    *renderParams = pl_render_default_params;
+
+    renderParams->upscaler = &d.sampleParams->filter;
+    renderParams->downscaler = &d.sampleParams->filter;
+    renderParams->antiringing_strength = d.sampleParams->antiring;
+    renderParams->deband_params = deband ? d.debandParams : NULL;
+    renderParams->sigmoid_params = sigmoid ? &pl_sigmoid_default_params : NULL;
+    renderParams->disable_linear_scaling = !linear;
+    renderParams->color_map_params = d.colorMapParams;
+    renderParams->peak_detect_params = peak_detection ? d.peakDetectParams : NULL;
+    renderParams->dither_params = dither ? d.ditherParams : NULL;
+    renderParams->cone_params = NULL;
+    renderParams->color_adjustment = NULL;
+
+    d.renderParams = renderParams;
+
+    d.vf = VSPlaceboInit(&init_params);
+    if (!d.vf) {
+        vsapi->mapSetError(out, "placebo.Render: Failed initializing libplacebo!");
+        vsapi->freeNode(d.node);
+        vspl_render_data_free(&d);
+        return;
+    }
+
+    // Parse it once up front to catch errors early; the other slots parse
+    // their own copy when they first get used.
+    if (d.shader) {
+        d.vf->slots[0].hook = pl_mpv_user_shader_parse(d.vf->gpu, d.shader, d.shader_len);
+
+        if (!d.vf->slots[0].hook) {
+            VSPlaceboUninit(d.vf);
+            vsapi->mapSetError(out, "placebo.Render: Failed parsing shader!");
+            vsapi->freeNode(d.node);
+            vspl_render_data_free(&d);
+            return;
+        }
+    }
+
+    // Same as Tonemap, the peak detection state needs the frames in order
+    if (peak_detection) {
+        d.rr = pl_renderer_create(d.vf->log, d.vf->gpu);
+        if (!d.rr) {
+            VSPlaceboUninit(d.vf);
+            vsapi->mapSetError(out, "placebo.Render: Failed creating renderer!");
+            vsapi->freeNode(d.node);
+            vspl_render_data_free(&d);
+            return;
+        }
+
+        d.order = vspl_order_create(d.vi->numFrames, core, vsapi);
+    }
+
+    if (d.src_csp != CSP_SDR)
+        d.hdr_tracker = vspl_hdr_tracker_create(1 + d.vf->num_slots);
+
+    VSFilterDependency deps[] = {{d.node, rpStrictSpatial}};
+
+    data = malloc(sizeof(d));
+    *data = d;
+
+    vsapi->createVideoFilter(
+        out,
+        "Render",
+        &data->vi_out,
+        VSPlaceboRenderGetFrame,
+        VSPlaceboRenderFree,
+        fmParallelRequests,
+        deps,
+        1,
+        data,
+        core
+    );
+}
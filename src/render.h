@@ -0,0 +1,8 @@
+#ifndef VS_PLACEBO_RENDER_H
+#define VS_PLACEBO_RENDER_H
+
+#include <VapourSynth4.h>
+
+void VS_CC VSPlaceboRenderCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi);
+
+#endif //VS_PLACEBO_RENDER_H
@@ -10,6 +10,9 @@
 #include <libplacebo/colorspace.h>
 
 #include "vs-placebo.h"
+#include "resident.h"
+#include "resample.h"
+#include "resample_cpu.h"
 
 typedef struct {
     VSNode *node;
@@ -26,17 +29,47 @@ typedef struct {
     float src_x;
     float src_y;
     struct pl_sample_filter_params *sampleParams;
-    pl_shader_obj lut;
     struct pl_sigmoid_params *sigmoid_params;
     enum pl_color_transfer trc;
     bool linear;
 
     /** Minimum luminance. */
     float min_luma;
+
+    /** The CPU backend leaves `vf` NULL, and has the weights of each plane. */
+    enum vspl_backend backend;
+    enum vspl_cpu_isa isa;
+    struct vspl_resample_cpu *cpu[MAX_PLANES];
+    bool profile;
+
+    // Tells the instance apart in traces
+    int trace_id;
 } ResampleData;
 
+/** The source region of a plane, in its own pixels. */
+static void vspl_resample_plane_rect(const ResampleData *d, const VSVideoFormat *fmt, int plane, int w,
+                                     float *sx, float *sy, float *src_w, float *src_h)
+{
+    const float subsampling_w = 1 << fmt->subSamplingW;
+    const float subsampling_h = 1 << fmt->subSamplingH;
+
+    // FIXME: support other chroma locations as well.
+    const float subsampling_shift_w = (0.5f * (1.0f - (float) w / (float) d->vi->width)) / subsampling_w;
+    const float subsampling_shift_h = 0.0;
+
+    const bool shift = fmt->colorFamily == cfYUV && (plane == 1 || plane == 2);
+    *sx = shift ? subsampling_shift_w + d->src_x / subsampling_w : d->src_x;
+    *sy = shift ? subsampling_shift_h + d->src_y / subsampling_h : d->src_y;
+
+    *src_w = shift ? d->src_width / subsampling_w : d->src_width;
+    *src_h = shift ? d->src_height / subsampling_h : d->src_height;
+}
+
 bool vspl_resample_do_plane(
     struct priv *p,
+    struct vspl_slot *s,
+    int idx,
+    pl_tex tex_in,
     void *data,
     int w,
     int h,
@@ -49,12 +82,10 @@ bool vspl_resample_do_plane(
 )
 {
     ResampleData *d = (ResampleData*) data;
-    pl_shader sh = pl_dispatch_begin(p->dp);
-    pl_tex sample_fbo = NULL;
-    pl_tex sep_fbo = NULL;
+    pl_shader sh = pl_dispatch_begin(s->dp);
 
     struct pl_sample_filter_params sampleFilterParams = *d->sampleParams;
-    sampleFilterParams.lut = &d->lut;
+    sampleFilterParams.lut = &s->lut;
 
     struct pl_color_space *color = pl_color_space(
         .transfer = d->trc,
@@ -62,38 +93,51 @@ bool vspl_resample_do_plane(
     );
 
     struct pl_sample_src *src = pl_sample_src(
-        .tex = p->tex_in[0]
+        .tex = tex_in
     );
 
     //
     // linearization and sigmoidization
     //
 
-    pl_shader ish = pl_dispatch_begin(p->dp);
-    struct pl_tex_params *tex_params = pl_tex_params(
-        .w = src->tex->params.w,
-        .h = src->tex->params.h,
-        .renderable = true,
-        .sampleable = true,
-        .format = src->tex->params.format
-    );
+    // Without either, the scaler reads the uploaded texture directly instead
+    // of going through a full-size copy of it first
+    if (d->linear || d->sigmoid_params) {
+        pl_shader ish = pl_dispatch_begin(s->dp);
+        struct pl_tex_params *tex_params = pl_tex_params(
+            .w = src->tex->params.w,
+            .h = src->tex->params.h,
+            .renderable = true,
+            .sampleable = true,
+            .format = src->tex->params.format
+        );
 
-    if (!pl_tex_recreate(p->gpu, &sample_fbo, tex_params))
-        vsapi->logMessage(mtCritical, "failed creating intermediate color texture!\n", core);
+        // The intermediate textures stay with the slot, and only get swapped
+        // through the pool when the plane size changes
+        if (!vspl_tex_pool_recreate(p->pool, &s->tex_tmp[idx * 2], tex_params)) {
+            vsapi->logMessage(mtCritical, "failed creating intermediate color texture!\n", core);
+            pl_dispatch_abort(s->dp, &ish);
+            pl_dispatch_abort(s->dp, &sh);
+            return false;
+        }
 
-    pl_shader_sample_direct(ish, src);
-    if (d->linear)
-        pl_shader_linearize(ish, color);
+        pl_shader_sample_direct(ish, src);
+        if (d->linear)
+            pl_shader_linearize(ish, color);
 
-    if (d->sigmoid_params)
-        pl_shader_sigmoidize(ish, d->sigmoid_params);
+        if (d->sigmoid_params)
+            pl_shader_sigmoidize(ish, d->sigmoid_params);
 
-    if (!pl_dispatch_finish(p->dp, pl_dispatch_params(
-        .target = sample_fbo,
-        .shader = &ish
-    ))) {
-        vsapi->logMessage(mtCritical, "Failed linearizing/sigmoidizing! \n", core);
-        return false;
+        if (!pl_dispatch_finish(s->dp, pl_dispatch_params(
+            .target = s->tex_tmp[idx * 2],
+            .shader = &ish,
+            .timer = s->prof.render,
+        ))) {
+            vsapi->logMessage(mtCritical, "Failed linearizing/sigmoidizing! \n", core);
+            return false;
+        }
+
+        src->tex = s->tex_tmp[idx * 2];
     }
 
     //
@@ -106,7 +150,6 @@ bool vspl_resample_do_plane(
         src_width + sx,
         src_height + sy,
     };
-    src->tex = sample_fbo;
     src->rect = rect;
     src->new_h = h;
     src->new_w = w;
@@ -122,11 +165,11 @@ bool vspl_resample_do_plane(
         src2.rect.y0 = 0;
         src2.rect.y1 = src1.new_h;
 
-        pl_shader tsh = pl_dispatch_begin(p->dp);
+        pl_shader tsh = pl_dispatch_begin(s->dp);
 
         if (!pl_shader_sample_ortho2(tsh, &src1, &sampleFilterParams)) {
             vsapi->logMessage(mtCritical, "Failed dispatching vertical pass!\n", core);
-            pl_dispatch_abort(p->dp, &tsh);
+            pl_dispatch_abort(s->dp, &tsh);
         }
 
         struct pl_tex_params *tex_params = pl_tex_params(
@@ -137,12 +180,18 @@ bool vspl_resample_do_plane(
             .format = src->tex->params.format,
         );
 
-        if (!pl_tex_recreate(p->gpu, &sep_fbo, tex_params))
+        if (!vspl_tex_pool_recreate(p->pool, &s->tex_tmp[idx * 2 + 1], tex_params)) {
             vsapi->logMessage(mtCritical, "failed creating intermediate texture!\n", core);
+            pl_dispatch_abort(s->dp, &tsh);
+            pl_dispatch_abort(s->dp, &sh);
+            return false;
+        }
+        pl_tex sep_fbo = s->tex_tmp[idx * 2 + 1];
 
-        if (!pl_dispatch_finish(p->dp, pl_dispatch_params (
+        if (!pl_dispatch_finish(s->dp, pl_dispatch_params (
             .target = sep_fbo,
-            .shader = &tsh
+            .shader = &tsh,
+            .timer = s->prof.render,
         ))) {
             vsapi->logMessage(mtCritical, "Failed rendering vertical pass! \n", core);
             return false;
@@ -161,16 +210,13 @@ bool vspl_resample_do_plane(
         pl_shader_delinearize(sh, color);
 
 
-    bool ok = pl_dispatch_finish(p->dp, pl_dispatch_params(
-        .target = p->tex_out[0],
-        .shader = &sh
+    return pl_dispatch_finish(s->dp, pl_dispatch_params(
+        .target = s->tex_out[idx],
+        .shader = &sh,
+        .timer = s->prof.render,
     ));
 
-    pl_tex_destroy(p->gpu, &sep_fbo);
-    pl_tex_destroy(p->gpu, &sample_fbo);
-    return ok;
-
-//    struct pl_plane plane = (struct pl_plane) {.texture = p->tex_in[0], .components = 1, .component_mapping[0] = 0};
+//    struct pl_plane plane = (struct pl_plane) {.texture = s->tex_in[0], .components = 1, .component_mapping[0] = 0};
 //
 //    struct pl_color_repr crpr = {.bits = {.sample_depth = d->vi->format->bytesPerSample * 8, .color_depth =
 //    d->vi->format->bytesPerSample * 8, .bit_shift = 0},
@@ -179,7 +225,7 @@ bool vspl_resample_do_plane(
 //    struct pl_image img = {.num_planes = 1, .width = d->vi->width, .height = d->vi->height,
 //            .planes[0] = plane,
 //            .repr = crpr, .color = (struct pl_color_space) {0}};
-//    struct pl_render_target out = {.color = (struct pl_color_space) {0}, .repr = crpr, .fbo = p->tex_out[0]};
+//    struct pl_render_target out = {.color = (struct pl_color_space) {0}, .repr = crpr, .fbo = s->tex_out[0]};
 //    struct pl_render_params par = {
 //            .downscaler = &d->sampleParams->filter,
 //            .upscaler = &d->sampleParams->filter,
@@ -190,7 +236,7 @@ bool vspl_resample_do_plane(
 
 }
 
-bool vspl_resample_reconfig(void *priv, struct pl_plane_data *data, int w, int h, VSCore *core, const VSAPI *vsapi)
+bool vspl_resample_reconfig(void *priv, struct vspl_slot *s, int idx, struct pl_plane_data *data, int w, int h, bool upload, VSCore *core, const VSAPI *vsapi)
 {
     struct priv *p = priv;
 
@@ -201,21 +247,24 @@ bool vspl_resample_reconfig(void *priv, struct pl_plane_data *data, int w, int h
     }
 
     bool ok = true;
-    ok &= pl_tex_recreate(p->gpu, &p->tex_in[0], pl_tex_params(
-        .w = data->width,
-        .h = data->height,
-        .format = fmt,
-        .sampleable = true,
-        .host_writable = true,
-    ));
+    if (upload) {
+        ok &= vspl_tex_pool_recreate(p->pool, &s->tex_in[idx], pl_tex_params(
+            .w = data->width,
+            .h = data->height,
+            .format = fmt,
+            .sampleable = true,
+            .host_writable = true,
+        ));
+    }
 
-    ok &= pl_tex_recreate(p->gpu, &p->tex_out[0], pl_tex_params(
+    ok &= vspl_tex_pool_recreate(p->pool, &s->tex_out[idx], pl_tex_params(
         .w = w,
         .h = h,
         .format = fmt,
         .renderable = true,
         .host_readable = true,
         .storable = true,
+        .sampleable = p->resident,
     ));
 
     if (!ok) {
@@ -228,6 +277,7 @@ bool vspl_resample_reconfig(void *priv, struct pl_plane_data *data, int w, int h
 
 bool vspl_resample_filter(
     void *priv,
+    struct vspl_slot *s,
     VSFrame *dst,
     struct pl_plane_data *src,
     void *d,
@@ -239,28 +289,35 @@ bool vspl_resample_filter(
     float sy,
     VSCore *core,
     const VSAPI *vsapi,
-    int planeIdx
+    int planeIdx,
+    pl_tex resident_tex
 )
 {
     struct priv *p = priv;
 
-    pl_fmt in_fmt = p->tex_in[0]->params.format;
-    pl_fmt out_fmt = p->tex_out[0]->params.format;
+    pl_fmt out_fmt = s->tex_out[planeIdx]->params.format;
+    pl_tex tex_in = resident_tex;
 
-    // Upload planes
+    // Upload planes, unless they are still on the GPU
     bool ok = true;
-    ok &= pl_tex_upload(p->gpu, pl_tex_transfer_params(
-        .tex = p->tex_in[0],
-        .row_pitch = (src->row_stride / src->pixel_stride) * in_fmt->texel_size,
-        .ptr = (void *) src->pixels,
-    ));
+    if (!tex_in) {
+        tex_in = s->tex_in[planeIdx];
+        ok &= vspl_upload_async(p->gpu, &s->xfer, pl_tex_transfer_params(
+            .tex = tex_in,
+            .row_pitch = (src->row_stride / src->pixel_stride) * tex_in->params.format->texel_size,
+            .ptr = (void *) src->pixels,
+        ));
+    }
 
     if (!ok) {
         vsapi->logMessage(mtCritical, "Failed uploading data to the GPU!\n", core);
         return false;
     }
     // Process plane
-    if (!vspl_resample_do_plane(p, d, w, h, src_width, src_height, core, vsapi, sx, sy)) {
+    const int64_t trace = vspl_trace_begin();
+    ok = vspl_resample_do_plane(p, s, planeIdx, tex_in, d, w, h, src_width, src_height, core, vsapi, sx, sy);
+    vspl_trace_end(VSPL_TRACE_RENDER, trace);
+    if (!ok) {
         vsapi->logMessage(mtCritical, "Failed processing planes!\n", core);
         return false;
     }
@@ -268,9 +325,9 @@ bool vspl_resample_filter(
     uint8_t *dst_ptr = vsapi->getWritePtr(dst, planeIdx);
     int dst_row_pitch = (vsapi->getStride(dst, planeIdx) / src->pixel_stride) * out_fmt->texel_size;
 
-    // Download planes
-    ok = pl_tex_download(p->gpu, pl_tex_transfer_params(
-        .tex = p->tex_out[0],
+    // Queue the download, the caller waits for all planes at once
+    ok = vspl_download_async(p->gpu, &s->xfer, pl_tex_transfer_params(
+        .tex = s->tex_out[planeIdx],
         .row_pitch = dst_row_pitch,
         .ptr = (void *) dst_ptr,
     ));
@@ -322,53 +379,96 @@ void vspl_propagate_sar(
     }
 }
 
-static const VSFrame *VS_CC VSPlaceboResampleGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
-    ResampleData *d = (ResampleData *) instanceData;
+static void vspl_resample_gpu_frame(ResampleData *d, const VSFrame *frame, VSFrame *dst,
+                                    VSCore *core, const VSAPI *vsapi)
+{
+    const VSVideoFormat *srcFmt = vsapi->getVideoFrameFormat(frame);
+
+    // All planes go through the same slot, so they get submitted together
+    // and the frame only has to wait for the GPU once
+    struct vspl_slot *s = vspl_slot_acquire(d->vf);
+
+    struct vspl_resident_ref res;
+    vspl_resident_ref(d->vf, frame, &res, vsapi);
+
+    for (unsigned int i = 0; i < srcFmt->numPlanes; i++) {
+        struct pl_plane_data plane = {
+            .type = srcFmt->sampleType == stInteger ? PL_FMT_UNORM : PL_FMT_FLOAT,
+            .width = vsapi->getFrameWidth(frame, i),
+            .height = vsapi->getFrameHeight(frame, i),
+            .pixel_stride = srcFmt->bytesPerSample,
+            .row_stride = vsapi->getStride(frame, i),
+            .pixels = vsapi->getReadPtr((VSFrame *) frame, i),
+            .component_size[0] = srcFmt->bitsPerSample,
+            .component_pad[0] = 0,
+            .component_map[0] = 0,
+        };
+
+        int w = vsapi->getFrameWidth(dst, i), h = vsapi->getFrameHeight(dst, i);
+
+        float sx, sy, src_w, src_h;
+        vspl_resample_plane_rect(d, srcFmt, i, w, &sx, &sy, &src_w, &src_h);
+
+        pl_tex resident_tex = vspl_resident_tex(&res, i);
+        const int64_t trace = vspl_trace_begin();
+        bool ok = vspl_resample_reconfig(d->vf, s, i, &plane, w, h, !resident_tex, core, vsapi);
+        vspl_trace_end(VSPL_TRACE_RECONFIG, trace);
+        if (ok) {
+            vspl_resample_filter(d->vf, s, dst, &plane, d, w, h, src_w, src_h, sx, sy, core, vsapi, i, resident_tex);
+        }
+    }
 
-    if (activationReason == arInitial) {
-        vsapi->requestFrameFilter(n, d->node, frameCtx);
-    } else if (activationReason == arAllFramesReady) {
-        const VSFrame *frame = vsapi->getFrameFilter(n, d->node, frameCtx);
+    vspl_download_wait(((struct priv *) d->vf)->gpu, &s->xfer);
+    vspl_resident_unref(&res, vsapi);
 
-        const VSVideoFormat *srcFmt = vsapi->getVideoFrameFormat(frame);
-        const float subsampling_w = 1 << srcFmt->subSamplingW;
-        const float subsampling_h = 1 << srcFmt->subSamplingH;
+    pl_tex *out_tex[MAX_PLANES] = {0};
+    for (int i = 0; i < srcFmt->numPlanes; i++)
+        out_tex[i] = &s->tex_out[i];
+    vspl_resident_export(d->vf, dst, out_tex, core, vsapi);
 
-        VSFrame *dst = vsapi->newVideoFrame(srcFmt, d->width, d->height, frame, core);
+    vspl_slot_profile(d->vf, s, dst, vsapi);
+    vspl_slot_release(d->vf, s);
+}
 
-        for (unsigned int i = 0; i < srcFmt->numPlanes; i++) {
-            struct pl_plane_data plane = {
-                .type = srcFmt->sampleType == stInteger ? PL_FMT_UNORM : PL_FMT_FLOAT,
-                .width = vsapi->getFrameWidth(frame, i),
-                .height = vsapi->getFrameHeight(frame, i),
-                .pixel_stride = srcFmt->bytesPerSample,
-                .row_stride = vsapi->getStride(frame, i),
-                .pixels = vsapi->getReadPtr((VSFrame *) frame, i),
-                .component_size[0] = srcFmt->bitsPerSample,
-                .component_pad[0] = 0,
-                .component_map[0] = 0,
-            };
+static void vspl_resample_cpu_frame(ResampleData *d, const VSFrame *frame, VSFrame *dst,
+                                    VSCore *core, const VSAPI *vsapi)
+{
+    const VSVideoFormat *fmt = vsapi->getVideoFrameFormat(frame);
 
-            int w = vsapi->getFrameWidth(dst, i), h = vsapi->getFrameHeight(dst, i);
+    bool ok = true;
+    for (int i = 0; i < fmt->numPlanes; i++) {
+        ok &= vspl_resample_cpu_plane(d->cpu[i], d->isa, fmt, vsapi->getReadPtr(frame, i), vsapi->getStride(frame, i),
+                                      vsapi->getWritePtr(dst, i), vsapi->getStride(dst, i));
+    }
 
-            // FIXME: support other chroma locations as well.
-            const float subsampling_shift_w = (0.5f * (1.0f - (float) w / (float) d->vi->width)) / subsampling_w;
-            const float subsampling_shift_h = 0.0;
+    if (!ok) {
+        vsapi->logMessage(mtCritical, "placebo.Resample: Failed allocating memory!\n", core);
+    }
+}
 
-            const bool shift = srcFmt->colorFamily == cfYUV && (i == 1 || i == 2);
-            const float sx = shift ? subsampling_shift_w + d->src_x / subsampling_w : d->src_x;
-            const float sy = shift ? subsampling_shift_h + d->src_y / subsampling_h : d->src_y;
+static const VSFrame *VS_CC VSPlaceboResampleGetFrame(int n, int activationReason, void *instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    ResampleData *d = (ResampleData *) instanceData;
 
-            const float src_w = shift ? d->src_width / subsampling_w : d->src_width;
-            const float src_h = shift ? d->src_height / subsampling_h : d->src_height;
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        vspl_counter_add(VSPL_COUNTER_RESAMPLE_FRAMES, 1);
+        vspl_trace_frame("Resample", d->trace_id, n);
 
-            pthread_mutex_lock(&vspl_vulkan_mutex);
+        const VSFrame *frame = vsapi->getFrameFilter(n, d->node, frameCtx);
 
-            if (vspl_resample_reconfig(d->vf, &plane, w, h, core, vsapi)) {
-                vspl_resample_filter(d->vf, dst, &plane, d, w, h, src_w, src_h, sx, sy, core, vsapi, i);
-            }
+        const VSVideoFormat *srcFmt = vsapi->getVideoFrameFormat(frame);
+        VSFrame *dst = vsapi->newVideoFrame(srcFmt, d->width, d->height, frame, core);
 
-            pthread_mutex_unlock(&vspl_vulkan_mutex);
+        if (d->backend == VSPL_BACKEND_CPU) {
+            const int64_t start = d->profile ? vspl_profile_now() : 0;
+            const int64_t trace = vspl_trace_begin();
+            vspl_resample_cpu_frame(d, frame, dst, core, vsapi);
+            vspl_trace_end(VSPL_TRACE_CPU, trace);
+            if (d->profile)
+                vspl_profile_write_cpu(start, vsapi->getFramePropertiesRW(dst), vsapi);
+        } else {
+            vspl_resample_gpu_frame(d, frame, dst, core, vsapi);
         }
 
         const VSMap *src_props = vsapi->getFramePropertiesRO(frame);
@@ -392,26 +492,87 @@ static const VSFrame *VS_CC VSPlaceboResampleGetFrame(int n, int activationReaso
     return 0;
 }
 
-static void VS_CC VSPlaceboResampleFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
-    ResampleData *d = (ResampleData *) instanceData;
+struct pl_sample_filter_params *vspl_sample_filter_params_read(const VSMap *in, const char *default_filter,
+                                                               VSCore *core, const VSAPI *vsapi)
+{
+    int err;
+    struct pl_sample_filter_params *sampleFilterParams = calloc(1, sizeof(struct pl_sample_filter_params));
+
+    sampleFilterParams->no_widening = false;
+    sampleFilterParams->no_compute = false;
+    sampleFilterParams->antiring = vsapi->mapGetFloat(in, "antiring", 0, &err);
+
+    const char *filter = vsapi->mapGetData(in, "filter", 0, &err);
+    if (err && default_filter) {
+        filter = default_filter;
+    } else if (err) {
+        vsapi->logMessage(mtWarning, "Unspecified filter... selecting ewa_lanczos.\n", core);
+        filter = "ewa_lanczos";
+    }
+
+    const struct pl_filter_config *filter_config = pl_find_filter_config(filter, PL_FILTER_SCALING);
+    if (filter_config) {
+        sampleFilterParams->filter = *filter_config;
+    } else {
+        vsapi->logMessage(mtWarning, "Unknown filter... selecting ewa_lanczos.\n", core);
+        sampleFilterParams->filter = pl_filter_ewa_lanczos;
+    }
+
+    sampleFilterParams->filter.clamp = vsapi->mapGetFloat(in, "clamp", 0, &err);
+    sampleFilterParams->filter.blur = vsapi->mapGetFloat(in, "blur", 0, &err);
+    sampleFilterParams->filter.taper = vsapi->mapGetFloat(in, "taper", 0, &err);
+
+    struct pl_filter_function *f = calloc(1, sizeof(struct pl_filter_function));
+
+    *f = *sampleFilterParams->filter.kernel;
+    if (f->resizable) {
+        vsapi->mapGetFloat(in, "radius", 0, &err);
+        if (!err)
+            f->radius = vsapi->mapGetFloat(in, "radius", 0, &err);
+    }
+
+    vsapi->mapGetFloat(in, "param1", 0, &err);
+    if (!err && f->tunable[0])
+        sampleFilterParams->filter.params[0] = vsapi->mapGetFloat(in, "param1", 0, &err);
+
+    vsapi->mapGetFloat(in, "param2", 0, &err);
+    if (!err && f->tunable[1])
+        sampleFilterParams->filter.params[1] = vsapi->mapGetFloat(in, "param2", 0, &err);
+
+    sampleFilterParams->filter.kernel = f;
+    return sampleFilterParams;
+}
+
+void vspl_sample_filter_params_free(struct pl_sample_filter_params *params)
+{
+    free((void *) params->filter.kernel);
+    free(params);
+}
+
+static void vspl_resample_data_free(ResampleData *d, const VSAPI *vsapi)
+{
     vsapi->freeNode(d->node);
-    pl_shader_obj_destroy(&d->lut);
-    free((void *) d->sampleParams->filter.kernel);
-    free(d->sampleParams);
+    vspl_sample_filter_params_free(d->sampleParams);
     free(d->sigmoid_params);
-    VSPlaceboUninit(d->vf);
+    for (int i = 0; i < MAX_PLANES; i++)
+        vspl_resample_cpu_destroy(&d->cpu[i]);
+    if (d->vf)
+        VSPlaceboUninit(d->vf);
+}
+
+static void VS_CC VSPlaceboResampleFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
+    ResampleData *d = (ResampleData *) instanceData;
+    vspl_resample_data_free(d, vsapi);
     free(d);
 }
 
 void VS_CC VSPlaceboResampleCreate(const VSMap *in, VSMap *out, void *useResampleData, VSCore *core, const VSAPI *vsapi) {
-    ResampleData d;
+    ResampleData d = {0};
     ResampleData *data;
     int err;
-    enum pl_log_level log_level;
-
-    log_level = vsapi->mapGetInt(in, "log_level", 0, &err);
-    if (err)
-        log_level = PL_LOG_ERR;
+    struct vspl_init_params init_params;
+    vspl_init_params_read(&init_params, in, core, vsapi);
+    d.trace_id = vspl_trace_id();
 
     d.node = vsapi->mapGetNode(in, "clip", 0, 0);
     d.vi = vsapi->getVideoInfo(d.node);
@@ -422,8 +583,6 @@ void VS_CC VSPlaceboResampleCreate(const VSMap *in, VSMap *out, void *useResampl
         vsapi->freeNode(d.node);
     }
 
-    d.vf = VSPlaceboInit(log_level);
-
     d.width = vsapi->mapGetInt(in, "width", 0, &err);
     if (err)
         d.width = d.vi->width;
@@ -483,50 +642,62 @@ void VS_CC VSPlaceboResampleCreate(const VSMap *in, VSMap *out, void *useResampl
         d.sigmoid_params = sigmoidParams;
     }
 
-    struct pl_sample_filter_params *sampleFilterParams = calloc(1, sizeof(struct pl_sample_filter_params));;
-
-    d.lut = NULL;
-    sampleFilterParams->no_widening = false;
-    sampleFilterParams->no_compute = false;
-    sampleFilterParams->antiring = vsapi->mapGetFloat(in, "antiring", 0, &err);
+    d.sampleParams = vspl_sample_filter_params_read(in, NULL, core, vsapi);
 
-    const char *filter = vsapi->mapGetData(in, "filter", 0, &err);
-    if (err) {
-        vsapi->logMessage(mtWarning, "Unspecified filter... selecting ewa_lanczos.\n", core);
-        filter = "ewa_lanczos";
+    if (!vspl_backend_read(&d.backend, in, vsapi)) {
+        vsapi->mapSetError(out, "placebo.Resample: backend must be \"gpu\", \"cpu\" or \"auto\"!");
+        vspl_resample_data_free(&d, vsapi);
+        return;
     }
 
-    const struct pl_filter_config *filter_config = pl_find_filter_config(filter, PL_FILTER_SCALING);
-    if (filter_config) {
-        sampleFilterParams->filter = *filter_config;
-    } else {
-        vsapi->logMessage(mtWarning, "Unknown filter... selecting ewa_lanczos.\n", core);
-        sampleFilterParams->filter = pl_filter_ewa_lanczos;
-    }
+    // Only plain resizes of known frame sizes have a CPU implementation
+    const bool cpu_supported = vspl_resample_cpu_supported(d.sampleParams) && !d.linear && !d.sigmoid_params &&
+                               vsh_isConstantVideoFormat(d.vi);
 
-    sampleFilterParams->filter.clamp = vsapi->mapGetFloat(in, "clamp", 0, &err);
-    sampleFilterParams->filter.blur = vsapi->mapGetFloat(in, "blur", 0, &err);
-    sampleFilterParams->filter.taper = vsapi->mapGetFloat(in, "taper", 0, &err);
+    if (d.backend == VSPL_BACKEND_CPU && !cpu_supported) {
+        vsapi->mapSetError(out, "placebo.Resample: The CPU backend needs a constant format clip, an orthogonal "
+                                "filter, and linearize and sigmoidize disabled!");
+        vspl_resample_data_free(&d, vsapi);
+        return;
+    }
 
-    struct pl_filter_function *f = calloc(1, sizeof(struct pl_filter_function));
+    // Small frames aren't worth the round trip through the GPU
+    if (d.backend == VSPL_BACKEND_AUTO && !cpu_supported) {
+        d.backend = VSPL_BACKEND_GPU;
+    } else if (d.backend == VSPL_BACKEND_AUTO &&
+               (int64_t) (d.vi->width > d.width ? d.vi->width : d.width) *
+               (d.vi->height > d.height ? d.vi->height : d.height) <= VSPL_RESAMPLE_CPU_AUTO_PIXELS) {
+        d.backend = VSPL_BACKEND_CPU;
+    }
 
-    *f = *sampleFilterParams->filter.kernel;
-    if (f->resizable) {
-        vsapi->mapGetFloat(in, "radius", 0, &err);
-        if (!err)
-            f->radius = vsapi->mapGetFloat(in, "radius", 0, &err);
+    d.vf = vspl_backend_init(&d.backend, &init_params);
+    d.profile = init_params.profile;
+    if (d.backend == VSPL_BACKEND_GPU && !d.vf) {
+        vsapi->mapSetError(out, "placebo.Resample: Failed initializing libplacebo!");
+        vspl_resample_data_free(&d, vsapi);
+        return;
     }
 
-    vsapi->mapGetFloat(in, "param1", 0, &err);
-    if (!err && f->tunable[0])
-        sampleFilterParams->filter.params[0] = vsapi->mapGetFloat(in, "param1", 0, &err);
+    if (d.backend == VSPL_BACKEND_CPU) {
+        d.isa = vspl_cpu_isa_detect();
 
-    vsapi->mapGetFloat(in, "param2", 0, &err);
-    if (!err && f->tunable[1])
-        sampleFilterParams->filter.params[1] = vsapi->mapGetFloat(in, "param2", 0, &err);
+        const VSVideoFormat *fmt = &d.vi->format;
+        for (int i = 0; i < fmt->numPlanes; i++) {
+            const int ssw = i ? fmt->subSamplingW : 0, ssh = i ? fmt->subSamplingH : 0;
+            const int w = d.width >> ssw;
 
-    sampleFilterParams->filter.kernel = f;
-    d.sampleParams = sampleFilterParams;
+            float sx, sy, src_w, src_h;
+            vspl_resample_plane_rect(&d, fmt, i, w, &sx, &sy, &src_w, &src_h);
+
+            d.cpu[i] = vspl_resample_cpu_create(d.sampleParams, d.vi->width >> ssw, d.vi->height >> ssh,
+                                                w, d.height >> ssh, sx, sy, src_w, src_h);
+            if (!d.cpu[i]) {
+                vsapi->mapSetError(out, "placebo.Resample: Failed computing filter weights!");
+                vspl_resample_data_free(&d, vsapi);
+                return;
+            }
+        }
+    }
 
     data = malloc(sizeof(d));
     *data = d;
@@ -539,7 +710,8 @@ void VS_CC VSPlaceboResampleCreate(const VSMap *in, VSMap *out, void *useResampl
         &vi_out,
         VSPlaceboResampleGetFrame,
         VSPlaceboResampleFree,
-        fmParallelRequests,
+        // Without slots to wait for, frames run fully in parallel
+        d.backend == VSPL_BACKEND_CPU ? fmParallel : fmParallelRequests,
         deps,
         1,
         data,
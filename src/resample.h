@@ -3,6 +3,16 @@
 
 #include <VapourSynth4.h>
 
+#include <libplacebo/shaders/sampling.h>
+
+// Parse the filter arguments (`filter`, `radius`, `clamp`, `taper`, `blur`,
+// `param1`, `param2` and `antiring`). The kernel is copied so the user's
+// radius can be applied, release both with vspl_sample_filter_params_free.
+// Without a `default_filter`, a missing `filter` warns and uses ewa_lanczos.
+struct pl_sample_filter_params *vspl_sample_filter_params_read(const VSMap *in, const char *default_filter,
+                                                               VSCore *core, const VSAPI *vsapi);
+void vspl_sample_filter_params_free(struct pl_sample_filter_params *params);
+
 void VS_CC VSPlaceboResampleCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi);
 
 #endif //VS_PLACEBO_RESAMPLE_H
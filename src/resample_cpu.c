@@ -0,0 +1,344 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libplacebo/config.h>
+#include <libplacebo/filters.h>
+
+#include "resample_cpu.h"
+
+#if VSPL_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#if VSPL_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+// Weights of one direction
+struct vspl_resample_axis {
+    int size;
+    int taps;
+
+    // First input of each output
+    int *offset;
+    // Tap left of each output's center, relative to its offset
+    int *center;
+    float *weights;
+};
+
+struct vspl_resample_cpu {
+    struct vspl_resample_axis x, y;
+    int src_w, src_h;
+    float antiring;
+};
+
+bool vspl_resample_cpu_supported(const struct pl_sample_filter_params *params)
+{
+#if PL_API_VER >= 303
+    return !params->filter.polar;
+#else
+    return false;
+#endif
+}
+
+#if PL_API_VER >= 303
+
+static inline int vspl_clamp(int v, int min, int max)
+{
+    return v < min ? min : v > max ? max : v;
+}
+
+static float vspl_filter_radius(const struct pl_filter_config *c)
+{
+    float radius = c->radius > 0 && c->kernel->resizable ? c->radius : c->kernel->radius;
+    return c->blur > 0 ? radius * c->blur : radius;
+}
+
+static void vspl_resample_axis_uninit(struct vspl_resample_axis *ax)
+{
+    free(ax->offset);
+    free(ax->center);
+    free(ax->weights);
+}
+
+static bool vspl_resample_axis_init(struct vspl_resample_axis *ax, const struct pl_sample_filter_params *params,
+                                    int src, int dst, float start, float len)
+{
+    const struct pl_filter_config *cfg = &params->filter;
+
+    // Downscaling widens the filter, like the shaders do
+    const double scale = (double) len / dst;
+    const double widen = !params->no_widening && scale > 1 ? scale : 1;
+    const double support = vspl_filter_radius(cfg) * widen;
+
+    const int full_taps = (int) ceil(2 * support) + 1;
+    const int taps = full_taps < src ? full_taps : src;
+
+    ax->size = dst;
+    ax->taps = taps;
+    ax->offset = malloc(dst * sizeof(int));
+    ax->center = malloc(dst * sizeof(int));
+    ax->weights = calloc((size_t) dst * taps, sizeof(float));
+    if (!ax->offset || !ax->center || !ax->weights)
+        return false;
+
+    for (int i = 0; i < dst; i++) {
+        const double c = start + (i + 0.5) * scale - 0.5;
+        const int first = (int) floor(c - support) + 1;
+        const int offset = vspl_clamp(first, 0, src - taps);
+        float *w = &ax->weights[(size_t) i * taps];
+
+        // Taps past the edges fold onto the edge pixels
+        double sum = 0;
+        for (int k = 0; k < full_taps; k++) {
+            const int j = first + k;
+            float weight = pl_filter_sample(cfg, (float) ((j - c) / widen));
+            if (weight < 0)
+                weight *= 1.0f - cfg->clamp;
+
+            w[vspl_clamp(j, 0, src - 1) - offset] += weight;
+            sum += weight;
+        }
+
+        if (sum != 0) {
+            for (int k = 0; k < taps; k++)
+                w[k] = (float) (w[k] / sum);
+        } else {
+            w[vspl_clamp((int) lround(c), 0, src - 1) - offset] = 1.0f;
+        }
+
+        ax->offset[i] = offset;
+        ax->center[i] = vspl_clamp(vspl_clamp((int) floor(c), 0, src - 1) - offset, 0, taps > 1 ? taps - 2 : 0);
+    }
+
+    return true;
+}
+
+struct vspl_resample_cpu *vspl_resample_cpu_create(const struct pl_sample_filter_params *params,
+                                                   int src_w, int src_h, int dst_w, int dst_h,
+                                                   float sx, float sy, float src_width, float src_height)
+{
+    struct vspl_resample_cpu *rs = calloc(1, sizeof(*rs));
+    if (!rs)
+        return NULL;
+
+    rs->src_w = src_w;
+    rs->src_h = src_h;
+    rs->antiring = params->antiring;
+
+    if (!vspl_resample_axis_init(&rs->x, params, src_w, dst_w, sx, src_width) ||
+        !vspl_resample_axis_init(&rs->y, params, src_h, dst_h, sy, src_height)) {
+        vspl_resample_cpu_destroy(&rs);
+        return NULL;
+    }
+
+    return rs;
+}
+
+void vspl_resample_cpu_destroy(struct vspl_resample_cpu **rs)
+{
+    struct vspl_resample_cpu *r = *rs;
+    if (!r)
+        return;
+
+    vspl_resample_axis_uninit(&r->x);
+    vspl_resample_axis_uninit(&r->y);
+    free(r);
+    *rs = NULL;
+}
+
+static inline float vspl_antiring(float v, float a, float b, float strength)
+{
+    const float lo = a < b ? a : b, hi = a < b ? b : a;
+    const float clamped = v < lo ? lo : v > hi ? hi : v;
+    return v + strength * (clamped - v);
+}
+
+// Horizontal pass of one row, into normalized floats
+#define VSPL_RESAMPLE_ROW(name, type)                                                     \
+static void name(const struct vspl_resample_axis *ax, const type *src, float scale,      \
+                 float antiring, float *out)                                             \
+{                                                                                        \
+    for (int x = 0; x < ax->size; x++) {                                                 \
+        const float *w = &ax->weights[(size_t) x * ax->taps];                            \
+        const type *s = src + ax->offset[x];                                             \
+                                                                                         \
+        float sum = 0;                                                                   \
+        for (int k = 0; k < ax->taps; k++)                                               \
+            sum += w[k] * s[k];                                                          \
+                                                                                         \
+        if (antiring > 0 && ax->taps > 1) {                                              \
+            const int c = ax->center[x];                                                 \
+            sum = vspl_antiring(sum, (float) s[c], (float) s[c + 1], antiring);          \
+        }                                                                                \
+                                                                                         \
+        out[x] = sum * scale;                                                            \
+    }                                                                                    \
+}
+
+VSPL_RESAMPLE_ROW(vspl_resample_row_u8, uint8_t)
+VSPL_RESAMPLE_ROW(vspl_resample_row_u16, uint16_t)
+VSPL_RESAMPLE_ROW(vspl_resample_row_f32, float)
+
+// Vertical pass of one row: out = sum of weights[k] * rows[k]
+static void vspl_resample_col_c(const float *weights, const float *const *rows, int taps, int w, float *out)
+{
+    for (int x = 0; x < w; x++) {
+        float sum = 0;
+        for (int k = 0; k < taps; k++)
+            sum += weights[k] * rows[k][x];
+        out[x] = sum;
+    }
+}
+
+#if VSPL_HAVE_AVX2
+
+__attribute__((target("avx2")))
+static void vspl_resample_col_avx2(const float *weights, const float *const *rows, int taps, int w, float *out)
+{
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        for (int k = 0; k < taps; k++)
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + x)));
+        _mm256_storeu_ps(out + x, sum);
+    }
+
+    for (; x < w; x++) {
+        float sum = 0;
+        for (int k = 0; k < taps; k++)
+            sum += weights[k] * rows[k][x];
+        out[x] = sum;
+    }
+}
+
+#endif // VSPL_HAVE_AVX2
+
+#if VSPL_HAVE_NEON
+
+static void vspl_resample_col_neon(const float *weights, const float *const *rows, int taps, int w, float *out)
+{
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        for (int k = 0; k < taps; k++)
+            sum = vmlaq_n_f32(sum, vld1q_f32(rows[k] + x), weights[k]);
+        vst1q_f32(out + x, sum);
+    }
+
+    for (; x < w; x++) {
+        float sum = 0;
+        for (int k = 0; k < taps; k++)
+            sum += weights[k] * rows[k][x];
+        out[x] = sum;
+    }
+}
+
+#endif // VSPL_HAVE_NEON
+
+static void vspl_resample_store_row(const VSVideoFormat *fmt, const float *in, uint8_t *dst, int w)
+{
+    if (fmt->sampleType == stFloat) {
+        memcpy(dst, in, w * sizeof(float));
+        return;
+    }
+
+    const float max = (float) ((1 << fmt->bitsPerSample) - 1);
+    for (int x = 0; x < w; x++) {
+        float v = floorf(in[x] * max + 0.5f);
+        v = v < 0 ? 0 : v > max ? max : v;
+
+        if (fmt->bytesPerSample == 1) {
+            dst[x] = (uint8_t) v;
+        } else {
+            ((uint16_t *) dst)[x] = (uint16_t) v;
+        }
+    }
+}
+
+bool vspl_resample_cpu_plane(const struct vspl_resample_cpu *rs, enum vspl_cpu_isa isa, const VSVideoFormat *fmt,
+                             const uint8_t *src, ptrdiff_t src_stride, uint8_t *dst, ptrdiff_t dst_stride)
+{
+    const struct vspl_resample_axis *ax = &rs->x, *ay = &rs->y;
+    const int w = ax->size;
+
+    // Only the rows some output row reads from
+    const int row_lo = ay->offset[0];
+    const int row_hi = ay->offset[ay->size - 1] + ay->taps;
+
+    float *tmp = malloc((size_t) (row_hi - row_lo) * w * sizeof(float));
+    float *out = malloc((size_t) w * sizeof(float));
+    const float **rows = malloc(ay->taps * sizeof(float *));
+    if (!tmp || !out || !rows) {
+        free(tmp);
+        free(out);
+        free(rows);
+        return false;
+    }
+
+    const float scale = fmt->sampleType == stFloat ? 1.0f : 1.0f / ((1 << fmt->bitsPerSample) - 1);
+
+    for (int y = row_lo; y < row_hi; y++) {
+        const uint8_t *row = src + y * src_stride;
+        float *t = tmp + (size_t) (y - row_lo) * w;
+
+        if (fmt->sampleType == stFloat) {
+            vspl_resample_row_f32(ax, (const float *) row, scale, rs->antiring, t);
+        } else if (fmt->bytesPerSample == 1) {
+            vspl_resample_row_u8(ax, row, scale, rs->antiring, t);
+        } else {
+            vspl_resample_row_u16(ax, (const uint16_t *) row, scale, rs->antiring, t);
+        }
+    }
+
+    for (int y = 0; y < ay->size; y++) {
+        const float *weights = &ay->weights[(size_t) y * ay->taps];
+        for (int k = 0; k < ay->taps; k++)
+            rows[k] = tmp + (size_t) (ay->offset[y] - row_lo + k) * w;
+
+        switch (isa) {
+#if VSPL_HAVE_AVX2
+        case VSPL_CPU_AVX2: vspl_resample_col_avx2(weights, rows, ay->taps, w, out); break;
+#endif
+#if VSPL_HAVE_NEON
+        case VSPL_CPU_NEON: vspl_resample_col_neon(weights, rows, ay->taps, w, out); break;
+#endif
+        default: vspl_resample_col_c(weights, rows, ay->taps, w, out); break;
+        }
+
+        if (rs->antiring > 0 && ay->taps > 1) {
+            const int c = ay->center[y];
+            for (int x = 0; x < w; x++)
+                out[x] = vspl_antiring(out[x], rows[c][x], rows[c + 1][x], rs->antiring);
+        }
+
+        vspl_resample_store_row(fmt, out, dst + y * dst_stride, w);
+    }
+
+    free(rows);
+    free(out);
+    free(tmp);
+    return true;
+}
+
+#else // PL_API_VER >= 303
+
+struct vspl_resample_cpu *vspl_resample_cpu_create(const struct pl_sample_filter_params *params,
+                                                   int src_w, int src_h, int dst_w, int dst_h,
+                                                   float sx, float sy, float src_width, float src_height)
+{
+    return NULL;
+}
+
+void vspl_resample_cpu_destroy(struct vspl_resample_cpu **rs)
+{
+}
+
+bool vspl_resample_cpu_plane(const struct vspl_resample_cpu *rs, enum vspl_cpu_isa isa, const VSVideoFormat *fmt,
+                             const uint8_t *src, ptrdiff_t src_stride, uint8_t *dst, ptrdiff_t dst_stride)
+{
+    return false;
+}
+
+#endif // PL_API_VER >= 303
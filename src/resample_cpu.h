@@ -0,0 +1,39 @@
+#ifndef VS_PLACEBO_RESAMPLE_CPU_H
+#define VS_PLACEBO_RESAMPLE_CPU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <VapourSynth4.h>
+
+#include <libplacebo/shaders/sampling.h>
+
+#include "cpu.h"
+
+// Separable resampling on the CPU, with the weights of the same filter
+// config the GPU uses, for frames too small to be worth a GPU round trip.
+// The weights of every output row and column are computed once, so each
+// frame is just two passes of multiply-adds. Edges are clamped like texture
+// sampling, and antiringing uses the two taps closest to each output sample.
+struct vspl_resample_cpu;
+
+// Largest frame, input or output, that `backend="auto"` resamples on the CPU
+#define VSPL_RESAMPLE_CPU_AUTO_PIXELS (960 * 540)
+
+// Whether the filter can run on the CPU, which only does orthogonal filters
+bool vspl_resample_cpu_supported(const struct pl_sample_filter_params *params);
+
+// Weights for resampling the region (`sx`, `sy`, `src_width`, `src_height`)
+// of a `src_w`x`src_h` plane to `dst_w`x`dst_h`
+struct vspl_resample_cpu *vspl_resample_cpu_create(const struct pl_sample_filter_params *params,
+                                                   int src_w, int src_h, int dst_w, int dst_h,
+                                                   float sx, float sy, float src_width, float src_height);
+void vspl_resample_cpu_destroy(struct vspl_resample_cpu **rs);
+
+// Resamples one plane of an 8 or 16 bit integer, or 32 bit float, format.
+// Returns false if out of memory.
+bool vspl_resample_cpu_plane(const struct vspl_resample_cpu *rs, enum vspl_cpu_isa isa, const VSVideoFormat *fmt,
+                             const uint8_t *src, ptrdiff_t src_stride, uint8_t *dst, ptrdiff_t dst_stride);
+
+#endif //VS_PLACEBO_RESAMPLE_CPU_H
@@ -0,0 +1,174 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "counters.h"
+#include "resident.h"
+
+struct vspl_resident {
+    struct vspl_resident *next;
+    struct vspl_context *ctx;
+
+    // Held by consumers while they use the textures
+    pthread_mutex_t lock;
+
+    pl_tex tex[MAX_PLANES];
+
+    // Unique per export, and stored in the props next to the function
+    uint64_t gen;
+
+    // Where the frame that owns the textures keeps its planes. Frames that
+    // merely copied the props won't match these.
+    const uint8_t *ptr[MAX_PLANES];
+
+    // Shares the planes of that frame, so they stay allocated, and a filter
+    // writing to them gets a copy at another address
+    const VSFrame *frame;
+    const VSAPI *vsapi;
+};
+
+static atomic_uint_fast64_t vspl_resident_gen;
+
+static void VS_CC vspl_resident_get(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi)
+{
+    vsapi->mapSetData(out, "entry", (const char *) &userData, sizeof(userData), dtBinary, maReplace);
+}
+
+static void VS_CC vspl_resident_free(void *userData)
+{
+    struct vspl_resident *entry = userData;
+    struct vspl_context *ctx = entry->ctx;
+
+    vspl_lock(&ctx->resident_lock);
+    struct vspl_resident **link = &ctx->resident;
+    while (*link != entry)
+        link = &(*link)->next;
+    *link = entry->next;
+    pthread_mutex_unlock(&ctx->resident_lock);
+
+    for (int i = 0; i < MAX_PLANES; i++)
+        vspl_tex_pool_put(ctx->pool, &entry->tex[i]);
+
+    entry->vsapi->freeFrame(entry->frame);
+    pthread_mutex_destroy(&entry->lock);
+    free(entry);
+
+    vspl_context_release(ctx);
+}
+
+bool vspl_resident_ref(struct priv *p, const VSFrame *frame, struct vspl_resident_ref *ref, const VSAPI *vsapi)
+{
+    *ref = (struct vspl_resident_ref) {0};
+
+    int err;
+    const VSMap *props = vsapi->getFramePropertiesRO(frame);
+    VSFunction *func = vsapi->mapGetFunction(props, VSPL_RESIDENT_PROP, 0, &err);
+    if (err || !func)
+        return false;
+
+    struct vspl_resident *entry = NULL;
+
+    VSMap *in = vsapi->createMap();
+    VSMap *out = vsapi->createMap();
+    vsapi->callFunction(func, in, out);
+
+    const char *data = vsapi->mapGetData(out, "entry", 0, &err);
+    if (!err && vsapi->mapGetDataSize(out, "entry", 0, &err) == sizeof(entry))
+        memcpy(&entry, data, sizeof(entry));
+
+    vsapi->freeMap(out);
+    vsapi->freeMap(in);
+
+    // Only trust entries of our own context, which also rules out textures
+    // from another device
+    bool found = false;
+    vspl_lock(&p->ctx->resident_lock);
+    for (struct vspl_resident *e = p->ctx->resident; e && !found; e = e->next)
+        found = e == entry;
+    pthread_mutex_unlock(&p->ctx->resident_lock);
+
+    int64_t gen = vsapi->mapGetInt(props, VSPL_RESIDENT_GEN_PROP, 0, &err);
+    if (found && (err || (uint64_t) gen != entry->gen))
+        found = false;
+
+    const VSVideoFormat *fmt = vsapi->getVideoFrameFormat(frame);
+    for (int i = 0; found && i < fmt->numPlanes; i++) {
+        if (entry->tex[i] && entry->ptr[i] != vsapi->getReadPtr(frame, i))
+            found = false;
+    }
+
+    if (!found) {
+        vsapi->freeFunction(func);
+        return false;
+    }
+
+    // The function reference keeps the entry alive until unref
+    vspl_lock(&entry->lock);
+    ref->func = func;
+    ref->entry = entry;
+    return true;
+}
+
+void vspl_resident_unref(struct vspl_resident_ref *ref, const VSAPI *vsapi)
+{
+    if (!ref->entry)
+        return;
+
+    pthread_mutex_unlock(&ref->entry->lock);
+    vsapi->freeFunction(ref->func);
+    *ref = (struct vspl_resident_ref) {0};
+}
+
+pl_tex vspl_resident_tex(const struct vspl_resident_ref *ref, int plane)
+{
+    return ref->entry ? ref->entry->tex[plane] : NULL;
+}
+
+void vspl_resident_export(struct priv *p, VSFrame *dst, pl_tex *tex[MAX_PLANES], VSCore *core, const VSAPI *vsapi)
+{
+    VSMap *props = vsapi->getFramePropertiesRW(dst);
+    vsapi->mapDeleteKey(props, VSPL_RESIDENT_PROP);
+    vsapi->mapDeleteKey(props, VSPL_RESIDENT_GEN_PROP);
+
+    if (!p->resident)
+        return;
+
+    const VSVideoFormat *fmt = vsapi->getVideoFrameFormat(dst);
+    bool any = false;
+    for (int i = 0; i < fmt->numPlanes; i++)
+        any |= tex[i] && *tex[i];
+    if (!any)
+        return;
+
+    struct vspl_resident *entry = calloc(1, sizeof(struct vspl_resident));
+    if (!entry)
+        return;
+
+    pthread_mutex_init(&entry->lock, NULL);
+    entry->ctx = p->ctx;
+    vspl_context_ref(entry->ctx);
+
+    // Copied before the function is attached, so it doesn't reference itself
+    entry->gen = atomic_fetch_add(&vspl_resident_gen, 1) + 1;
+    entry->frame = vsapi->copyFrame(dst, core);
+    entry->vsapi = vsapi;
+
+    for (int i = 0; i < fmt->numPlanes; i++) {
+        if (!tex[i] || !*tex[i])
+            continue;
+
+        // The slot picks up a fresh texture from the pool for its next frame
+        entry->tex[i] = *tex[i];
+        entry->ptr[i] = vsapi->getReadPtr(entry->frame, i);
+        *tex[i] = NULL;
+    }
+
+    vspl_lock(&entry->ctx->resident_lock);
+    entry->next = entry->ctx->resident;
+    entry->ctx->resident = entry;
+    pthread_mutex_unlock(&entry->ctx->resident_lock);
+
+    VSFunction *func = vsapi->createFunction(vspl_resident_get, entry, vspl_resident_free, core);
+    vsapi->mapConsumeFunction(props, VSPL_RESIDENT_PROP, func, maReplace);
+    vsapi->mapSetInt(props, VSPL_RESIDENT_GEN_PROP, (int64_t) entry->gen, maReplace);
+}
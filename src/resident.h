@@ -0,0 +1,49 @@
+#ifndef VS_PLACEBO_RESIDENT_H
+#define VS_PLACEBO_RESIDENT_H
+
+#include <stdbool.h>
+
+#include <VapourSynth4.h>
+
+#include "vs-placebo.h"
+
+// Frames output with `resident` enabled keep their output textures alive on
+// the GPU, referenced from the frame props. A later placebo filter on the same
+// context samples those textures instead of uploading the planes again.
+//
+// The frame still gets downloaded as usual, since VapourSynth frames must
+// hold their pixels by the time they are returned.
+//
+// The textures are only used for a frame whose planes are the very buffers
+// they were downloaded to, and which carries the generation of the export
+// next to the function. The entry keeps those buffers referenced, so they
+// can neither be written in place (VapourSynth copies shared planes on
+// write) nor freed and handed to a new frame that inherited the props.
+#define VSPL_RESIDENT_PROP "PlaceboResident"
+#define VSPL_RESIDENT_GEN_PROP "PlaceboResidentGen"
+
+struct vspl_resident;
+
+struct vspl_resident_ref {
+    VSFunction *func;
+    struct vspl_resident *entry;
+};
+
+// Looks for textures attached to `frame` by a filter on the same context.
+// Returns false if there are none (or they can't be used), in which case the
+// planes have to be uploaded. Otherwise the textures stay valid and usable by
+// this thread until vspl_resident_unref.
+bool vspl_resident_ref(struct priv *p, const VSFrame *frame, struct vspl_resident_ref *ref, const VSAPI *vsapi);
+void vspl_resident_unref(struct vspl_resident_ref *ref, const VSAPI *vsapi);
+
+// The texture holding plane `plane` of the referenced frame, or NULL if that
+// plane has to be uploaded
+pl_tex vspl_resident_tex(const struct vspl_resident_ref *ref, int plane);
+
+// Called on every output frame once its planes are downloaded. Drops the
+// textures inherited through the props of the source frame, and if `resident`
+// is enabled, moves the textures in `tex` (indexed by plane, entries may be
+// NULL) out of the slot and attaches them to `dst`.
+void vspl_resident_export(struct priv *p, VSFrame *dst, pl_tex *tex[MAX_PLANES], VSCore *core, const VSAPI *vsapi);
+
+#endif //VS_PLACEBO_RESIDENT_H
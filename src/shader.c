@@ -6,12 +6,13 @@
 
 #include <VapourSynth4.h>
 
-#include "p2p_api.h"
 #include <libplacebo/shaders/custom.h>
 #include <libplacebo/colorspace.h>
 
 #include "vs-placebo.h"
+#include "resident.h"
 #include "shader.h"
+#include "resample.h"
 
 typedef  struct {
     VSNode *node;
@@ -20,30 +21,33 @@ typedef  struct {
     const VSVideoInfo *vi;
     VSVideoInfo vi_out;
     struct priv *vf;
-    const struct pl_hook *shader;
+    char *shader;
+    size_t shader_len;
     enum pl_color_system matrix;
     enum pl_color_levels range;
     enum pl_chroma_location chromaLocation;
+    enum pl_chroma_location dst_chroma_loc;
     struct pl_sample_filter_params *sampleParams;
     struct pl_sigmoid_params *sigmoid_params;
     enum pl_color_transfer trc;
     bool linear;
+
+    // Tells the instance apart in traces
+    int trace_id;
 } ShaderData;
 
 
-bool vspl_shader_do_plane(struct priv *p, void *data, int n, struct pl_plane *planes)
+bool vspl_shader_do_plane(struct vspl_slot *s, void *data, int n, struct pl_plane *planes, enum pl_color_levels range)
 {
     ShaderData *d = (ShaderData*) data;
 
     const struct pl_color_repr crpr = {
-        .bits = {
-            .sample_depth = 16,
-            .color_depth = 16,
-            .bit_shift = 0
-        },
+        .bits = vspl_bit_encoding(&d->vi->format),
         .sys = d->matrix,
-        .levels = d->range
+        .levels = range
     };
+    struct pl_color_repr dst_repr = crpr;
+    dst_repr.bits = vspl_bit_encoding(&d->vi_out.format);
     const struct pl_color_space csp = {
         .transfer = d->trc
     };
@@ -60,18 +64,25 @@ bool vspl_shader_do_plane(struct priv *p, void *data, int n, struct pl_plane *pl
     }
 
     struct pl_frame out = {
-        .num_planes = 1,
-        .planes = {{
-            .texture = p->tex_out[0],
-            .components = p->tex_out[0]->params.format->num_components,
-            .component_mapping = {0, 1, 2, 3},
-        }},
-        .repr = crpr,
+        .num_planes = 3,
+        .repr = dst_repr,
         .color = csp,
     };
 
+    for (int i = 0; i < 3; i++) {
+        out.planes[i] = (struct pl_plane) {
+            .texture = s->tex_out[i],
+            .components = 1,
+            .component_mapping = {i},
+        };
+    }
+
+    if (d->vi_out.format.subSamplingW || d->vi_out.format.subSamplingH) {
+        pl_frame_set_chroma_location(&out, d->dst_chroma_loc);
+    }
+
     struct pl_render_params renderParams = {
-        .hooks = &d->shader,
+        .hooks = &s->hook,
         .num_hooks = 1,
         .sigmoid_params = d->sigmoid_params,
         .disable_linear_scaling = !d->linear,
@@ -79,11 +90,13 @@ bool vspl_shader_do_plane(struct priv *p, void *data, int n, struct pl_plane *pl
         .downscaler = &d->sampleParams->filter,
         .antiringing_strength = d->sampleParams->antiring,
     };
+    vspl_slot_render_params(d->vf, s, &renderParams);
 
-    return pl_render_image(p->rr, &img, &out, &renderParams);
+    return pl_render_image(s->rr, &img, &out, &renderParams);
 }
 
-bool vspl_shader_reconfig(void *priv, struct pl_plane_data *data, VSCore *core, const VSAPI *vsapi, ShaderData *d)
+bool vspl_shader_reconfig(void *priv, struct vspl_slot *s, struct pl_plane_data *data, const struct vspl_resident_ref *res,
+                          VSCore *core, const VSAPI *vsapi, ShaderData *d)
 {
     struct priv *p = priv;
 
@@ -98,32 +111,36 @@ bool vspl_shader_reconfig(void *priv, struct pl_plane_data *data, VSCore *core,
 
     bool ok = true;
     for (int i = 0; i < 3; ++i) {
-        ok &= pl_tex_recreate(p->gpu, &p->tex_in[i], pl_tex_params(
+        if (vspl_resident_tex(res, i))
+            continue;
+
+        ok &= vspl_tex_pool_recreate(p->pool, &s->tex_in[i], pl_tex_params(
             .w = data[i].width,
             .h = data[i].height,
             .format = fmt[i],
             .sampleable = true,
             .host_writable = true,
+            .blit_src = fmt[i]->caps & PL_FMT_CAP_BLITTABLE,
         ));
     }
 
-    const struct pl_plane_data plane_data = {
-        .type = PL_FMT_UNORM,
-        .component_map = {0, 1, 2, 0},
-        .component_pad = {0, 0, 0, 0},
-        .component_size = {16, 16, 16, 0},
-        .pixel_stride = 6
-    };
-
-    pl_fmt out = pl_plane_find_fmt(p->gpu, NULL, &plane_data);
+    const VSVideoFormat *dst_fmt = &d->vi_out.format;
+    pl_fmt out = vspl_find_plane_fmt(p->gpu, dst_fmt, PL_FMT_CAP_RENDERABLE | PL_FMT_CAP_HOST_READABLE);
+    if (!out) {
+        vsapi->logMessage(mtCritical, "Failed configuring filter: no good output texture format!\n", core);
+        return false;
+    }
 
-    ok &= pl_tex_recreate(p->gpu, &p->tex_out[0], pl_tex_params(
-        .w = d->width,
-        .h = d->height,
-        .format = out,
-        .renderable = true,
-        .host_readable = true,
-    ));
+    for (int i = 0; i < 3; ++i) {
+        ok &= vspl_tex_pool_recreate(p->pool, &s->tex_out[i], pl_tex_params(
+            .w = i ? d->width >> dst_fmt->subSamplingW : d->width,
+            .h = i ? d->height >> dst_fmt->subSamplingH : d->height,
+            .format = out,
+            .renderable = true,
+            .host_readable = true,
+            .sampleable = p->resident,
+        ));
+    }
 
     if (!ok) {
         vsapi->logMessage(mtCritical, "Failed creating GPU textures!\n", core);
@@ -133,15 +150,25 @@ bool vspl_shader_reconfig(void *priv, struct pl_plane_data *data, VSCore *core,
     return true;
 }
 
-bool vspl_shader_filter(void *priv, void *dst, struct pl_plane_data *src,  ShaderData *d, int n, VSCore *core, const VSAPI *vsapi)
+bool vspl_shader_filter(void *priv, struct vspl_slot *s, VSFrame *dst, struct pl_plane_data *src,  ShaderData *d, int n, enum pl_color_levels range,
+                        const struct vspl_resident_ref *res, VSCore *core, const VSAPI *vsapi)
 {
     struct priv *p = priv;
-    // Upload planes
+    // Upload planes, unless they are still on the GPU
     struct pl_plane planes[4] = {0};
     bool ok = true;
 
     for (int i = 0; i < 3; ++i) {
-        ok &= pl_upload_plane(p->gpu, &planes[i], &p->tex_in[i], &src[i]);
+        pl_tex tex = vspl_resident_tex(res, i);
+        if (tex) {
+            planes[i] = (struct pl_plane) {
+                .texture = tex,
+                .components = 1,
+                .component_mapping = {i},
+            };
+        } else {
+            ok &= vspl_upload_plane(p->gpu, &s->xfer, &planes[i], &s->tex_in[i], &src[i]);
+        }
     }
 
     if (!ok) {
@@ -150,16 +177,23 @@ bool vspl_shader_filter(void *priv, void *dst, struct pl_plane_data *src,  Shade
     }
 
     // Process plane
-    if (!vspl_shader_do_plane(p, d, n, planes)) {
+    const int64_t trace = vspl_trace_begin();
+    ok = vspl_shader_do_plane(s, d, n, planes, range);
+    vspl_trace_end(VSPL_TRACE_RENDER, trace);
+    if (!ok) {
         vsapi->logMessage(mtCritical, "Failed processing planes!\n", core);
         return false;
     }
 
     // Download planes
-    ok = pl_tex_download(p->gpu, pl_tex_transfer_params(
-        .tex = p->tex_out[0],
-        .ptr = dst,
-    ));
+    for (int i = 0; i < 3; ++i) {
+        ok &= vspl_download_async(p->gpu, &s->xfer, pl_tex_transfer_params(
+            .tex = s->tex_out[i],
+            .row_pitch = vsapi->getStride(dst, i),
+            .ptr = vsapi->getWritePtr(dst, i),
+        ));
+    }
+    vspl_download_wait(p->gpu, &s->xfer);
 
     if (!ok) {
         vsapi->logMessage(mtCritical, "Failed downloading data from the GPU!\n", core);
@@ -175,23 +209,27 @@ static const VSFrame *VS_CC VSPlaceboShaderGetFrame(int n, int activationReason,
     if (activationReason == arInitial) {
         vsapi->requestFrameFilter(n, d->node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
+        vspl_counter_add(VSPL_COUNTER_SHADER_FRAMES, 1);
+        vspl_trace_frame("Shader", d->trace_id, n);
+
         const VSFrame *frame = vsapi->getFrameFilter(n, d->node, frameCtx);
 
-        if (d->range == PL_COLOR_LEVELS_UNKNOWN) {
+        // Resolved per frame rather than cached in the instance data, since
+        // several frames may be in flight at once
+        enum pl_color_levels range = d->range;
+        if (range == PL_COLOR_LEVELS_UNKNOWN) {
             const VSMap *props = vsapi->getFramePropertiesRO(frame);
 
             int err = 0;
             int r = vsapi->mapGetInt(props, "_ColorRange", 0, &err);
-            if (err)
-                d->range = PL_COLOR_LEVELS_UNKNOWN;
-            else
-                d->range = r ? PL_COLOR_LEVELS_TV : PL_COLOR_LEVELS_PC;
+            if (!err)
+                range = r ? PL_COLOR_LEVELS_TV : PL_COLOR_LEVELS_PC;
         }
 
-        VSVideoFormat dstfmt = d->vi_out.format;
-        vsapi->queryVideoFormat(&dstfmt, dstfmt.colorFamily, dstfmt.sampleType, dstfmt.bitsPerSample, 0, 0, core);
+        VSFrame *dst = vsapi->newVideoFrame(&d->vi_out.format, d->width, d->height, frame, core);
 
-        VSFrame *dst = vsapi->newVideoFrame(&dstfmt, d->width, d->height, frame, core);
+        if ((d->vi_out.format.subSamplingW || d->vi_out.format.subSamplingH) && d->dst_chroma_loc != PL_CHROMA_UNKNOWN)
+            vsapi->mapSetInt(vsapi->getFramePropertiesRW(dst), "_ChromaLocation", d->dst_chroma_loc - 1, maReplace);
 
         struct pl_plane_data planes[4] = {0};
         for (int j = 0; j < 3; ++j) {
@@ -209,31 +247,29 @@ static const VSFrame *VS_CC VSPlaceboShaderGetFrame(int n, int activationReason,
             planes[j].component_map[0] = j;
         }
 
-        void *packed_dst = malloc(d->width * d->height * 2 * 3);
-
-        pthread_mutex_lock(&vspl_vulkan_mutex);
+        struct vspl_slot *s = vspl_slot_acquire(d->vf);
 
-        if (vspl_shader_reconfig(d->vf, planes, core, vsapi, d)) {
-            vspl_shader_filter(d->vf, packed_dst, planes, d, n, core, vsapi);
-        }
-
-        pthread_mutex_unlock(&vspl_vulkan_mutex);
+        struct vspl_resident_ref res;
+        vspl_resident_ref(d->vf, frame, &res, vsapi);
 
-        struct p2p_buffer_param pack_params = {
-            .width = d->width,
-            .height = d->height,
-            .packing = p2p_bgr48_le,
-            .src[0] = packed_dst,
-            .src_stride[0] = d->width * 2 * 3
-        };
+        if (!s->hook)
+            s->hook = pl_mpv_user_shader_parse(d->vf->gpu, d->shader, d->shader_len);
 
-        for (int k = 0; k < 3; ++k) {
-            pack_params.dst[k] = vsapi->getWritePtr(dst, k);
-            pack_params.dst_stride[k] = vsapi->getStride(dst, k);
+        if (!s->hook) {
+            vsapi->logMessage(mtCritical, "Failed parsing shader!\n", core);
+        } else {
+            const int64_t trace = vspl_trace_begin();
+            bool ok = vspl_shader_reconfig(d->vf, s, planes, &res, core, vsapi, d);
+            vspl_trace_end(VSPL_TRACE_RECONFIG, trace);
+            if (ok)
+                vspl_shader_filter(d->vf, s, dst, planes, d, n, range, &res, core, vsapi);
         }
 
-        p2p_unpack_frame(&pack_params, 0);
-        free(packed_dst);
+        vspl_resident_unref(&res, vsapi);
+        vspl_resident_export(d->vf, dst, (pl_tex *[MAX_PLANES]) {&s->tex_out[0], &s->tex_out[1], &s->tex_out[2]},
+                             core, vsapi);
+        vspl_slot_profile(d->vf, s, dst, vsapi);
+        vspl_slot_release(d->vf, s);
 
         vsapi->freeFrame(frame);
         return dst;
@@ -245,55 +281,67 @@ static const VSFrame *VS_CC VSPlaceboShaderGetFrame(int n, int activationReason,
 static void VS_CC VSPlaceboShaderFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     ShaderData *d = (ShaderData *)instanceData;
     vsapi->freeNode(d->node);
-    pl_mpv_user_shader_destroy(&d->shader);
-    free((void *) d->sampleParams->filter.kernel);
-    free(d->sampleParams);
+    free(d->shader);
+    vspl_sample_filter_params_free(d->sampleParams);
     free(d->sigmoid_params);
     VSPlaceboUninit(d->vf);
     free(d);
 }
 
-void VS_CC VSPlaceboShaderCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
-    ShaderData d;
-    ShaderData *data;
+bool vspl_shader_text_read(const VSMap *in, char **shader, const VSAPI *vsapi)
+{
     int err;
-    enum pl_log_level log_level;
-
-    log_level = vsapi->mapGetInt(in, "log_level", 0, &err);
-    if (err)
-        log_level = PL_LOG_ERR;
-
     const char *sh = vsapi->mapGetData(in, "shader", 0, &err);
-    char *shader;
     size_t fsize;
 
+    *shader = NULL;
+
     if (!err) {
         FILE *fl = fopen(sh, "rb");
         if (fl == NULL) {
             perror("Failed: ");
-            vsapi->mapSetError(out, "placebo.Shader: Failed reading shader file!");
-            return;
+            return false;
         }
 
         fseek(fl, 0, SEEK_END);
         fsize = (size_t) ftell(fl);
         rewind(fl);
 
-        shader = malloc(fsize + 1);
-        fread(shader, 1, fsize, fl);
+        *shader = malloc(fsize + 1);
+        fread(*shader, 1, fsize, fl);
         fclose(fl);
 
-        shader[fsize] = '\0';
+        (*shader)[fsize] = '\0';
     } else {
         const char *shader_s = vsapi->mapGetData(in, "shader_s", 0, &err);
 
-        if (err) {
-            vsapi->mapSetError(out, "placebo.Shader: Either shader or shader_s must be specified!");
-            return;
+        if (!err) {
+            fsize = strlen(shader_s);
+            *shader = malloc(fsize + 1);
+            strcpy(*shader, shader_s);
         }
-        fsize =  strlen(shader_s);
-        shader = malloc(fsize + 1);
-        strcpy(shader, shader_s);
+    }
+
+    return true;
+}
+
+void VS_CC VSPlaceboShaderCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    ShaderData d;
+    ShaderData *data;
+    int err;
+    struct vspl_init_params init_params;
+    vspl_init_params_read(&init_params, in, core, vsapi);
+    d.trace_id = vspl_trace_id();
+
+    char *shader;
+    if (!vspl_shader_text_read(in, &shader, vsapi)) {
+        vsapi->mapSetError(out, "placebo.Shader: Failed reading shader file!");
+        return;
+    }
+
+    if (!shader) {
+        vsapi->mapSetError(out, "placebo.Shader: Either shader or shader_s must be specified!");
+        return;
     }
 
     d.node = vsapi->mapGetNode(in, "clip", 0, 0);
@@ -302,19 +350,31 @@ void VS_CC VSPlaceboShaderCreate(const VSMap *in, VSMap *out, void *userData, VS
     d.vi_out = *d.vi;
     vsapi->getVideoFormatByID(&d.vi_out.format, pfYUV444P16, core);
 
-    d.vf = VSPlaceboInit(log_level);
-    d.shader = pl_mpv_user_shader_parse(d.vf->gpu, shader, strlen(shader));
-    free(shader);
+    d.vf = VSPlaceboInit(&init_params);
+    if (!d.vf) {
+        free(shader);
+        vsapi->mapSetError(out, "placebo.Shader: Failed initializing libplacebo!");
+        vsapi->freeNode(d.node);
+        return;
+    }
 
-    if (!d.shader) {
+    // Parse it once up front to catch errors early; the other slots parse
+    // their own copy when they first get used.
+    d.shader = shader;
+    d.shader_len = strlen(shader);
+    d.vf->slots[0].hook = pl_mpv_user_shader_parse(d.vf->gpu, d.shader, d.shader_len);
+
+    if (!d.vf->slots[0].hook) {
+        free(shader);
         VSPlaceboUninit(d.vf);
-        pl_mpv_user_shader_destroy(&d.shader);
         vsapi->mapSetError(out, "placebo.Shader: Failed parsing shader!");
         vsapi->freeNode(d.node);
         return;
     }
 
     if (d.vi->format.colorFamily != cfYUV || d.vi->format.bitsPerSample != 16) {
+        free(shader);
+        VSPlaceboUninit(d.vf);
         vsapi->mapSetError(out, "placebo.Shader: Input should be YUVxxxP16!");
         vsapi->freeNode(d.node);
         return;
@@ -340,6 +400,45 @@ void VS_CC VSPlaceboShaderCreate(const VSMap *in, VSMap *out, void *userData, VS
     if (err)
         d.chromaLocation = PL_CHROMA_LEFT;
 
+    // In _ChromaLocation values, like Tonemap's and Render's
+    int dst_chroma_loc = vsapi->mapGetIntSaturated(in, "dst_chroma_loc", 0, &err);
+    if (err)
+        dst_chroma_loc = -1;
+
+    if (dst_chroma_loc < -1 || dst_chroma_loc > 5) {
+        free(shader);
+        VSPlaceboUninit(d.vf);
+        vsapi->mapSetError(out, "placebo.Shader: dst_chroma_loc must be between 0 and 5!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
+    d.dst_chroma_loc = dst_chroma_loc >= 0 ? dst_chroma_loc + 1 : d.chromaLocation;
+
+    int64_t format_id = vsapi->mapGetInt(in, "format", 0, &err);
+    if (!err) {
+        VSVideoFormat dst_fmt;
+        if (!vsapi->getVideoFormatByID(&dst_fmt, format_id, core) ||
+            dst_fmt.colorFamily != cfYUV || dst_fmt.sampleType != stInteger ||
+            !vspl_format_supported(&dst_fmt)) {
+            free(shader);
+            VSPlaceboUninit(d.vf);
+            vsapi->mapSetError(out, "placebo.Shader: Output format must be 8-16 bit integer YUV!");
+            vsapi->freeNode(d.node);
+            return;
+        }
+
+        d.vi_out.format = dst_fmt;
+    }
+
+    if ((d.width % (1 << d.vi_out.format.subSamplingW)) || (d.height % (1 << d.vi_out.format.subSamplingH))) {
+        free(shader);
+        VSPlaceboUninit(d.vf);
+        vsapi->mapSetError(out, "placebo.Shader: Output dimensions must be divisible by the output subsampling!");
+        vsapi->freeNode(d.node);
+        return;
+    }
+
     d.linear = vsapi->mapGetInt(in, "linearize", 0, &err);
     if (err) d.linear = 1;
     d.trc = vsapi->mapGetInt(in, "trc", 0, &err);
@@ -360,64 +459,7 @@ void VS_CC VSPlaceboShaderCreate(const VSMap *in, VSMap *out, void *userData, VS
         sigm = true;
     d.sigmoid_params = sigm ? sigmoidParams : NULL;
 
-
-    struct pl_sample_filter_params *sampleFilterParams = calloc(1, sizeof(struct pl_sample_filter_params));
-
-    sampleFilterParams->antiring = vsapi->mapGetFloat(in, "antiring", 0, &err);
-
-    const char *filter = vsapi->mapGetData(in, "filter", 0, &err);
-
-    if (!filter) filter = "ewa_lanczos";
-#define FILTER_ELIF(name) else if (strcmp(filter, #name) == 0) sampleFilterParams->filter = pl_filter_##name;
-    if (strcmp(filter, "spline16") == 0)
-        sampleFilterParams->filter = pl_filter_spline16;
-    FILTER_ELIF(spline36)
-    FILTER_ELIF(spline64)
-    FILTER_ELIF(box)
-    FILTER_ELIF(triangle)
-    FILTER_ELIF(gaussian)
-    FILTER_ELIF(sinc)
-    FILTER_ELIF(lanczos)
-    FILTER_ELIF(ginseng)
-    FILTER_ELIF(ewa_jinc)
-    FILTER_ELIF(ewa_ginseng)
-    FILTER_ELIF(ewa_hann)
-    FILTER_ELIF(bicubic)
-    FILTER_ELIF(catmull_rom)
-    FILTER_ELIF(mitchell)
-    FILTER_ELIF(robidoux)
-    FILTER_ELIF(robidouxsharp)
-    FILTER_ELIF(ewa_robidoux)
-    FILTER_ELIF(ewa_lanczos)
-    FILTER_ELIF(ewa_robidouxsharp)
-    else {
-        vsapi->logMessage(mtWarning, "Unkown filter... selecting ewa_lanczos.\n", core);
-        sampleFilterParams->filter = pl_filter_ewa_lanczos;
-    }
-
-    sampleFilterParams->filter.clamp = vsapi->mapGetFloat(in, "clamp", 0, &err);
-    sampleFilterParams->filter.blur = vsapi->mapGetFloat(in, "blur", 0, &err);
-    sampleFilterParams->filter.taper = vsapi->mapGetFloat(in, "taper", 0, &err);
-    struct pl_filter_function *f = calloc(1, sizeof(struct pl_filter_function));
-    *f = *sampleFilterParams->filter.kernel;
-
-    if (f->resizable) {
-        vsapi->mapGetFloat(in, "radius", 0, &err);
-        if (!err)
-            f->radius = vsapi->mapGetFloat(in, "radius", 0, &err);
-    }
-
-    vsapi->mapGetFloat(in, "param1", 0, &err);
-    if (!err && f->tunable[0])
-        f->params[0] = vsapi->mapGetFloat(in, "param1", 0, &err);
-
-    vsapi->mapGetFloat(in, "param2", 0, &err);
-    if (!err && f->tunable[1])
-        f->params[1] = vsapi->mapGetFloat(in, "param2", 0, &err);
-
-    sampleFilterParams->filter.kernel = f;
-
-    d.sampleParams = sampleFilterParams;
+    d.sampleParams = vspl_sample_filter_params_read(in, "ewa_lanczos", core, vsapi);
 
     data = malloc(sizeof(d));
     *data = d;
@@ -1,8 +1,15 @@
 #ifndef VS_PLACEBO_SHADER_H
 #define VS_PLACEBO_SHADER_H
 
+#include <stdbool.h>
+
 #include <VapourSynth4.h>
 
+// Load the user shader given as `shader` (a file path) or `shader_s` (its
+// source). `*shader` is a malloc'd string, or NULL if neither was given.
+// Returns false if the file couldn't be read.
+bool vspl_shader_text_read(const VSMap *in, char **shader, const VSAPI *vsapi);
+
 void VS_CC VSPlaceboShaderCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi);
 
 #endif //VS_PLACEBO_SHADER_H
@@ -0,0 +1,296 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <VapourSynth4.h>
+
+#include <libplacebo/colorspace.h>
+
+#include "stats.h"
+
+struct vspl_stats {
+    void *map;
+    size_t size;
+    bool writable;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+static size_t vspl_stats_size(int num_frames)
+{
+    return sizeof(struct vspl_stats_header) + (size_t) num_frames * sizeof(struct vspl_stats_frame);
+}
+
+static struct vspl_stats *vspl_stats_map(const char *path, size_t size, bool create)
+{
+    struct vspl_stats *stats = calloc(1, sizeof(*stats));
+    stats->size = size;
+    stats->writable = create;
+
+#ifdef _WIN32
+    stats->file = CreateFileA(path, create ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, NULL,
+                              create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (stats->file == INVALID_HANDLE_VALUE)
+        goto error;
+
+    if (create) {
+        LARGE_INTEGER file_size = {.QuadPart = (LONGLONG) size};
+        if (!SetFilePointerEx(stats->file, file_size, NULL, FILE_BEGIN) || !SetEndOfFile(stats->file))
+            goto error;
+    } else {
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(stats->file, &file_size) || file_size.QuadPart < (LONGLONG) sizeof(struct vspl_stats_header))
+            goto error;
+        stats->size = size = (size_t) file_size.QuadPart;
+    }
+
+    stats->mapping = CreateFileMappingA(stats->file, NULL, create ? PAGE_READWRITE : PAGE_READONLY,
+                                        (DWORD) ((uint64_t) size >> 32), (DWORD) size, NULL);
+    if (!stats->mapping)
+        goto error;
+
+    stats->map = MapViewOfFile(stats->mapping, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+    if (!stats->map)
+        goto error;
+#else
+    int fd = open(path, create ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0)
+        goto error;
+
+    if (create) {
+        if (ftruncate(fd, (off_t) size) < 0) {
+            close(fd);
+            goto error;
+        }
+    } else {
+        off_t file_size = lseek(fd, 0, SEEK_END);
+        if (file_size < (off_t) sizeof(struct vspl_stats_header)) {
+            close(fd);
+            goto error;
+        }
+        stats->size = size = (size_t) file_size;
+    }
+
+    stats->map = mmap(NULL, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps the file alive
+    close(fd);
+
+    if (stats->map == MAP_FAILED) {
+        stats->map = NULL;
+        goto error;
+    }
+#endif
+
+    return stats;
+
+error:
+    fprintf(stderr, "vs-placebo: Failed mapping stats file %s\n", path);
+    vspl_stats_close(&stats);
+    return NULL;
+}
+
+bool vspl_stats_fingerprint(struct vspl_stats_clip *clip, VSNode *node, char *err, int err_size,
+                            VSCore *core, const VSAPI *vsapi)
+{
+    const VSVideoInfo *vi = vsapi->getVideoInfo(node);
+    const VSVideoFormat *fmt = &vi->format;
+
+    *clip = (struct vspl_stats_clip) {
+        .num_frames = vi->numFrames,
+        .width = vi->width,
+        .height = vi->height,
+        .format = vsapi->queryVideoFormatID(fmt->colorFamily, fmt->sampleType, fmt->bitsPerSample,
+                                            fmt->subSamplingW, fmt->subSamplingH, core),
+        .hash = 0xcbf29ce484222325ull,
+    };
+
+    // Tells clips of the same length and format apart
+    const VSFrame *frame = vsapi->getFrame(0, node, err, err_size);
+    if (!frame)
+        return false;
+
+    for (int i = 0; i < fmt->numPlanes; i++) {
+        const uint8_t *ptr = vsapi->getReadPtr(frame, i);
+        const ptrdiff_t stride = vsapi->getStride(frame, i);
+        const int row_size = vsapi->getFrameWidth(frame, i) * fmt->bytesPerSample;
+
+        for (int y = 0; y < vsapi->getFrameHeight(frame, i); y++, ptr += stride) {
+            for (int x = 0; x < row_size; x++) {
+                clip->hash ^= ptr[x];
+                clip->hash *= 0x100000001b3ull;
+            }
+        }
+    }
+
+    vsapi->freeFrame(frame);
+    return true;
+}
+
+struct vspl_stats *vspl_stats_create(const char *path, const struct vspl_stats_clip *clip)
+{
+    struct vspl_stats *stats = vspl_stats_map(path, vspl_stats_size(clip->num_frames), true);
+    if (!stats)
+        return NULL;
+
+    // Creating the filter doesn't mean any frame gets analyzed (vspipe
+    // --info, a previewer reloading the script), so the records of an
+    // earlier pass over the same clip are kept and updated
+    struct vspl_stats_header *header = stats->map;
+    if (memcmp(header->magic, VSPL_STATS_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != VSPL_STATS_VERSION || memcmp(&header->clip, clip, sizeof(*clip)) != 0) {
+        // Zeroed, every record starts out invalid
+        memset(stats->map, 0, stats->size);
+        memcpy(header->magic, VSPL_STATS_MAGIC, sizeof(header->magic));
+        header->version = VSPL_STATS_VERSION;
+        header->clip = *clip;
+    }
+
+    return stats;
+}
+
+struct vspl_stats *vspl_stats_open(const char *path)
+{
+    struct vspl_stats *stats = vspl_stats_map(path, 0, false);
+    if (!stats)
+        return NULL;
+
+    const struct vspl_stats_header *header = stats->map;
+    if (memcmp(header->magic, VSPL_STATS_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != VSPL_STATS_VERSION ||
+        stats->size < vspl_stats_size(header->clip.num_frames)) {
+        fprintf(stderr, "vs-placebo: %s is not a valid stats file\n", path);
+        vspl_stats_close(&stats);
+        return NULL;
+    }
+
+    return stats;
+}
+
+void vspl_stats_close(struct vspl_stats **stats)
+{
+    struct vspl_stats *s = *stats;
+    if (!s)
+        return;
+
+    if (s->map && s->writable) {
+        struct vspl_stats_header *header = s->map;
+        const struct vspl_stats_frame *frames = vspl_stats_frames(s);
+
+        header->flags |= VSPL_STATS_COMPLETE;
+        for (uint32_t i = 0; i < header->clip.num_frames; i++) {
+            if (!(frames[i].flags & VSPL_STATS_VALID)) {
+                header->flags &= ~VSPL_STATS_COMPLETE;
+                break;
+            }
+        }
+    }
+
+#ifdef _WIN32
+    if (s->map) {
+        if (s->writable)
+            FlushViewOfFile(s->map, 0);
+        UnmapViewOfFile(s->map);
+    }
+    if (s->mapping)
+        CloseHandle(s->mapping);
+    if (s->file && s->file != INVALID_HANDLE_VALUE)
+        CloseHandle(s->file);
+#else
+    if (s->map) {
+        if (s->writable)
+            msync(s->map, s->size, MS_SYNC);
+        munmap(s->map, s->size);
+    }
+#endif
+
+    free(s);
+    *stats = NULL;
+}
+
+const struct vspl_stats_clip *vspl_stats_get_clip(const struct vspl_stats *stats)
+{
+    return &((const struct vspl_stats_header *) stats->map)->clip;
+}
+
+bool vspl_stats_complete(const struct vspl_stats *stats)
+{
+    return ((const struct vspl_stats_header *) stats->map)->flags & VSPL_STATS_COMPLETE;
+}
+
+int vspl_stats_num_frames(const struct vspl_stats *stats)
+{
+    return vspl_stats_get_clip(stats)->num_frames;
+}
+
+struct vspl_stats_frame *vspl_stats_frames(struct vspl_stats *stats)
+{
+    return (struct vspl_stats_frame *) ((char *) stats->map + sizeof(struct vspl_stats_header));
+}
+
+static void vspl_stats_scene_end(struct vspl_stats_frame *out, int start, int end, float max_pq, double sum_avg)
+{
+    for (int i = start; i < end; i++) {
+        out[i].max_pq = max_pq;
+        out[i].avg_pq = (float) (sum_avg / (end - start));
+    }
+}
+
+struct vspl_stats_frame *vspl_stats_scenes(struct vspl_stats *stats, float scene_threshold)
+{
+    const struct vspl_stats_frame *frames = vspl_stats_frames(stats);
+    int num_frames = vspl_stats_num_frames(stats);
+
+    struct vspl_stats_frame *out = malloc(sizeof(*out) * (num_frames ? num_frames : 1));
+    memcpy(out, frames, sizeof(*out) * num_frames);
+
+    int start = 0;
+    float max_pq = 0.0f;
+    double sum_avg = 0.0;
+
+    for (int i = 0; i < num_frames; i++) {
+        const struct vspl_stats_frame *f = &frames[i];
+        if (!(f->flags & VSPL_STATS_VALID)) {
+            if (i > start)
+                vspl_stats_scene_end(out, start, i, max_pq, sum_avg);
+            start = i + 1;
+            max_pq = 0.0f;
+            sum_avg = 0.0;
+            continue;
+        }
+
+        if (i > start) {
+            float scene_avg = pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, (float) (sum_avg / (i - start)));
+            float frame_avg = pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, f->avg_pq);
+            float delta = 10.0f * fabsf(log10f(fmaxf(frame_avg, 1e-6f) / fmaxf(scene_avg, 1e-6f)));
+
+            if (delta > scene_threshold) {
+                vspl_stats_scene_end(out, start, i, max_pq, sum_avg);
+                start = i;
+                max_pq = 0.0f;
+                sum_avg = 0.0;
+            }
+        }
+
+        max_pq = fmaxf(max_pq, f->max_pq);
+        sum_avg += f->avg_pq;
+    }
+
+    if (num_frames > start)
+        vspl_stats_scene_end(out, start, num_frames, max_pq, sum_avg);
+
+    return out;
+}
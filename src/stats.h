@@ -0,0 +1,75 @@
+#ifndef VS_PLACEBO_STATS_H
+#define VS_PLACEBO_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <VapourSynth4.h>
+
+// Per-frame HDR statistics written by placebo.Analyze and read back by
+// Tonemap's `stats_file`. The file is a small header followed by one fixed
+// size record per frame, mapped into memory so frames can be written in any
+// order and from any thread without locking.
+#define VSPL_STATS_MAGIC   "VSPLSTAT"
+#define VSPL_STATS_VERSION 2
+
+// Every frame of the clip has a valid record
+#define VSPL_STATS_COMPLETE (1u << 0)
+
+// The record has been written
+#define VSPL_STATS_VALID (1u << 0)
+
+// Identifies the clip the records were measured on
+struct vspl_stats_clip {
+    uint32_t num_frames;
+    uint32_t width;
+    uint32_t height;
+    // VapourSynth video format ID
+    uint32_t format;
+    // FNV-1a of the first frame's pixels
+    uint64_t hash;
+};
+
+struct vspl_stats_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    struct vspl_stats_clip clip;
+};
+
+struct vspl_stats_frame {
+    // Brightest and average luminance of the frame, in PQ (0-1)
+    float max_pq;
+    float avg_pq;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+struct vspl_stats;
+
+// Fills in `clip` for the clip of `node`. Reads its first frame, so this
+// runs the filters before it once. Returns false with `err` set if that fails.
+bool vspl_stats_fingerprint(struct vspl_stats_clip *clip, VSNode *node, char *err, int err_size,
+                            VSCore *core, const VSAPI *vsapi);
+
+// Opens the file for writing the records of `clip`. An existing stats file
+// for the same clip keeps its records, anything else is reset to invalid
+// records.
+struct vspl_stats *vspl_stats_create(const char *path, const struct vspl_stats_clip *clip);
+// Maps an existing file read-only, returns NULL if it isn't a stats file
+struct vspl_stats *vspl_stats_open(const char *path);
+// A writable file is marked complete if every record was written
+void vspl_stats_close(struct vspl_stats **stats);
+
+const struct vspl_stats_clip *vspl_stats_get_clip(const struct vspl_stats *stats);
+bool vspl_stats_complete(const struct vspl_stats *stats);
+int vspl_stats_num_frames(const struct vspl_stats *stats);
+struct vspl_stats_frame *vspl_stats_frames(struct vspl_stats *stats);
+
+// Splits the frames into scenes wherever the average brightness changes by
+// more than `scene_threshold` dB, and returns a malloc'd copy of the records
+// where each frame holds the brightest and mean average luminance of its
+// scene. Frames that weren't analyzed stay invalid and end the scene.
+struct vspl_stats_frame *vspl_stats_scenes(struct vspl_stats *stats, float scene_threshold);
+
+#endif //VS_PLACEBO_STATS_H
@@ -0,0 +1,183 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "counters.h"
+#include "texpool.h"
+
+struct vspl_tex_pool_entry {
+    pl_tex tex;
+    size_t size;
+    uint64_t last_used;
+};
+
+struct vspl_tex_pool {
+    pl_gpu gpu;
+    pthread_mutex_t lock;
+
+    struct vspl_tex_pool_entry *idle;
+    int num_idle;
+    int max_idle;
+    size_t idle_bytes;
+    size_t max_bytes;
+
+    uint64_t clock;
+};
+
+static size_t vspl_tex_size(const struct pl_tex_params *params)
+{
+    const size_t h = params->h ? params->h : 1;
+    const size_t d = params->d ? params->d : 1;
+    return params->w * h * d * params->format->texel_size;
+}
+
+// The texture has the same format and size and can do at least everything
+// the caller asks for
+static bool vspl_tex_matches(pl_tex tex, const struct pl_tex_params *params)
+{
+    const struct pl_tex_params *t = &tex->params;
+
+    if (t->format != params->format || t->w != params->w || t->h != params->h || t->d != params->d)
+        return false;
+    if (t->export_handle || t->import_handle || params->export_handle || params->import_handle)
+        return false;
+
+    return (!params->sampleable || t->sampleable) &&
+           (!params->renderable || t->renderable) &&
+           (!params->storable || t->storable) &&
+           (!params->blit_src || t->blit_src) &&
+           (!params->blit_dst || t->blit_dst) &&
+           (!params->host_writable || t->host_writable) &&
+           (!params->host_readable || t->host_readable);
+}
+
+static void vspl_tex_pool_remove(struct vspl_tex_pool *pool, int idx)
+{
+    pool->idle_bytes -= pool->idle[idx].size;
+    pool->idle[idx] = pool->idle[--pool->num_idle];
+}
+
+struct vspl_tex_pool *vspl_tex_pool_create(pl_gpu gpu, size_t max_bytes)
+{
+    struct vspl_tex_pool *pool = calloc(1, sizeof(struct vspl_tex_pool));
+    if (!pool)
+        return NULL;
+
+    pool->gpu = gpu;
+    pool->max_bytes = max_bytes;
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+void vspl_tex_pool_destroy(struct vspl_tex_pool **ppool)
+{
+    struct vspl_tex_pool *pool = *ppool;
+    if (!pool)
+        return;
+
+    for (int i = 0; i < pool->num_idle; i++)
+        pl_tex_destroy(pool->gpu, &pool->idle[i].tex);
+    vspl_counter_add(VSPL_COUNTER_TEXTURE_BYTES, -(int64_t) pool->idle_bytes);
+
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->idle);
+    free(pool);
+    *ppool = NULL;
+}
+
+pl_tex vspl_tex_pool_get(struct vspl_tex_pool *pool, const struct pl_tex_params *params)
+{
+    pl_tex tex = NULL;
+
+    vspl_lock(&pool->lock);
+
+    // Prefer the most recently returned texture
+    int best = -1;
+    for (int i = 0; i < pool->num_idle; i++) {
+        if (!vspl_tex_matches(pool->idle[i].tex, params))
+            continue;
+        if (best < 0 || pool->idle[i].last_used > pool->idle[best].last_used)
+            best = i;
+    }
+
+    if (best >= 0) {
+        tex = pool->idle[best].tex;
+        vspl_tex_pool_remove(pool, best);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if (tex) {
+        vspl_counter_add(VSPL_COUNTER_TEXTURE_REUSES, 1);
+        return tex;
+    }
+
+    tex = pl_tex_create(pool->gpu, params);
+    if (tex) {
+        vspl_counter_add(VSPL_COUNTER_TEXTURE_ALLOCS, 1);
+        vspl_counter_add(VSPL_COUNTER_TEXTURE_BYTES, vspl_tex_size(params));
+    }
+
+    return tex;
+}
+
+void vspl_tex_pool_put(struct vspl_tex_pool *pool, pl_tex *tex)
+{
+    if (!*tex)
+        return;
+
+    const size_t size = vspl_tex_size(&(*tex)->params);
+    if (size > pool->max_bytes) {
+        pl_tex_destroy(pool->gpu, tex);
+        vspl_counter_add(VSPL_COUNTER_TEXTURE_BYTES, -(int64_t) size);
+        return;
+    }
+
+    vspl_lock(&pool->lock);
+
+    if (pool->num_idle == pool->max_idle) {
+        const int max_idle = pool->max_idle ? pool->max_idle * 2 : 16;
+        struct vspl_tex_pool_entry *idle = realloc(pool->idle, max_idle * sizeof(*idle));
+        if (!idle) {
+            pthread_mutex_unlock(&pool->lock);
+            pl_tex_destroy(pool->gpu, tex);
+            vspl_counter_add(VSPL_COUNTER_TEXTURE_BYTES, -(int64_t) size);
+            return;
+        }
+
+        pool->idle = idle;
+        pool->max_idle = max_idle;
+    }
+
+    pool->idle[pool->num_idle++] = (struct vspl_tex_pool_entry) {
+        .tex = *tex,
+        .size = size,
+        .last_used = ++pool->clock,
+    };
+    pool->idle_bytes += size;
+
+    while (pool->idle_bytes > pool->max_bytes) {
+        int lru = 0;
+        for (int i = 1; i < pool->num_idle; i++) {
+            if (pool->idle[i].last_used < pool->idle[lru].last_used)
+                lru = i;
+        }
+
+        pl_tex_destroy(pool->gpu, &pool->idle[lru].tex);
+        vspl_counter_add(VSPL_COUNTER_TEXTURE_BYTES, -(int64_t) pool->idle[lru].size);
+        vspl_tex_pool_remove(pool, lru);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    *tex = NULL;
+}
+
+bool vspl_tex_pool_recreate(struct vspl_tex_pool *pool, pl_tex *tex, const struct pl_tex_params *params)
+{
+    if (*tex && vspl_tex_matches(*tex, params))
+        return true;
+
+    vspl_tex_pool_put(pool, tex);
+    *tex = vspl_tex_pool_get(pool, params);
+    return *tex != NULL;
+}
@@ -0,0 +1,30 @@
+#ifndef VS_PLACEBO_TEXPOOL_H
+#define VS_PLACEBO_TEXPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libplacebo/gpu.h>
+
+// Upper bound for the memory held by textures nobody is using
+#define VSPL_TEX_POOL_MAX_BYTES ((size_t) 256 << 20)
+
+// Textures that are no longer needed by their owner, kept around so the next
+// request for the same format, size and usage doesn't have to allocate.
+// Evicts the least recently returned textures once over its size limit.
+// Thread-safe.
+struct vspl_tex_pool;
+
+struct vspl_tex_pool *vspl_tex_pool_create(pl_gpu gpu, size_t max_bytes);
+void vspl_tex_pool_destroy(struct vspl_tex_pool **pool);
+
+// Takes a matching texture out of the pool, or creates a new one
+pl_tex vspl_tex_pool_get(struct vspl_tex_pool *pool, const struct pl_tex_params *params);
+
+// Hands the texture back to the pool and clears *tex
+void vspl_tex_pool_put(struct vspl_tex_pool *pool, pl_tex *tex);
+
+// Same as pl_tex_recreate, but swaps textures through the pool
+bool vspl_tex_pool_recreate(struct vspl_tex_pool *pool, pl_tex *tex, const struct pl_tex_params *params);
+
+#endif //VS_PLACEBO_TEXPOOL_H
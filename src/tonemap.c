@@ -1,4 +1,5 @@
 #include <inttypes.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -7,20 +8,13 @@
 
 #include <VapourSynth4.h>
 
-#include "p2p_api.h"
 #include "vs-placebo.h"
+#include "resident.h"
+#include "tonemap.h"
+#include "stats.h"
+#include "order.h"
 
-#ifdef HAVE_DOVI
-#include <libdovi/rpu_parser.h>
-#include "dovi_meta.h"
-#endif
-
-enum supported_colorspace {
-    CSP_SDR = 0,
-    CSP_HDR10,
-    CSP_HLG,
-    CSP_DOVI,
-};
+#include "dovi_cache.h"
 
 typedef struct {
     VSNode *node;
@@ -40,42 +34,324 @@ typedef struct {
     float original_src_min;
 
     bool is_subsampled;
-    enum pl_chroma_location chromaLocation;
+    bool dst_subsampled;
+
+    // VapourSynth _ChromaLocation value, or -1 to keep the source's
+    int dst_chroma_loc;
 
     bool use_dovi;
+#ifdef HAVE_DOVI
+    struct vspl_dovi_cache *dovi_cache;
+#endif
+
+    // Scene stats from a placebo.Analyze pass, indexed by frame
+    struct vspl_stats_frame *scene_stats;
+    int num_scene_stats;
+
+    // With peak detection, a single renderer sees every frame, in order
+    pl_renderer rr;
+    struct vspl_order *order;
+
+    int metadata_steps;
+    struct vspl_hdr_tracker *hdr_tracker;
+
+    // Tells the instance apart in traces
+    int trace_id;
 } TMData;
 
-bool vspl_tonemap_do_planes(TMData *tm_data, struct pl_plane *planes,
-                 const struct pl_color_repr src_repr, const struct pl_color_repr dst_repr)
+struct pl_color_map_params *vspl_color_map_params_read(const VSMap *in, const VSAPI *vsapi)
 {
-    struct priv *p = tm_data->vf;
+    int err;
+    struct pl_color_map_params *colorMapParams = malloc(sizeof(struct pl_color_map_params));
+    *colorMapParams = pl_color_map_default_params;
+
+    // Gamut mapping function
+    int64_t gamut_map_index = vsapi->mapGetInt(in, "gamut_mapping", 0, &err);
+    if (!err && gamut_map_index >= 0 && gamut_map_index < pl_num_gamut_map_functions) {
+        colorMapParams->gamut_mapping = pl_gamut_map_functions[gamut_map_index];
+    }
+
+    // Tone mapping function
+    int64_t function_index = vsapi->mapGetInt(in, "tone_mapping_function", 0, &err);
+    if (!err && function_index >= 0 && function_index < pl_num_tone_map_functions) {
+        colorMapParams->tone_mapping_function = pl_tone_map_functions[function_index];
+    }
+
+    const char *function_name = vsapi->mapGetData(in, "tone_mapping_function_s", 0, &err);
+    if (function_name && !err) {
+        const struct pl_tone_map_function *tm_function = pl_find_tone_map_function(function_name);
+        if (tm_function)
+            colorMapParams->tone_mapping_function = tm_function;
+    }
+
+    const double tone_mapping_param = vsapi->mapGetFloat(in, "tone_mapping_param", 0, &err);
+    colorMapParams->tone_mapping_param = tone_mapping_param;
+
+    if (err) {
+        // Set default param from selected function
+        colorMapParams->tone_mapping_param = colorMapParams->tone_mapping_function->param_def;
+    }
+
+#define COLORM_PARAM(par, type) colorMapParams->par = vsapi->mapGet##type(in, #par, 0, &err); \
+        if (err) colorMapParams->par = pl_color_map_default_params.par;
+
+#if PL_API_VER >= 247
+    COLORM_PARAM(visualize_lut, Int)
+#endif
+#if PL_API_VER >= 261
+    COLORM_PARAM(metadata, Int)
+#endif
+#if PL_API_VER >= 264
+    COLORM_PARAM(show_clipping, Int)
+#endif
+    COLORM_PARAM(contrast_recovery, Float)
+
+    return colorMapParams;
+}
+
+struct pl_peak_detect_params *vspl_peak_detect_params_read(const VSMap *in, const VSAPI *vsapi)
+{
+    int err;
+    struct pl_peak_detect_params *peakDetectParams = malloc(sizeof(struct pl_peak_detect_params));
+    *peakDetectParams = pl_peak_detect_default_params;
+
+#define PEAK_PARAM(par, type) peakDetectParams->par = vsapi->mapGet##type(in, #par, 0, &err); \
+        if (err) peakDetectParams->par = pl_peak_detect_default_params.par;
+
+    PEAK_PARAM(smoothing_period, Float)
+    PEAK_PARAM(scene_threshold_low, Float)
+    PEAK_PARAM(scene_threshold_high, Float)
+#if PL_API_VER >= 264
+    PEAK_PARAM(percentile, Float)
+#endif
+
+    return peakDetectParams;
+}
 
+bool vspl_color_space_from_csp(int csp, struct pl_color_space *out)
+{
+    switch (csp) {
+        case CSP_SDR:
+            *out = pl_color_space_bt709;
+            return true;
+        case CSP_HDR10:
+        case CSP_DOVI:
+            *out = pl_color_space_hdr10;
+            return true;
+        case CSP_HLG:
+            *out = pl_color_space_bt2020_hlg;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void vspl_hdr_metadata_read(const VSMap *props, struct pl_color_space *csp, bool max_luma, bool min_luma,
+                            const VSAPI *vsapi)
+{
+    int err;
+
+    // ST2086 metadata
+    csp->hdr.max_cll = vsapi->mapGetFloat(props, "ContentLightLevelMax", 0, &err);
+    csp->hdr.max_fall = vsapi->mapGetFloat(props, "ContentLightLevelAverage", 0, &err);
+
+    if (max_luma)
+        csp->hdr.max_luma = vsapi->mapGetFloat(props, "MasteringDisplayMaxLuminance", 0, &err);
+
+    if (min_luma)
+        csp->hdr.min_luma = vsapi->mapGetFloat(props, "MasteringDisplayMinLuminance", 0, &err);
+
+#if PL_API_VER >= 246
+    const double scene_avg = vsapi->mapGetFloat(props, "PLSceneAvg", 0, &err);
+
+    const int scene_max_len = vsapi->mapNumElements(props, "PLSceneMax");
+
+    if (scene_max_len) {
+        const double *prop_scene_max = vsapi->mapGetFloatArray(props, "PLSceneMax", &err);
+        if (prop_scene_max) {
+            if (scene_max_len == 1) {
+#if PL_API_VER >= 257
+                csp->hdr.avg_pq_y = pl_hdr_rescale(PL_HDR_NITS, PL_HDR_PQ, scene_avg);
+                csp->hdr.max_pq_y = pl_hdr_rescale(PL_HDR_NITS, PL_HDR_PQ, prop_scene_max[0]);
+#else
+                csp->hdr.scene_avg = scene_avg;
+                csp->hdr.scene_max[0] = csp->hdr.scene_max[1] = csp->hdr.scene_max[2] = prop_scene_max[0];
+#endif // PL_API_VER >= 257
+            } else if (scene_max_len == 3) {
+                csp->hdr.scene_avg = scene_avg;
+                csp->hdr.scene_max[0] = prop_scene_max[0];
+                csp->hdr.scene_max[1] = prop_scene_max[1];
+                csp->hdr.scene_max[2] = prop_scene_max[2];
+            }
+        }
+    }
+#endif // PL_API_VER >= 246
+
+    const double *primariesX = vsapi->mapGetFloatArray(props, "MasteringDisplayPrimariesX", &err);
+    const double *primariesY = vsapi->mapGetFloatArray(props, "MasteringDisplayPrimariesY", &err);
+
+    const int numPrimariesX = vsapi->mapNumElements(props, "MasteringDisplayPrimariesX");
+    const int numPrimariesY = vsapi->mapNumElements(props, "MasteringDisplayPrimariesY");
+
+    if (primariesX && primariesY && numPrimariesX == 3 && numPrimariesY == 3) {
+        csp->hdr.prim.red.x = primariesX[0];
+        csp->hdr.prim.red.y = primariesY[0];
+        csp->hdr.prim.green.x = primariesX[1];
+        csp->hdr.prim.green.y = primariesY[1];
+        csp->hdr.prim.blue.x = primariesX[2];
+        csp->hdr.prim.blue.y = primariesY[2];
+
+        // White point comes with primaries
+        const double whitePointX = vsapi->mapGetFloat(props, "MasteringDisplayWhitePointX", 0, &err);
+        const double whitePointY = vsapi->mapGetFloat(props, "MasteringDisplayWhitePointY", 0, &err);
+
+        if (whitePointX && whitePointY) {
+            csp->hdr.prim.white.x = whitePointX;
+            csp->hdr.prim.white.y = whitePointY;
+        }
+    } else {
+        // Assume DCI-P3 D65 default?
+        pl_raw_primaries_merge(&csp->hdr.prim, pl_raw_primaries_get(PL_COLOR_PRIM_DISPLAY_P3));
+    }
+}
+
+#if PL_API_VER >= 246
+static float vspl_quantize_pq(float pq, int steps)
+{
+    // Zero means unknown, which is kept as such
+    if (pq <= 0)
+        return pq;
+
+    float q = roundf(pq * steps) / steps;
+    return q > 0 ? q : pq;
+}
+
+static float vspl_quantize_nits(float nits, int steps)
+{
+    if (nits <= 0)
+        return nits;
+
+    float pq = pl_hdr_rescale(PL_HDR_NITS, PL_HDR_PQ, nits);
+    float q = vspl_quantize_pq(pq, steps);
+    return q != pq ? pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, q) : nits;
+}
+#endif
+
+void vspl_hdr_metadata_quantize(struct pl_hdr_metadata *hdr, int steps)
+{
+    if (steps <= 0)
+        return;
+
+    // Only the dynamic values, the mastering display and MaxCLL/MaxFALL
+    // are passed on exactly as given
+#if PL_API_VER >= 257
+    hdr->max_pq_y = vspl_quantize_pq(hdr->max_pq_y, steps);
+    hdr->avg_pq_y = vspl_quantize_pq(hdr->avg_pq_y, steps);
+#endif
+#if PL_API_VER >= 246
+    for (int i = 0; i < 3; i++)
+        hdr->scene_max[i] = vspl_quantize_nits(hdr->scene_max[i], steps);
+    hdr->scene_avg = vspl_quantize_nits(hdr->scene_avg, steps);
+#endif
+}
+
+struct vspl_hdr_tracker *vspl_hdr_tracker_create(int num_renderers)
+{
+    struct vspl_hdr_tracker *tracker = calloc(1, sizeof(*tracker) + num_renderers * sizeof(tracker->last[0]));
+    if (!tracker)
+        return NULL;
+
+    atomic_init(&tracker->frames, 0);
+    atomic_init(&tracker->changes, 0);
+    atomic_init(&tracker->merged, 0);
+    tracker->num_renderers = num_renderers;
+    return tracker;
+}
+
+void vspl_hdr_tracker_update(struct vspl_hdr_tracker *tracker, int renderer,
+                             const struct pl_hdr_metadata *raw, const struct pl_hdr_metadata *used)
+{
+    if (renderer < 0 || renderer >= tracker->num_renderers)
+        return;
+
+    atomic_fetch_add_explicit(&tracker->frames, 1, memory_order_relaxed);
+
+    // The first frame of a renderer always builds its LUT
+    struct vspl_hdr_last *last = &tracker->last[renderer];
+    if (!last->valid || !pl_hdr_metadata_equal(&last->used, used)) {
+        atomic_fetch_add_explicit(&tracker->changes, 1, memory_order_relaxed);
+        vspl_counter_add(VSPL_COUNTER_RENDERER_CACHE_MISSES, 1);
+    } else {
+        if (!pl_hdr_metadata_equal(&last->raw, raw))
+            atomic_fetch_add_explicit(&tracker->merged, 1, memory_order_relaxed);
+        vspl_counter_add(VSPL_COUNTER_RENDERER_CACHE_HITS, 1);
+    }
+
+    last->valid = true;
+    last->raw = *raw;
+    last->used = *used;
+}
+
+void vspl_hdr_tracker_destroy(struct vspl_hdr_tracker **tracker, pl_log log, const char *name)
+{
+    struct vspl_hdr_tracker *t = *tracker;
+    if (!t)
+        return;
+
+    uint64_t frames = atomic_load(&t->frames);
+    if (frames) {
+        pl_msg(log, PL_LOG_INFO, "%s: HDR metadata changed on %" PRIu64 " of %" PRIu64 " frames, "
+               "%" PRIu64 " more changes avoided by quantizing", name, atomic_load(&t->changes), frames,
+               atomic_load(&t->merged));
+    }
+
+    free(t);
+    *tracker = NULL;
+}
+
+bool vspl_tonemap_do_planes(TMData *tm_data, struct vspl_slot *s, pl_renderer rr, struct pl_plane *planes,
+                 const struct pl_color_repr src_repr, const struct pl_color_repr dst_repr,
+                 const struct pl_color_space *src_csp, const struct pl_color_space *dst_csp,
+                 enum pl_chroma_location chroma_loc, enum pl_chroma_location dst_chroma_loc)
+{
     struct pl_frame img = {
         .num_planes = 3,
         .planes     = {planes[0], planes[1], planes[2]},
         .repr       = src_repr,
-        .color      = *tm_data->src_pl_csp,
+        .color      = *src_csp,
     };
 
     if (tm_data->is_subsampled) {
-        pl_frame_set_chroma_location(&img, tm_data->chromaLocation);
+        pl_frame_set_chroma_location(&img, chroma_loc);
     }
 
+    // Render straight into one texture per output plane
     struct pl_frame out = {
-        .num_planes = 1,
-        .planes = {{
-            .texture = p->tex_out[0],
-            .components = p->tex_out[0]->params.format->num_components,
-            .component_mapping = {0, 1, 2, 3},
-        }},
+        .num_planes = 3,
         .repr = dst_repr,
-        .color = *tm_data->dst_pl_csp,
+        .color = *dst_csp,
     };
 
-    return pl_render_image(p->rr, &img, &out, tm_data->renderParams);
+    for (int i = 0; i < 3; i++) {
+        out.planes[i] = (struct pl_plane) {
+            .texture = s->tex_out[i],
+            .components = 1,
+            .component_mapping = {i},
+        };
+    }
+
+    // Subsampled chroma planes get downsampled by the renderer
+    if (tm_data->dst_subsampled) {
+        pl_frame_set_chroma_location(&out, dst_chroma_loc);
+    }
+
+    struct pl_render_params params = *tm_data->renderParams;
+    vspl_slot_render_params(tm_data->vf, s, &params);
+    return pl_render_image(rr, &img, &out, &params);
 }
 
-bool vspl_tonemap_reconfig(void *priv, struct pl_plane_data *data, VSCore *core, const VSAPI *vsapi)
+bool vspl_tonemap_reconfig(void *priv, struct vspl_slot *s, struct pl_plane_data *data, const VSVideoFormat *dst_fmt,
+                           const struct vspl_resident_ref *res, VSCore *core, const VSAPI *vsapi)
 {
     struct priv *p = priv;
 
@@ -85,39 +361,41 @@ bool vspl_tonemap_reconfig(void *priv, struct pl_plane_data *data, VSCore *core,
         return false;
     }
 
+    // Subsampled chroma is uploaded at its own size, the renderer upsamples
+    // it according to the chroma location
     bool ok = true;
     for (int i = 0; i < 3; ++i) {
-        ok &= pl_tex_recreate(p->gpu, &p->tex_in[i], pl_tex_params(
-            .w = data->width,
-            .h = data->height,
+        if (vspl_resident_tex(res, i))
+            continue;
+
+        ok &= vspl_tex_pool_recreate(p->pool, &s->tex_in[i], pl_tex_params(
+            .w = data[i].width,
+            .h = data[i].height,
             .format = fmt,
             .sampleable = true,
             .host_writable = true,
+            .blit_src = fmt->caps & PL_FMT_CAP_BLITTABLE,
         ));
     }
 
-    const struct pl_plane_data plane_data = {
-        .type = PL_FMT_UNORM,
-        .component_map = {0, 1, 2, 0},
-        .component_pad = {0, 0, 0, 0},
-        .component_size = {16, 16, 16, 0},
-        .width = 10,
-        .height = 10,
-        .row_stride = 60,
-        .pixel_stride = 6
-    };
-
-    pl_fmt out = pl_plane_find_fmt(p->gpu, NULL, &plane_data);
+    pl_fmt out = vspl_find_plane_fmt(p->gpu, dst_fmt, PL_FMT_CAP_RENDERABLE | PL_FMT_CAP_HOST_READABLE);
+    if (!out) {
+        vsapi->logMessage(mtCritical, "Failed configuring filter: no good output texture format!\n", core);
+        return false;
+    }
 
-    ok &= pl_tex_recreate(p->gpu, &p->tex_out[0], pl_tex_params(
-        .w = data->width,
-        .h = data->height,
-        .format = out,
-        .renderable = true,
-        .host_readable = true,
-        .storable = true,
-        .blit_dst = true,
-    ));
+    for (int i = 0; i < 3; ++i) {
+        ok &= vspl_tex_pool_recreate(p->pool, &s->tex_out[i], pl_tex_params(
+            .w = i ? data->width >> dst_fmt->subSamplingW : data->width,
+            .h = i ? data->height >> dst_fmt->subSamplingH : data->height,
+            .format = out,
+            .renderable = true,
+            .host_readable = true,
+            .storable = out->caps & PL_FMT_CAP_STORABLE,
+            .blit_dst = out->caps & PL_FMT_CAP_BLITTABLE,
+            .sampleable = p->resident,
+        ));
+    }
 
     if (!ok) {
         vsapi->logMessage(mtCritical, "Failed creating GPU textures!\n", core);
@@ -127,35 +405,73 @@ bool vspl_tonemap_reconfig(void *priv, struct pl_plane_data *data, VSCore *core,
     return true;
 }
 
-bool vspl_tonemap_filter(TMData *tm_data, void *dst, struct pl_plane_data *src, VSCore *core, const VSAPI *vsapi,
-               const struct pl_color_repr src_repr, const struct pl_color_repr dst_repr)
+bool vspl_tonemap_filter(TMData *tm_data, struct vspl_slot *s, int n, VSFrame *dst, struct pl_plane_data *src, VSCore *core, const VSAPI *vsapi,
+               const struct pl_color_repr src_repr, const struct pl_color_repr dst_repr,
+               const struct pl_color_space *src_csp, const struct pl_color_space *dst_csp,
+               enum pl_chroma_location chroma_loc, enum pl_chroma_location dst_chroma_loc,
+               const struct pl_hdr_metadata *raw_hdr, const struct vspl_resident_ref *res)
 {
     struct priv *p = tm_data->vf;
 
-    // Upload planes
+    // Upload planes, unless they are still on the GPU
     struct pl_plane planes[4] = {0};
 
     bool ok = true;
     for (int i = 0; i < 3; ++i) {
-        ok &= pl_upload_plane(p->gpu, &planes[i], &p->tex_in[i], &src[i]);
+        pl_tex tex = vspl_resident_tex(res, i);
+        if (tex) {
+            planes[i] = (struct pl_plane) {
+                .texture = tex,
+                .components = 1,
+                .component_mapping = {i},
+            };
+        } else {
+            ok &= vspl_upload_plane(p->gpu, &s->xfer, &planes[i], &s->tex_in[i], &src[i]);
+        }
     }
 
     if (!ok) {
         vsapi->logMessage(mtCritical, "Failed uploading data to the GPU!\n", core);
+        if (tm_data->order)
+            vspl_order_cancel(tm_data->order, n);
         return false;
     }
 
-    // Process plane
-    if (!vspl_tonemap_do_planes(tm_data, planes, src_repr, dst_repr)) {
+    // Process plane. Only the rendering is ordered, the transfers of other
+    // frames keep going meanwhile.
+    pl_renderer rr = s->rr;
+    int renderer = 1 + (int) (s - p->slots);
+    if (tm_data->order) {
+        vspl_order_begin(tm_data->order, n);
+        rr = tm_data->rr;
+        renderer = 0;
+    }
+
+    if (tm_data->hdr_tracker)
+        vspl_hdr_tracker_update(tm_data->hdr_tracker, renderer, raw_hdr, &src_csp->hdr);
+
+    const int64_t trace = vspl_trace_begin();
+    bool rendered = vspl_tonemap_do_planes(tm_data, s, rr, planes, src_repr, dst_repr, src_csp, dst_csp,
+                                           chroma_loc, dst_chroma_loc);
+    vspl_trace_end(VSPL_TRACE_RENDER, trace);
+
+    if (tm_data->order)
+        vspl_order_end(tm_data->order, n);
+
+    if (!rendered) {
         vsapi->logMessage(mtCritical, "Failed processing planes!\n", core);
         return false;
     }
 
     // Download planes
-    ok = pl_tex_download(p->gpu, pl_tex_transfer_params(
-        .tex = p->tex_out[0],
-        .ptr = dst,
-    ));
+    for (int i = 0; i < 3; ++i) {
+        ok &= vspl_download_async(p->gpu, &s->xfer, pl_tex_transfer_params(
+            .tex = s->tex_out[i],
+            .row_pitch = vsapi->getStride(dst, i),
+            .ptr = vsapi->getWritePtr(dst, i),
+        ));
+    }
+    vspl_download_wait(p->gpu, &s->xfer);
 
     if (!ok) {
         vsapi->logMessage(mtCritical, "Failed downloading data from the GPU!\n", core);
@@ -172,7 +488,19 @@ static const VSFrame *VS_CC VSPlaceboTMGetFrame(int n, int activationReason, voi
 
     if (activationReason == arInitial) {
         vsapi->requestFrameFilter(n, tm_data->node, frameCtx);
+
+#ifdef HAVE_DOVI
+        // For the coefficients an RPU keeps from the frame before it
+        if (tm_data->dovi_cache && n > 0)
+            vsapi->requestFrameFilter(n - 1, tm_data->node, frameCtx);
+#endif
+
+        if (tm_data->order)
+            vspl_order_request(tm_data->order, n);
     } else if (activationReason == arAllFramesReady) {
+        vspl_counter_add(VSPL_COUNTER_TONEMAP_FRAMES, 1);
+        vspl_trace_frame("Tonemap", tm_data->trace_id, n);
+
         const VSFrame *frame = vsapi->getFrameFilter(n, tm_data->node, frameCtx);
 
         int err;
@@ -182,6 +510,9 @@ static const VSFrame *VS_CC VSPlaceboTMGetFrame(int n, int activationReason, voi
         if (tm_data->src_csp == CSP_DOVI && vsapi->mapNumElements(props, "DolbyVisionRPU") == -1) {
             vsapi->setFilterError("placebo.Tonemap: Clip is missing `DolbyVisionRPU` prop for Dolby Vision mapping!", frameCtx);
 
+            if (tm_data->order)
+                vspl_order_cancel(tm_data->order, n);
+            vsapi->freeFrame(frame);
             return NULL;
         }
 
@@ -200,21 +531,21 @@ static const VSFrame *VS_CC VSPlaceboTMGetFrame(int n, int activationReason, voi
                                         : PL_COLOR_SYSTEM_BT_2020_NC;
         enum pl_color_system dst_sys = PL_COLOR_SYSTEM_RGB;
 
+        // The color spaces are updated from the frame props below, so work on
+        // per-frame copies to keep parallel requests from racing on them
+        struct pl_color_space src_csp = *tm_data->src_pl_csp;
+        struct pl_color_space dst_csp = *tm_data->dst_pl_csp;
+        struct pl_color_space *src_pl_csp = &src_csp;
+        struct pl_color_space *dst_pl_csp = &dst_csp;
+
+        // The renderer dithers down to the output's color depth
         struct pl_color_repr src_repr = {
-            .bits = {
-                .sample_depth = 16,
-                .color_depth = 16,
-                .bit_shift = 0
-            },
+            .bits = vspl_bit_encoding(src_fmt),
             .sys = src_sys,
         };
 
         struct pl_color_repr dst_repr = {
-            .bits = {
-                .sample_depth = 16,
-                .color_depth = 16,
-                .bit_shift = 0
-            },
+            .bits = vspl_bit_encoding(dst_fmt),
             .sys = dst_sys,
             .levels = PL_COLOR_LEVELS_FULL,
             .alpha = PL_ALPHA_PREMULTIPLIED,
@@ -235,226 +566,182 @@ static const VSFrame *VS_CC VSPlaceboTMGetFrame(int n, int activationReason, voi
                 dst_repr.levels = PL_COLOR_LEVELS_FULL;
             }
 
-            if (tm_data->dst_pl_csp->transfer == PL_COLOR_TRC_BT_1886) {
+            if (dst_pl_csp->transfer == PL_COLOR_TRC_BT_1886) {
                 dst_repr.sys = PL_COLOR_SYSTEM_BT_709;
-            } else if (tm_data->dst_pl_csp->transfer == PL_COLOR_TRC_PQ || tm_data->dst_pl_csp->transfer == PL_COLOR_TRC_HLG) {
+            } else if (dst_pl_csp->transfer == PL_COLOR_TRC_PQ || dst_pl_csp->transfer == PL_COLOR_TRC_HLG) {
                 dst_repr.sys = PL_COLOR_SYSTEM_BT_2020_NC;
             }
         }
 
-        struct pl_color_space *src_pl_csp = tm_data->src_pl_csp;
-
-        // ST2086 metadata
-        // Update metadata from props
-        const double maxCll = vsapi->mapGetFloat(props, "ContentLightLevelMax", 0, &err);
-        const double maxFall = vsapi->mapGetFloat(props, "ContentLightLevelAverage", 0, &err);
-
-        src_pl_csp->hdr.max_cll = maxCll;
-        src_pl_csp->hdr.max_fall = maxFall;
-
-        if (tm_data->original_src_max < 1) {
-            src_pl_csp->hdr.max_luma = vsapi->mapGetFloat(props, "MasteringDisplayMaxLuminance", 0, &err);
-        }
-
-        if (tm_data->original_src_min <= 0) {
-            src_pl_csp->hdr.min_luma = vsapi->mapGetFloat(props, "MasteringDisplayMinLuminance", 0, &err);
-        }
-
-#if PL_API_VER >= 246
-        const double scene_avg = vsapi->mapGetFloat(props, "PLSceneAvg", 0, &err);
-
-        const int scene_max_len = vsapi->mapNumElements(props, "PLSceneMax");
-
-        if (scene_max_len) {
-            const double *prop_scene_max = vsapi->mapGetFloatArray(props, "PLSceneMax", &err);
-            if (prop_scene_max) {
-                if (scene_max_len == 1) {
-#if PL_API_VER >= 257
-                    src_pl_csp->hdr.avg_pq_y = pl_hdr_rescale(PL_HDR_NITS, PL_HDR_PQ, scene_avg);
-                    src_pl_csp->hdr.max_pq_y = pl_hdr_rescale(PL_HDR_NITS, PL_HDR_PQ, prop_scene_max[0]);
-#else
-                    src_pl_csp->hdr.scene_avg = scene_avg;
-                    src_pl_csp->hdr.scene_max[0] = src_pl_csp->hdr.scene_max[1] = src_pl_csp->hdr.scene_max[2] = prop_scene_max[0];
-#endif // PL_API_VER >= 257
-                } else if (scene_max_len == 3) {
-                    src_pl_csp->hdr.scene_avg = scene_avg;
-                    src_pl_csp->hdr.scene_max[0] = prop_scene_max[0];
-                    src_pl_csp->hdr.scene_max[1] = prop_scene_max[1];
-                    src_pl_csp->hdr.scene_max[2] = prop_scene_max[2];
-                }
-            }
-        }
-#endif // PL_API_VER >= 246
-
-        const double *primariesX = vsapi->mapGetFloatArray(props, "MasteringDisplayPrimariesX", &err);
-        const double *primariesY = vsapi->mapGetFloatArray(props, "MasteringDisplayPrimariesY", &err);
+        vspl_hdr_metadata_read(props, src_pl_csp, tm_data->original_src_max < 1,
+                               tm_data->original_src_min <= 0, vsapi);
 
-        const int numPrimariesX = vsapi->mapNumElements(props, "MasteringDisplayPrimariesX");
-        const int numPrimariesY = vsapi->mapNumElements(props, "MasteringDisplayPrimariesY");
-
-        if (primariesX && primariesY && numPrimariesX == 3 && numPrimariesY == 3) {
-            src_pl_csp->hdr.prim.red.x = primariesX[0];
-            src_pl_csp->hdr.prim.red.y = primariesY[0];
-            src_pl_csp->hdr.prim.green.x = primariesX[1];
-            src_pl_csp->hdr.prim.green.y = primariesY[1];
-            src_pl_csp->hdr.prim.blue.x = primariesX[2];
-            src_pl_csp->hdr.prim.blue.y = primariesY[2];
-
-            // White point comes with primaries
-            const double whitePointX = vsapi->mapGetFloat(props, "MasteringDisplayWhitePointX", 0, &err);
-            const double whitePointY = vsapi->mapGetFloat(props, "MasteringDisplayWhitePointY", 0, &err);
-
-            if (whitePointX && whitePointY) {
-                src_pl_csp->hdr.prim.white.x = whitePointX;
-                src_pl_csp->hdr.prim.white.y = whitePointY;
-            }
-        } else {
-            // Assume DCI-P3 D65 default?
-            pl_raw_primaries_merge(&src_pl_csp->hdr.prim, pl_raw_primaries_get(PL_COLOR_PRIM_DISPLAY_P3));
-        }
-
-        tm_data->chromaLocation = vsapi->mapGetInt(props, "_ChromaLocation", 0, &err);
+        enum pl_chroma_location chroma_loc = vsapi->mapGetInt(props, "_ChromaLocation", 0, &err);
 
         // FFMS2 prop is -1 to match zimg
         // However, libplacebo matches AVChromaLocation
         if (!err) {
-            tm_data->chromaLocation += 1;
+            chroma_loc += 1;
+        } else {
+            // Same default as VapourSynth's resizers
+            chroma_loc = PL_CHROMA_LEFT;
         }
 
+        enum pl_chroma_location dst_chroma_loc = tm_data->dst_chroma_loc >= 0
+                                                 ? tm_data->dst_chroma_loc + 1
+                                                 : chroma_loc;
+        if (tm_data->dst_subsampled)
+            vsapi->mapSetInt(vsapi->getFramePropertiesRW(dst), "_ChromaLocation", dst_chroma_loc - 1, maReplace);
+
         // DOVI
-        struct pl_dovi_metadata *dovi_meta = NULL;
-        uint8_t dovi_profile = 0;
+        const struct pl_dovi_metadata *dovi_meta = NULL;
 
 #ifdef HAVE_DOVI
         if (tm_data->use_dovi && vsapi->mapNumElements(props, "DolbyVisionRPU")) {
-            uint8_t *doviRpu = (uint8_t *) vsapi->mapGetData(props, "DolbyVisionRPU", 0, &err);
+            const uint8_t *doviRpu = (const uint8_t *) vsapi->mapGetData(props, "DolbyVisionRPU", 0, &err);
             size_t doviRpuSize = (size_t) vsapi->mapGetDataSize(props, "DolbyVisionRPU", 0, &err);
 
             if (doviRpu && doviRpuSize) {
-                DoviRpuOpaque *rpu = dovi_parse_unspec62_nalu(doviRpu, doviRpuSize);
-                const DoviRpuDataHeader *header = dovi_rpu_get_header(rpu);
-
-                if (!header) {
-                    fprintf(stderr, "Failed parsing RPU: %s\n", dovi_rpu_get_error(rpu));
-                } else {
-                    dovi_profile = header->guessed_profile;
-                    dovi_meta = create_dovi_meta(rpu, header);
+                const VSFrame *prev = n > 0 ? vsapi->getFrameFilter(n - 1, tm_data->node, frameCtx) : NULL;
+                const VSMap *prev_props = prev ? vsapi->getFramePropertiesRO(prev) : NULL;
+                const uint8_t *prevRpu = NULL;
+                size_t prevRpuSize = 0;
+                if (prev_props && vsapi->mapNumElements(prev_props, "DolbyVisionRPU") > 0) {
+                    prevRpu = (const uint8_t *) vsapi->mapGetData(prev_props, "DolbyVisionRPU", 0, &err);
+                    prevRpuSize = (size_t) vsapi->mapGetDataSize(prev_props, "DolbyVisionRPU", 0, &err);
                 }
 
+                struct vspl_dovi_rpu rpu = {0};
+                dovi_meta = vspl_dovi_cache_get(tm_data->dovi_cache, n, doviRpu, doviRpuSize,
+                                                prevRpu, prevRpuSize, &rpu);
+                vsapi->freeFrame(prev);
+
                 // Profile 5, 7 or 8 mapping
                 if (tm_data->src_csp == CSP_DOVI) {
                     src_repr.sys = PL_COLOR_SYSTEM_DOLBYVISION;
                     src_repr.dovi = dovi_meta;
 
-                    if (dovi_profile == 5) {
+                    if (rpu.profile == 5) {
                         dst_repr.levels = PL_COLOR_LEVELS_FULL;
                     }
                 }
 
-                if (header) {
-                    if (header->vdr_dm_metadata_present_flag) {
-                        const DoviVdrDmData *vdr_dm_data = dovi_rpu_get_vdr_dm_data(rpu);
-
-                        // Should avoid changing the source black point when mapping to PQ
-                        // As the source image already has a specific black point,
-                        // and the RPU isn't necessarily ground truth on the actual coded values
-                        //
-                        // Set target black point to the same as source
-                        if (tm_data->src_csp == CSP_DOVI && tm_data->dst_csp == CSP_HDR10) {
-                            tm_data->dst_pl_csp->hdr.min_luma = src_pl_csp->hdr.min_luma;
-                        } else {
-                            src_pl_csp->hdr.min_luma =
-                                pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, vdr_dm_data->source_min_pq / 4095.0f);
-                        }
+                if (rpu.has_dm) {
+                    // Should avoid changing the source black point when mapping to PQ
+                    // As the source image already has a specific black point,
+                    // and the RPU isn't necessarily ground truth on the actual coded values
+                    //
+                    // Set target black point to the same as source
+                    if (tm_data->src_csp == CSP_DOVI && tm_data->dst_csp == CSP_HDR10) {
+                        dst_pl_csp->hdr.min_luma = src_pl_csp->hdr.min_luma;
+                    } else {
+                        src_pl_csp->hdr.min_luma = pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, rpu.source_min_pq);
+                    }
 
-                        src_pl_csp->hdr.max_luma =
-                            pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, vdr_dm_data->source_max_pq / 4095.0f);
+                    src_pl_csp->hdr.max_luma = pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, rpu.source_max_pq);
 
 #if PL_API_VER >= 246
-                        if (vdr_dm_data->dm_data.level1) {
-                            const DoviExtMetadataBlockLevel1 *l1 = vdr_dm_data->dm_data.level1;
-
+                    if (rpu.has_l1) {
 #if PL_API_VER >= 257
-                            src_pl_csp->hdr.avg_pq_y = l1->avg_pq / 4095.0f;
-                            src_pl_csp->hdr.max_pq_y = l1->max_pq / 4095.0f;
+                        src_pl_csp->hdr.avg_pq_y = rpu.avg_pq;
+                        src_pl_csp->hdr.max_pq_y = rpu.max_pq;
 #else
-                            src_pl_csp->hdr.scene_avg = pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, l1->avg_pq / 4095.0f);
+                        src_pl_csp->hdr.scene_avg = pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, rpu.avg_pq);
 
-                            const float max_luma = pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, l1->max_pq / 4095.0f);
-                            src_pl_csp->hdr.scene_max[0] = src_pl_csp->hdr.scene_max[1] = src_pl_csp->hdr.scene_max[2] = max_luma;
+                        const float max_luma = pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, rpu.max_pq);
+                        src_pl_csp->hdr.scene_max[0] = src_pl_csp->hdr.scene_max[1] = src_pl_csp->hdr.scene_max[2] = max_luma;
 #endif // PL_API_VER >= 257
-                        }
+                    }
 #endif // PL_API_VER >= 246
 
-                        if (vdr_dm_data->dm_data.level6) {
-                            const DoviExtMetadataBlockLevel6 *meta = vdr_dm_data->dm_data.level6;
-
-                            if (!maxCll || !maxFall) {
-                                src_pl_csp->hdr.max_cll = meta->max_content_light_level;
-                                src_pl_csp->hdr.max_fall = meta->max_frame_average_light_level;
-                            }
+                    if (rpu.has_l6) {
+                        if (!src_pl_csp->hdr.max_cll || !src_pl_csp->hdr.max_fall) {
+                            src_pl_csp->hdr.max_cll = rpu.max_cll;
+                            src_pl_csp->hdr.max_fall = rpu.max_fall;
                         }
-
-                        dovi_rpu_free_vdr_dm_data(vdr_dm_data);
                     }
-
-                    dovi_rpu_free_header(header);
                 }
-
-                dovi_rpu_free(rpu);
             }
         }
 #endif
 
-        pl_color_space_infer_map(src_pl_csp, tm_data->dst_pl_csp);
+        // Measured scene stats take precedence over any metadata
+        if (tm_data->scene_stats && n < tm_data->num_scene_stats &&
+            (tm_data->scene_stats[n].flags & VSPL_STATS_VALID)) {
+            const struct vspl_stats_frame *scene = &tm_data->scene_stats[n];
+#if PL_API_VER >= 257
+            src_pl_csp->hdr.max_pq_y = scene->max_pq;
+            src_pl_csp->hdr.avg_pq_y = scene->avg_pq;
+#elif PL_API_VER >= 246
+            src_pl_csp->hdr.scene_avg = pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, scene->avg_pq);
+            src_pl_csp->hdr.scene_max[0] = src_pl_csp->hdr.scene_max[1] = src_pl_csp->hdr.scene_max[2] =
+                pl_hdr_rescale(PL_HDR_PQ, PL_HDR_NITS, scene->max_pq);
+#endif
+        }
+
+        // Round off the jitter, so the renderer keeps using the same LUT
+        const struct pl_hdr_metadata raw_hdr = src_pl_csp->hdr;
+        vspl_hdr_metadata_quantize(&src_pl_csp->hdr, tm_data->metadata_steps);
+
+        pl_color_space_infer_map(src_pl_csp, dst_pl_csp);
 
         struct pl_plane_data planes[3] = {};
         for (int i = 0; i < 3; ++i) {
             planes[i] = (struct pl_plane_data) {
-                .type = PL_FMT_UNORM,
+                .type = src_fmt->sampleType == stInteger ? PL_FMT_UNORM : PL_FMT_FLOAT,
                 .width = vsapi->getFrameWidth(frame, i),
                 .height = vsapi->getFrameHeight(frame, i),
-                .pixel_stride = dst_fmt->bytesPerSample,
+                .pixel_stride = src_fmt->bytesPerSample,
                 .row_stride = vsapi->getStride(frame, i),
                 .pixels = vsapi->getReadPtr((VSFrame *) frame, i),
             };
 
-            planes[i].component_size[0] = 16;
+            planes[i].component_size[0] = src_fmt->bytesPerSample * 8;
             planes[i].component_pad[0] = 0;
             planes[i].component_map[0] = i;
         }
 
-        void *packed_dst = malloc(w * h * 2 * 3);
-
-        pthread_mutex_lock(&vspl_vulkan_mutex);
-        if (vspl_tonemap_reconfig(tm_data->vf, planes, core, vsapi)) {
-            vspl_tonemap_filter(tm_data, packed_dst, planes, core, vsapi, src_repr, dst_repr);
+        struct vspl_slot *s = tm_data->order ? vspl_order_slot_acquire(tm_data->order, tm_data->vf, n)
+                                             : vspl_slot_acquire(tm_data->vf);
+        if (!s) {
+            vsapi->setFilterError("placebo.Tonemap: Too many frames waiting to be rendered in order, "
+                                  "request fewer frames at a time!", frameCtx);
+#ifdef HAVE_DOVI
+            vspl_dovi_cache_release(tm_data->dovi_cache, dovi_meta);
+#endif
+            vsapi->freeFrame(dst);
+            vsapi->freeFrame(frame);
+            return NULL;
         }
-        pthread_mutex_unlock(&vspl_vulkan_mutex);
-
-        struct p2p_buffer_param pack_params = {
-            .width = w,
-            .height = h,
-            .packing = p2p_bgr48_le,
-            .src[0] = packed_dst,
-            .src_stride[0] = w * 2 * 3,
-        };
 
-        for (int i = 0; i < 3; ++i) {
-            pack_params.dst[i] = vsapi->getWritePtr(dst, i);
-            pack_params.dst_stride[i] = vsapi->getStride(dst, i);
+        struct vspl_resident_ref res;
+        vspl_resident_ref(tm_data->vf, frame, &res, vsapi);
+
+        const int64_t trace = vspl_trace_begin();
+        bool ok = vspl_tonemap_reconfig(tm_data->vf, s, planes, dst_fmt, &res, core, vsapi);
+        vspl_trace_end(VSPL_TRACE_RECONFIG, trace);
+        if (ok) {
+            vspl_tonemap_filter(tm_data, s, n, dst, planes, core, vsapi, src_repr, dst_repr,
+                                src_pl_csp, dst_pl_csp, chroma_loc, dst_chroma_loc, &raw_hdr, &res);
+        } else if (tm_data->order) {
+            vspl_order_cancel(tm_data->order, n);
         }
 
-        p2p_unpack_frame(&pack_params, 0);
-        free(packed_dst);
+        vspl_resident_unref(&res, vsapi);
+        vspl_resident_export(tm_data->vf, dst, (pl_tex *[MAX_PLANES]) {&s->tex_out[0], &s->tex_out[1], &s->tex_out[2]},
+                             core, vsapi);
+        vspl_slot_profile(tm_data->vf, s, dst, vsapi);
+        vspl_slot_release(tm_data->vf, s);
 
-        #if PL_API_VER >= 185
-            if (dovi_meta)
-                free((void *) dovi_meta);
-        #endif
+#ifdef HAVE_DOVI
+        vspl_dovi_cache_release(tm_data->dovi_cache, dovi_meta);
+#endif
 
         vsapi->freeFrame(frame);
         return dst;
+    } else if (activationReason == arError) {
+        if (tm_data->order)
+            vspl_order_cancel(tm_data->order, n);
     }
 
     return 0;
@@ -463,13 +750,20 @@ static const VSFrame *VS_CC VSPlaceboTMGetFrame(int n, int activationReason, voi
 static void VS_CC VSPlaceboTMFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     TMData *tm_data = (TMData *) instanceData;
     vsapi->freeNode(tm_data->node);
+    pl_renderer_destroy(&tm_data->rr);
+    vspl_order_destroy(&tm_data->order);
+    vspl_hdr_tracker_destroy(&tm_data->hdr_tracker, tm_data->vf->log, "placebo.Tonemap");
     VSPlaceboUninit(tm_data->vf);
+#ifdef HAVE_DOVI
+    vspl_dovi_cache_destroy(&tm_data->dovi_cache);
+#endif
 
     free((void *) tm_data->src_pl_csp);
     free((void *) tm_data->dst_pl_csp);
     free((void *) tm_data->renderParams->peak_detect_params);
     free((void *) tm_data->renderParams->color_map_params);
     free(tm_data->renderParams);
+    free(tm_data->scene_stats);
 
     free(tm_data);
 }
@@ -478,11 +772,9 @@ void VS_CC VSPlaceboTMCreate(const VSMap *in, VSMap *out, void *userData, VSCore
     TMData d;
     TMData *tm_data;
     int err;
-    enum pl_log_level log_level;
-
-    log_level = vsapi->mapGetInt(in, "log_level", 0, &err);
-    if (err)
-        log_level = PL_LOG_ERR;
+    struct vspl_init_params init_params;
+    vspl_init_params_read(&init_params, in, core, vsapi);
+    d.trace_id = vspl_trace_id();
 
     d.node = vsapi->mapGetNode(in, "clip", 0, 0);
     d.vi = vsapi->getVideoInfo(d.node);
@@ -493,70 +785,50 @@ void VS_CC VSPlaceboTMCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         core
     );
 
-    d.vf = VSPlaceboInit(log_level);
-
-    if (d.vi->format.bitsPerSample != 16) {
-        vsapi->mapSetError(out, "placebo.Tonemap: Input must be 16 bits per sample!");
+    // Float YUV has its chroma centered around 0, which libplacebo doesn't
+    // know how to decode
+    const VSVideoFormat *src_fmt = &d.vi->format;
+    if ((src_fmt->colorFamily != cfRGB && src_fmt->colorFamily != cfYUV) || !vspl_format_supported(src_fmt) ||
+        (src_fmt->sampleType == stFloat && src_fmt->colorFamily != cfRGB)) {
+        vsapi->mapSetError(out, "placebo.Tonemap: Input must be 8-16 bit integer RGB/YUV or 32 bit float RGB!");
         vsapi->freeNode(d.node);
         return;
     }
 
-    struct pl_color_map_params *colorMapParams = malloc(sizeof(struct pl_color_map_params));
-    *colorMapParams = pl_color_map_default_params;
+    int64_t format_id = vsapi->mapGetInt(in, "format", 0, &err);
+    if (!err) {
+        VSVideoFormat dst_fmt;
+        if (!vsapi->getVideoFormatByID(&dst_fmt, format_id, core) ||
+            dst_fmt.colorFamily != src_fmt->colorFamily ||
+            !vspl_format_supported(&dst_fmt) ||
+            (dst_fmt.sampleType == stFloat && dst_fmt.colorFamily != cfRGB)) {
+            vsapi->mapSetError(out, "placebo.Tonemap: Output format must have the input's color family "
+                                    "and be 8-16 bit integer, or 32 bit float for RGB!");
+            vsapi->freeNode(d.node);
+            return;
+        }
 
-    // Gamut mapping function
-    int64_t gamut_map_index = vsapi->mapGetInt(in, "gamut_mapping", 0, &err);
-    if (!err && gamut_map_index >= 0 && gamut_map_index < pl_num_gamut_map_functions) {
-        colorMapParams->gamut_mapping = pl_gamut_map_functions[gamut_map_index];
-    }
+        if ((d.vi->width % (1 << dst_fmt.subSamplingW)) || (d.vi->height % (1 << dst_fmt.subSamplingH))) {
+            vsapi->mapSetError(out, "placebo.Tonemap: Clip dimensions must be divisible by the output subsampling!");
+            vsapi->freeNode(d.node);
+            return;
+        }
 
-    // Tone mapping function
-    int64_t function_index = vsapi->mapGetInt(in, "tone_mapping_function", 0, &err);
-    if (!err && function_index >= 0 && function_index < pl_num_tone_map_functions) {
-        colorMapParams->tone_mapping_function = pl_tone_map_functions[function_index];
+        d.vi_out.format = dst_fmt;
     }
 
-    const char *function_name = vsapi->mapGetData(in, "tone_mapping_function_s", 0, &err);
-    if (function_name && !err) {
-        const struct pl_tone_map_function *tm_function = pl_find_tone_map_function(function_name);
-        if (tm_function)
-            colorMapParams->tone_mapping_function = tm_function;
-    }
-
-    const double tone_mapping_param = vsapi->mapGetFloat(in, "tone_mapping_param", 0, &err);
-    colorMapParams->tone_mapping_param = tone_mapping_param;
+    d.dst_chroma_loc = vsapi->mapGetIntSaturated(in, "dst_chroma_loc", 0, &err);
+    if (err)
+        d.dst_chroma_loc = -1;
 
-    if (err) {
-        // Set default param from selected function
-        colorMapParams->tone_mapping_param = colorMapParams->tone_mapping_function->param_def;
+    if (d.dst_chroma_loc < -1 || d.dst_chroma_loc > 5) {
+        vsapi->mapSetError(out, "placebo.Tonemap: dst_chroma_loc must be between 0 and 5!");
+        vsapi->freeNode(d.node);
+        return;
     }
 
-#define COLORM_PARAM(par, type) colorMapParams->par = vsapi->mapGet##type(in, #par, 0, &err); \
-        if (err) colorMapParams->par = pl_color_map_default_params.par;
-
-#if PL_API_VER >= 247
-    COLORM_PARAM(visualize_lut, Int)
-#endif
-#if PL_API_VER >= 261
-    COLORM_PARAM(metadata, Int)
-#endif
-#if PL_API_VER >= 264
-    COLORM_PARAM(show_clipping, Int)
-#endif
-    COLORM_PARAM(contrast_recovery, Float)
-
-    struct pl_peak_detect_params *peakDetectParams = malloc(sizeof(struct pl_peak_detect_params));
-    *peakDetectParams = pl_peak_detect_default_params;
-
-#define PEAK_PARAM(par, type) peakDetectParams->par = vsapi->mapGet##type(in, #par, 0, &err); \
-        if (err) peakDetectParams->par = pl_peak_detect_default_params.par;
-
-    PEAK_PARAM(smoothing_period, Float)
-    PEAK_PARAM(scene_threshold_low, Float)
-    PEAK_PARAM(scene_threshold_high, Float)
-#if PL_API_VER >= 264
-    PEAK_PARAM(percentile, Float)
-#endif
+    struct pl_color_map_params *colorMapParams = vspl_color_map_params_read(in, vsapi);
+    struct pl_peak_detect_params *peakDetectParams = vspl_peak_detect_params_read(in, vsapi);
 
     struct pl_color_space *src_pl_csp = malloc((sizeof(struct pl_color_space)));
     struct pl_color_space *dst_pl_csp = malloc((sizeof(struct pl_color_space)));
@@ -580,33 +852,15 @@ void VS_CC VSPlaceboTMCreate(const VSMap *in, VSMap *out, void *userData, VSCore
         return;
     }
 
-    switch (src_csp) {
-        case CSP_HDR10:
-        case CSP_DOVI:
-            *src_pl_csp = pl_color_space_hdr10;
-            break;
-        case CSP_HLG:
-            *src_pl_csp = pl_color_space_bt2020_hlg;
-            break;
-        default:
-            vsapi->mapSetError(out, "Invalid source colorspace for tonemapping.\n");
-            return;
-    };
+    if (src_csp == CSP_SDR || !vspl_color_space_from_csp(src_csp, src_pl_csp)) {
+        vsapi->mapSetError(out, "Invalid source colorspace for tonemapping.\n");
+        return;
+    }
 
-    switch (dst_csp) {
-        case CSP_SDR:
-            *dst_pl_csp = pl_color_space_bt709;
-            break;
-        case CSP_HDR10:
-            *dst_pl_csp = pl_color_space_hdr10;
-            break;
-        case CSP_HLG:
-            *dst_pl_csp = pl_color_space_bt2020_hlg;
-            break;
-        default:
-            vsapi->mapSetError(out, "Invalid target colorspace for tonemapping.\n");
-            return;
-    };
+    if (dst_csp == CSP_DOVI || !vspl_color_space_from_csp(dst_csp, dst_pl_csp)) {
+        vsapi->mapSetError(out, "Invalid target colorspace for tonemapping.\n");
+        return;
+    }
 
     const float src_max = vsapi->mapGetFloat(in, "src_max", 0, &err);
     const float src_min = vsapi->mapGetFloat(in, "src_min", 0, &err);
@@ -625,10 +879,46 @@ void VS_CC VSPlaceboTMCreate(const VSMap *in, VSMap *out, void *userData, VSCore
     if (err)
         peak_detection = 1;
 
+    // Scenes measured ahead of time replace the peak detection, which makes
+    // the output independent of the order frames are rendered in
+    d.scene_stats = NULL;
+    d.num_scene_stats = 0;
+
+    const char *stats_path = vsapi->mapGetData(in, "stats_file", 0, &err);
+    if (!err) {
+        struct vspl_stats *stats = vspl_stats_open(stats_path);
+        struct vspl_stats_clip clip;
+        char fingerprint_err[256] = "placebo.Tonemap: stats_file must be written by placebo.Analyze on this clip!";
+        if (!stats || !vspl_stats_fingerprint(&clip, d.node, fingerprint_err, sizeof(fingerprint_err), core, vsapi) ||
+            memcmp(vspl_stats_get_clip(stats), &clip, sizeof(clip)) != 0) {
+            vsapi->mapSetError(out, fingerprint_err);
+            vsapi->freeNode(d.node);
+            vspl_stats_close(&stats);
+            free((void *) colorMapParams);
+            free((void *) peakDetectParams);
+            free((void *) src_pl_csp);
+            free((void *) dst_pl_csp);
+            return;
+        }
+
+        if (!vspl_stats_complete(stats))
+            vsapi->logMessage(mtWarning, "placebo.Tonemap: stats_file is incomplete, frames that weren't analyzed "
+                                         "use the clip's metadata\n", core);
+
+        d.scene_stats = vspl_stats_scenes(stats, peakDetectParams->scene_threshold_high);
+        d.num_scene_stats = vspl_stats_num_frames(stats);
+        vspl_stats_close(&stats);
+        peak_detection = 0;
+    }
+
     bool use_dovi = vsapi->mapGetInt(in, "use_dovi", 0, &err);
     if (err)
         use_dovi = src_csp == CSP_DOVI;
 
+    d.metadata_steps = vsapi->mapGetIntSaturated(in, "metadata_steps", 0, &err);
+    if (err)
+        d.metadata_steps = VSPL_HDR_QUANTIZE_STEPS;
+
     struct pl_render_params *renderParams = malloc(sizeof(struct pl_render_params));
     *renderParams = pl_render_default_params;
 
@@ -648,9 +938,58 @@ void VS_CC VSPlaceboTMCreate(const VSMap *in, VSMap *out, void *userData, VSCore
     d.original_src_max = src_max;
     d.original_src_min = src_min;
     d.is_subsampled = d.vi->format.subSamplingW || d.vi->format.subSamplingH;
+    d.dst_subsampled = d.vi_out.format.subSamplingW || d.vi_out.format.subSamplingH;
     d.use_dovi = use_dovi;
 
+    d.vf = VSPlaceboInit(&init_params);
+    if (!d.vf) {
+        vsapi->mapSetError(out, "placebo.Tonemap: Failed initializing libplacebo!");
+        vsapi->freeNode(d.node);
+        free((void *) colorMapParams);
+        free((void *) peakDetectParams);
+        free((void *) src_pl_csp);
+        free((void *) dst_pl_csp);
+        free(renderParams);
+        free(d.scene_stats);
+        return;
+    }
+
+    // The peak detection state lives in the renderer, and only makes sense if
+    // it sees the frames in order. Render them all with one renderer, in
+    // order, while the slots keep uploading and downloading in parallel.
+    d.rr = NULL;
+    d.order = NULL;
+
+    if (peak_detection) {
+        d.rr = pl_renderer_create(d.vf->log, d.vf->gpu);
+        if (!d.rr) {
+            vsapi->mapSetError(out, "placebo.Tonemap: Failed creating renderer!");
+            vsapi->freeNode(d.node);
+            VSPlaceboUninit(d.vf);
+            free((void *) colorMapParams);
+            free((void *) peakDetectParams);
+            free((void *) src_pl_csp);
+            free((void *) dst_pl_csp);
+            free(renderParams);
+            free(d.scene_stats);
+            return;
+        }
+
+        d.order = vspl_order_create(d.vi->numFrames, core, vsapi);
+    }
+
+#ifdef HAVE_DOVI
+    d.dovi_cache = use_dovi ? vspl_dovi_cache_create(d.vi->numFrames) : NULL;
+#endif
+
+    d.hdr_tracker = vspl_hdr_tracker_create(1 + d.vf->num_slots);
+
     VSFilterDependency deps[] = {{d.node, rpStrictSpatial}};
+#ifdef HAVE_DOVI
+    // Also requests the previous frame, for its RPU
+    if (d.dovi_cache)
+        deps[0].requestPattern = rpGeneral;
+#endif
 
     tm_data = malloc(sizeof(d));
     *tm_data = d;
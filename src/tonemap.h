@@ -1,8 +1,67 @@
 #ifndef VS_PLACEBO_TONEMAP_H
 #define VS_PLACEBO_TONEMAP_H
 
+#include <stdatomic.h>
+#include <stdbool.h>
+
 #include <VapourSynth4.h>
 
+#include <libplacebo/colorspace.h>
+#include <libplacebo/log.h>
+#include <libplacebo/shaders/colorspace.h>
+
+enum supported_colorspace {
+    CSP_SDR = 0,
+    CSP_HDR10,
+    CSP_HLG,
+    CSP_DOVI,
+};
+
+// Parse the tone/gamut mapping and peak detection arguments shared by the
+// filters that map colors. The results are malloc'd.
+struct pl_color_map_params *vspl_color_map_params_read(const VSMap *in, const VSAPI *vsapi);
+struct pl_peak_detect_params *vspl_peak_detect_params_read(const VSMap *in, const VSAPI *vsapi);
+
+// Translate a `src_csp`/`dst_csp` argument, returns false if it's unknown
+bool vspl_color_space_from_csp(int csp, struct pl_color_space *out);
+
+// Update the HDR metadata of `csp` from the frame props. The mastering display
+// luminance is only read if requested, so it can be overridden by the user.
+void vspl_hdr_metadata_read(const VSMap *props, struct pl_color_space *csp, bool max_luma, bool min_luma,
+                            const VSAPI *vsapi);
+
+// The dynamic per-frame metadata (frame and scene brightness) is rounded to a
+// grid of `steps` PQ levels (0 to keep it as is), so that values which only
+// jitter between frames render the same, instead of making the renderer
+// regenerate its tone mapping LUT each frame. Static metadata is left alone.
+#define VSPL_HDR_QUANTIZE_STEPS 1023
+
+void vspl_hdr_metadata_quantize(struct pl_hdr_metadata *hdr, int steps);
+
+// Counts how often the metadata a renderer gets changes from its previous
+// frame, which is when it has to regenerate its LUT (and possibly shader).
+// Renderer 0 is the shared one, used with peak detection, the others belong
+// to the slots. Each renderer is only ever updated by one frame at a time.
+struct vspl_hdr_tracker {
+    atomic_uint_fast64_t frames;
+    atomic_uint_fast64_t changes;
+    // Changes of the raw metadata that quantizing turned into none
+    atomic_uint_fast64_t merged;
+
+    int num_renderers;
+    struct vspl_hdr_last {
+        bool valid;
+        struct pl_hdr_metadata raw;
+        struct pl_hdr_metadata used;
+    } last[];
+};
+
+// Returns NULL if out of memory, the changes then just aren't counted
+struct vspl_hdr_tracker *vspl_hdr_tracker_create(int num_renderers);
+void vspl_hdr_tracker_update(struct vspl_hdr_tracker *tracker, int renderer,
+                             const struct pl_hdr_metadata *raw, const struct pl_hdr_metadata *used);
+void vspl_hdr_tracker_destroy(struct vspl_hdr_tracker **tracker, pl_log log, const char *name);
+
 void VS_CC VSPlaceboTMCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi);
 
 #endif //VS_PLACEBO_TONEMAP_H
@@ -0,0 +1,164 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "profile.h"
+#include "trace.h"
+
+struct vspl_trace_event {
+    const char *name;
+    const char *node;
+    int id;
+    int frame;
+    int64_t start;
+    int64_t end;
+};
+
+struct vspl_trace_buf {
+    struct vspl_trace_buf *next;
+    int tid;
+
+    // Only ever written by the owning thread, and read once it's done
+    atomic_uint_fast64_t head;
+    struct vspl_trace_event events[VSPL_TRACE_EVENTS];
+};
+
+static atomic_bool vspl_trace_on;
+static char *vspl_trace_path;
+static int64_t vspl_trace_epoch;
+
+static _Atomic(struct vspl_trace_buf *) vspl_trace_bufs;
+static atomic_int vspl_trace_threads;
+static atomic_int vspl_trace_ids;
+
+static _Thread_local struct vspl_trace_buf *vspl_trace_tls;
+static _Thread_local const char *vspl_trace_node;
+static _Thread_local int vspl_trace_node_id;
+static _Thread_local int vspl_trace_n;
+
+static void vspl_trace_flush(void);
+
+void vspl_trace_init(void)
+{
+    const char *path = getenv("VSPLACEBO_TRACE");
+    if (!path || !path[0] || vspl_trace_path)
+        return;
+
+    const size_t len = strlen(path) + 1;
+    vspl_trace_path = malloc(len);
+    if (!vspl_trace_path)
+        return;
+    memcpy(vspl_trace_path, path, len);
+
+    vspl_trace_epoch = vspl_profile_now();
+
+    // Within a shared library, this runs when it gets unloaded as well
+    atexit(vspl_trace_flush);
+    atomic_store(&vspl_trace_on, true);
+}
+
+static struct vspl_trace_buf *vspl_trace_buf_get(void)
+{
+    struct vspl_trace_buf *buf = vspl_trace_tls;
+    if (buf)
+        return buf;
+
+    buf = calloc(1, sizeof(*buf));
+    if (!buf)
+        return NULL;
+
+    buf->tid = atomic_fetch_add(&vspl_trace_threads, 1) + 1;
+    buf->next = atomic_load(&vspl_trace_bufs);
+    while (!atomic_compare_exchange_weak(&vspl_trace_bufs, &buf->next, buf))
+        ;
+
+    vspl_trace_tls = buf;
+    return buf;
+}
+
+int vspl_trace_id(void)
+{
+    return atomic_fetch_add(&vspl_trace_ids, 1) + 1;
+}
+
+void vspl_trace_frame(const char *node, int id, int n)
+{
+    if (!atomic_load_explicit(&vspl_trace_on, memory_order_relaxed))
+        return;
+
+    vspl_trace_node = node;
+    vspl_trace_node_id = id;
+    vspl_trace_n = n;
+}
+
+int64_t vspl_trace_begin(void)
+{
+    if (!atomic_load_explicit(&vspl_trace_on, memory_order_relaxed))
+        return 0;
+    return vspl_profile_now();
+}
+
+void vspl_trace_end(const char *name, int64_t start)
+{
+    if (!start || !atomic_load_explicit(&vspl_trace_on, memory_order_relaxed))
+        return;
+
+    struct vspl_trace_buf *buf = vspl_trace_buf_get();
+    if (!buf)
+        return;
+
+    const uint64_t head = atomic_load_explicit(&buf->head, memory_order_relaxed);
+    buf->events[head % VSPL_TRACE_EVENTS] = (struct vspl_trace_event) {
+        .name = name,
+        .node = vspl_trace_node ? vspl_trace_node : "placebo",
+        .id = vspl_trace_node ? vspl_trace_node_id : 0,
+        .frame = vspl_trace_n,
+        .start = start,
+        .end = vspl_profile_now(),
+    };
+    atomic_store_explicit(&buf->head, head + 1, memory_order_release);
+}
+
+// The buffers are deliberately never freed: a thread that got past the check
+// in vspl_trace_end may still be writing to its buffer, and every thread
+// keeps pointing at its own
+static void vspl_trace_flush(void)
+{
+    atomic_store(&vspl_trace_on, false);
+
+    FILE *f = fopen(vspl_trace_path, "w");
+    if (!f) {
+        fprintf(stderr, "vs-placebo: Failed writing trace '%s'\n", vspl_trace_path);
+    } else {
+        const int pid = (int) getpid();
+        bool first = true;
+
+        fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+        for (struct vspl_trace_buf *buf = atomic_load(&vspl_trace_bufs); buf; buf = buf->next) {
+            fprintf(f, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+                    "\"args\": {\"name\": \"thread %d\"}}", first ? "" : ",", pid, buf->tid, buf->tid);
+            first = false;
+
+            const uint64_t head = atomic_load_explicit(&buf->head, memory_order_acquire);
+            const uint64_t tail = head > VSPL_TRACE_EVENTS ? head - VSPL_TRACE_EVENTS : 0;
+            for (uint64_t i = tail; i < head; i++) {
+                const struct vspl_trace_event *ev = &buf->events[i % VSPL_TRACE_EVENTS];
+                fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+                        "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"node\": \"%s #%d\", \"frame\": %d}}",
+                        ev->name, ev->node, pid, buf->tid, (ev->start - vspl_trace_epoch) / 1e3,
+                        (ev->end - ev->start) / 1e3, ev->node, ev->id, ev->frame);
+            }
+        }
+        fprintf(f, "\n]}\n");
+        fclose(f);
+    }
+}
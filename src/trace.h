@@ -0,0 +1,39 @@
+#ifndef VS_PLACEBO_TRACE_H
+#define VS_PLACEBO_TRACE_H
+
+#include <stdint.h>
+
+// Timeline of what every thread did for which frame, written as a
+// Chrome/Perfetto JSON trace when the plugin is unloaded or the process
+// exits. Enabled by pointing the VSPLACEBO_TRACE environment variable at the
+// file to write. Each thread records into its own ring buffer, so recording
+// takes no locks; only the last VSPL_TRACE_EVENTS events of each thread are
+// kept.
+#define VSPL_TRACE_EVENTS (1 << 15)
+
+// Event names
+#define VSPL_TRACE_WAIT     "wait"
+#define VSPL_TRACE_ORDER    "order"
+#define VSPL_TRACE_RECONFIG "reconfig"
+#define VSPL_TRACE_UPLOAD   "upload"
+#define VSPL_TRACE_RENDER   "render"
+#define VSPL_TRACE_DOWNLOAD "download"
+#define VSPL_TRACE_CPU      "cpu"
+
+// Reads the environment, called once when the plugin gets loaded
+void vspl_trace_init(void);
+
+// A new number for a filter instance, so the events of several instances of
+// the same filter can be told apart. Taken whether or not tracing is on.
+int vspl_trace_id(void);
+
+// Attributes the following events of this thread to frame `n` of instance
+// `id` of the filter `node`, which has to be a string literal
+void vspl_trace_frame(const char *node, int id, int n);
+
+// Returns 0 when tracing is off, in which case vspl_trace_end does nothing
+int64_t vspl_trace_begin(void);
+// Records the event `name`, a string literal, as lasting since `start`
+void vspl_trace_end(const char *name, int64_t start);
+
+#endif //VS_PLACEBO_TRACE_H
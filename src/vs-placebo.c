@@ -1,5 +1,8 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include <VapourSynth4.h>
@@ -9,20 +12,79 @@
 #include "tonemap.h"
 #include "resample.h"
 #include "shader.h"
+#include "render.h"
+#include "analyze.h"
 
-pthread_mutex_t vspl_vulkan_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t vspl_context_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct vspl_context *vspl_contexts;
 
-void *VSPlaceboInit(enum pl_log_level log_level) {
-    struct priv *p = calloc(1, sizeof(struct priv));
-    if (!p)
+static int vspl_default_inflight(VSCore *core, const VSAPI *vsapi)
+{
+    VSCoreInfo info;
+    vsapi->getCoreInfo(core, &info);
+    return info.numThreads < MAX_INFLIGHT ? info.numThreads : MAX_INFLIGHT;
+}
+
+void vspl_init_params_read(struct vspl_init_params *params, const VSMap *in, VSCore *core, const VSAPI *vsapi)
+{
+    int err;
+
+    params->log_level = vsapi->mapGetInt(in, "log_level", 0, &err);
+    if (err)
+        params->log_level = PL_LOG_ERR;
+
+    params->device = vsapi->mapGetData(in, "device", 0, &err);
+    if (params->device && !params->device[0])
+        params->device = NULL;
+
+    params->cache_dir = vsapi->mapGetData(in, "cache_dir", 0, &err);
+    if (err)
+        params->cache_dir = getenv("VSPLACEBO_CACHE_DIR");
+    if (params->cache_dir && !params->cache_dir[0])
+        params->cache_dir = NULL;
+
+    params->inflight = vsapi->mapGetIntSaturated(in, "inflight", 0, &err);
+    if (err)
+        params->inflight = vspl_default_inflight(core, vsapi);
+
+    params->resident = vsapi->mapGetInt(in, "resident", 0, &err);
+    if (err)
+        params->resident = false;
+
+    params->profile = vsapi->mapGetInt(in, "profile", 0, &err);
+    if (err)
+        params->profile = false;
+}
+
+static void vspl_context_destroy(struct vspl_context *ctx)
+{
+    vspl_tex_pool_destroy(&ctx->pool);
+    vspl_cache_close(&ctx->cache);
+    pl_vulkan_destroy(&ctx->vk);
+    pl_log_destroy(&ctx->log);
+    pthread_mutex_destroy(&ctx->resident_lock);
+    free(ctx->device);
+    free(ctx->cache_dir);
+    free(ctx);
+}
+
+static struct vspl_context *vspl_context_create(const struct vspl_init_params *params)
+{
+    struct vspl_context *ctx = calloc(1, sizeof(struct vspl_context));
+    if (!ctx)
         return NULL;
 
-    p->log = pl_log_create(PL_API_VER, pl_log_params(
+    pthread_mutex_init(&ctx->resident_lock, NULL);
+    ctx->log_level = params->log_level;
+    ctx->device = params->device ? strdup(params->device) : NULL;
+    ctx->cache_dir = params->cache_dir ? strdup(params->cache_dir) : NULL;
+
+    ctx->log = pl_log_create(PL_API_VER, pl_log_params(
         .log_cb = pl_log_color,
-        .log_level = log_level
+        .log_level = params->log_level
     ));
 
-    if (!p->log) {
+    if (!ctx->log) {
         fprintf(stderr, "Failed initializing libplacebo\n");
         goto error;
     }
@@ -30,30 +92,180 @@ void *VSPlaceboInit(enum pl_log_level log_level) {
     struct pl_vulkan_params vp = pl_vulkan_default_params;
     struct pl_vk_inst_params ip = pl_vk_inst_default_params;
     vp.allow_software = true;
+    vp.device_name = ctx->device;
+    // Let transfers and shaders of different frames overlap on separate queues
+    vp.async_transfer = true;
+    vp.async_compute = true;
 //    ip.debug = true;
     vp.instance_params = &ip;
-    p->vk = pl_vulkan_create(p->log, &vp);
+    ctx->vk = pl_vulkan_create(ctx->log, &vp);
 
-    if (!p->vk) {
+    if (!ctx->vk) {
         fprintf(stderr, "Failed creating vulkan context\n");
         goto error;
     }
 
     // Give this a shorter name for convenience
-    p->gpu = p->vk->gpu;
+    ctx->gpu = ctx->vk->gpu;
 
-    p->dp = pl_dispatch_create(p->log, p->gpu);
-    if (!p->dp) {
-        fprintf(stderr, "Failed creating shader dispatch object\n");
+    // Attach the shader cache before anything gets compiled. Without a
+    // cache_dir, it only keeps count of the compilations.
+    ctx->cache = vspl_cache_open(ctx->log, ctx->gpu, ctx->cache_dir);
+
+    ctx->pool = vspl_tex_pool_create(ctx->gpu, VSPL_TEX_POOL_MAX_BYTES);
+    if (!ctx->pool) {
+        fprintf(stderr, "Failed creating texture pool\n");
         goto error;
     }
 
-    p->rr = pl_renderer_create(p->log, p->gpu);
-    if (!p->rr) {
+    vspl_counter_add(VSPL_COUNTER_CONTEXTS, 1);
+    return ctx;
+
+error:
+    vspl_context_destroy(ctx);
+    return NULL;
+}
+
+static bool vspl_str_equal(const char *a, const char *b)
+{
+    if (!a || !b)
+        return a == b;
+    return strcmp(a, b) == 0;
+}
+
+static bool vspl_context_matches(const struct vspl_context *ctx, const struct vspl_init_params *params)
+{
+    return ctx->log_level == params->log_level &&
+           vspl_str_equal(ctx->device, params->device) &&
+           vspl_str_equal(ctx->cache_dir, params->cache_dir);
+}
+
+struct vspl_context *vspl_context_acquire(const struct vspl_init_params *params)
+{
+    vspl_lock(&vspl_context_mutex);
+
+    struct vspl_context *ctx = vspl_contexts;
+    while (ctx && !vspl_context_matches(ctx, params))
+        ctx = ctx->next;
+
+    if (!ctx) {
+        ctx = vspl_context_create(params);
+        if (ctx) {
+            ctx->next = vspl_contexts;
+            vspl_contexts = ctx;
+        }
+    }
+
+    if (ctx)
+        ctx->refcount++;
+
+    pthread_mutex_unlock(&vspl_context_mutex);
+    return ctx;
+}
+
+void vspl_context_ref(struct vspl_context *ctx)
+{
+    vspl_lock(&vspl_context_mutex);
+    ctx->refcount++;
+    pthread_mutex_unlock(&vspl_context_mutex);
+}
+
+void vspl_context_release(struct vspl_context *ctx)
+{
+    if (!ctx)
+        return;
+
+    vspl_lock(&vspl_context_mutex);
+
+    if (--ctx->refcount > 0) {
+        pthread_mutex_unlock(&vspl_context_mutex);
+        return;
+    }
+
+    struct vspl_context **link = &vspl_contexts;
+    while (*link != ctx)
+        link = &(*link)->next;
+    *link = ctx->next;
+
+    pthread_mutex_unlock(&vspl_context_mutex);
+
+    vspl_context_destroy(ctx);
+}
+
+static bool vspl_slot_init(struct priv *p, struct vspl_slot *s)
+{
+    s->dp = pl_dispatch_create(p->log, p->gpu);
+    if (!s->dp) {
+        fprintf(stderr, "Failed creating shader dispatch object\n");
+        return false;
+    }
+
+    s->rr = pl_renderer_create(p->log, p->gpu);
+    if (!s->rr) {
         fprintf(stderr, "Failed creating renderer\n");
-        goto error;
+        pl_dispatch_destroy(&s->dp);
+        return false;
+    }
+
+    if (p->profile) {
+        vspl_profile_init(p->gpu, &s->prof);
+        pl_dispatch_callback(s->dp, &s->prof, vspl_profile_dispatch_cb);
+        s->xfer.prof = &s->prof;
+    }
+
+    s->initialized = true;
+    return true;
+}
+
+static void vspl_slot_uninit(struct priv *p, struct vspl_slot *s)
+{
+    for (int i = 0; i < MAX_PLANES; i++) {
+        vspl_tex_pool_put(p->pool, &s->tex_in[i]);
+        vspl_tex_pool_put(p->pool, &s->tex_out[i]);
     }
 
+    for (int i = 0; i < MAX_PLANES * 2; i++)
+        vspl_tex_pool_put(p->pool, &s->tex_tmp[i]);
+
+    pl_renderer_destroy(&s->rr);
+    pl_mpv_user_shader_destroy(&s->hook);
+    pl_shader_obj_destroy(&s->lut);
+    pl_shader_obj_destroy(&s->dither_state);
+    pl_dispatch_destroy(&s->dp);
+    if (p->profile) {
+        vspl_profile_uninit(p->gpu, &s->prof);
+        s->xfer.prof = NULL;
+    }
+    s->initialized = false;
+}
+
+void *VSPlaceboInit(const struct vspl_init_params *params) {
+    struct priv *p = calloc(1, sizeof(struct priv));
+    if (!p)
+        return NULL;
+
+    vspl_counter_add(VSPL_COUNTER_INSTANCES, 1);
+
+    const int inflight = params->inflight;
+    p->num_slots = inflight < 1 ? 1 : inflight > MAX_INFLIGHT ? MAX_INFLIGHT : inflight;
+    pthread_mutex_init(&p->slots_lock, NULL);
+    pthread_cond_init(&p->slot_free, NULL);
+
+    p->ctx = vspl_context_acquire(params);
+    if (!p->ctx)
+        goto error;
+
+    p->log = p->ctx->log;
+    p->gpu = p->ctx->gpu;
+    p->pool = p->ctx->pool;
+    p->resident = params->resident;
+    p->profile = params->profile;
+
+    // The other slots are only set up once enough frames are in flight to
+    // need them, but make sure the first one works up front
+    if (!vspl_slot_init(p, &p->slots[0]))
+        goto error;
+
     return p;
 
 error:
@@ -64,21 +276,402 @@ error:
 void VSPlaceboUninit(void *priv)
 {
     struct priv *p = priv;
-    for (int i = 0; i < MAX_PLANES; i++) {
-        pl_tex_destroy(p->gpu, &p->tex_in[i]);
-        pl_tex_destroy(p->gpu, &p->tex_out[i]);
+    for (int i = 0; i < MAX_INFLIGHT; i++) {
+        if (p->slots[i].initialized)
+            vspl_slot_uninit(p, &p->slots[i]);
     }
 
-    pl_renderer_destroy(&p->rr);
-    pl_shader_obj_destroy(&p->dither_state);
-    pl_dispatch_destroy(&p->dp);
-    pl_vulkan_destroy(&p->vk);
-    pl_log_destroy(&p->log);
+    pthread_cond_destroy(&p->slot_free);
+    pthread_mutex_destroy(&p->slots_lock);
 
+    vspl_context_release(p->ctx);
     free(p);
+    vspl_counter_add(VSPL_COUNTER_INSTANCES, -1);
+}
+
+bool vspl_backend_read(enum vspl_backend *backend, const VSMap *in, const VSAPI *vsapi)
+{
+    int err;
+    const char *name = vsapi->mapGetData(in, "backend", 0, &err);
+    if (err) {
+        *backend = VSPL_BACKEND_GPU;
+        return true;
+    }
+
+    if (!strcmp(name, "gpu")) {
+        *backend = VSPL_BACKEND_GPU;
+    } else if (!strcmp(name, "cpu")) {
+        *backend = VSPL_BACKEND_CPU;
+    } else if (!strcmp(name, "auto")) {
+        *backend = VSPL_BACKEND_AUTO;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+void *vspl_backend_init(enum vspl_backend *backend, const struct vspl_init_params *params)
+{
+    if (*backend == VSPL_BACKEND_CPU)
+        return NULL;
+
+    struct priv *p = VSPlaceboInit(params);
+
+    if (*backend == VSPL_BACKEND_AUTO) {
+        if (p && vspl_gpu_is_software(p)) {
+            VSPlaceboUninit(p);
+            p = NULL;
+        }
+
+        *backend = p ? VSPL_BACKEND_GPU : VSPL_BACKEND_CPU;
+    }
+
+    return p;
+}
+
+bool vspl_gpu_is_software(const struct priv *p)
+{
+    pl_vulkan vk = p->ctx->vk;
+    PFN_vkGetPhysicalDeviceProperties get_props = (PFN_vkGetPhysicalDeviceProperties)
+        vk->get_proc_addr(vk->instance, "vkGetPhysicalDeviceProperties");
+    if (!get_props)
+        return false;
+
+    VkPhysicalDeviceProperties props;
+    get_props(vk->phys_device, &props);
+    return props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+}
+
+struct vspl_slot *vspl_slot_acquire(struct priv *p)
+{
+    struct vspl_slot *s = NULL;
+    const int64_t wait_start = p->profile ? vspl_profile_now() : 0;
+    const int64_t trace = vspl_trace_begin();
+
+    vspl_lock(&p->slots_lock);
+    for (;;) {
+        // Prefer the lowest free slot, so the higher ones only get created
+        // when that many frames are actually in flight at the same time
+        for (int i = 0; i < p->num_slots && !s; i++) {
+            if (!p->slots[i].in_use)
+                s = &p->slots[i];
+        }
+
+        if (s)
+            break;
+        pthread_cond_wait(&p->slot_free, &p->slots_lock);
+    }
+    s->in_use = true;
+    pthread_mutex_unlock(&p->slots_lock);
+
+    if (!s->initialized && !vspl_slot_init(p, s)) {
+        // Fall back to the slot that is known to work
+        vspl_lock(&p->slots_lock);
+        s->in_use = false;
+        pthread_cond_broadcast(&p->slot_free);
+
+        s = &p->slots[0];
+        while (s->in_use)
+            pthread_cond_wait(&p->slot_free, &p->slots_lock);
+        s->in_use = true;
+        pthread_mutex_unlock(&p->slots_lock);
+    }
+
+    vspl_trace_end(VSPL_TRACE_WAIT, trace);
+
+    if (p->profile)
+        vspl_profile_begin(&s->prof, wait_start);
+
+    return s;
+}
+
+void vspl_slot_release(struct priv *p, struct vspl_slot *slot)
+{
+    // Normally already done by the frame, but on errors make sure nothing
+    // still references the frame's memory once it gets freed
+    if (atomic_load(&slot->xfer.pending) > 0 || slot->xfer.num_bufs)
+        vspl_download_wait(p->gpu, &slot->xfer);
+
+    vspl_lock(&p->slots_lock);
+    slot->in_use = false;
+    pthread_cond_broadcast(&p->slot_free);
+    pthread_mutex_unlock(&p->slots_lock);
 }
 
+void vspl_slot_render_params(struct priv *p, struct vspl_slot *slot, struct pl_render_params *params)
+{
+    if (p->profile) {
+        params->info_callback = vspl_profile_render_cb;
+        params->info_priv = &slot->prof;
+    }
+}
+
+void vspl_slot_profile(struct priv *p, struct vspl_slot *slot, VSFrame *dst, const VSAPI *vsapi)
+{
+    if (p->profile)
+        vspl_profile_write(p->gpu, &slot->prof, vsapi->getFramePropertiesRW(dst), vsapi);
+}
+
+// Wraps VapourSynth frame memory in a pl_buf, so transfers can go straight
+// from/to it instead of through libplacebo's staging buffers. Returns NULL if
+// the device or the memory layout doesn't allow it, in which case the caller
+// falls back to a regular transfer.
+static pl_buf vspl_import_host_ptr(pl_gpu gpu, struct vspl_xfer_batch *batch, const void *ptr, size_t size, size_t *offset)
+{
+    if (!ptr || !size || !(gpu->import_caps.buf & PL_HANDLE_HOST_PTR))
+        return NULL;
+    if (batch->num_bufs == sizeof(batch->bufs) / sizeof(batch->bufs[0]))
+        return NULL;
+
+    const size_t align = gpu->limits.align_host_ptr ? gpu->limits.align_host_ptr : 1;
+    const uintptr_t addr = (uintptr_t) ptr;
+    const uintptr_t start = addr - addr % align;
+    const uintptr_t end = ((addr + size + align - 1) / align) * align;
+    const size_t off = addr - start;
+
+    if (gpu->limits.align_tex_xfer_offset && off % gpu->limits.align_tex_xfer_offset)
+        return NULL;
+    if (end - start > gpu->limits.max_buf_size)
+        return NULL;
+
+    pl_buf buf = pl_buf_create(gpu, pl_buf_params(
+        .size = end - start,
+        .import_handle = PL_HANDLE_HOST_PTR,
+        .shared_mem = {
+            .handle.ptr = (void *) start,
+            .size = end - start,
+        },
+    ));
+
+    if (!buf)
+        return NULL;
+
+    batch->bufs[batch->num_bufs++] = buf;
+    *offset = off;
+    return buf;
+}
+
+// What a whole texture transfer moves between host and GPU
+static int64_t vspl_tex_bytes(pl_tex tex)
+{
+    return (int64_t) tex->params.w * (tex->params.h ? tex->params.h : 1) * tex->params.format->texel_size;
+}
+
+// Replaces the .ptr of a transfer by an imported buffer, if possible
+static void vspl_import_transfer(pl_gpu gpu, struct vspl_xfer_batch *batch, struct pl_tex_transfer_params *par)
+{
+    const struct pl_tex_params *tp = &par->tex->params;
+    const size_t row_pitch = par->row_pitch ? par->row_pitch : tp->w * tp->format->texel_size;
+
+    if (row_pitch % tp->format->texel_size)
+        return;
+    if (gpu->limits.align_tex_xfer_pitch && row_pitch % gpu->limits.align_tex_xfer_pitch)
+        return;
+
+    size_t offset;
+    const size_t size = row_pitch * (tp->h ? tp->h : 1);
+    pl_buf buf = vspl_import_host_ptr(gpu, batch, par->ptr, size, &offset);
+    if (!buf)
+        return;
+
+    par->row_pitch = row_pitch;
+    par->ptr = NULL;
+    par->buf = buf;
+    par->buf_offset = offset;
+}
+
+bool vspl_upload_async(pl_gpu gpu, struct vspl_xfer_batch *batch, const struct pl_tex_transfer_params *params)
+{
+    struct pl_tex_transfer_params par = *params;
+    if (batch->prof && !par.timer)
+        par.timer = batch->prof->upload;
+
+    const int64_t trace = vspl_trace_begin();
+    vspl_import_transfer(gpu, batch, &par);
+    bool ok = pl_tex_upload(gpu, &par);
+    vspl_trace_end(VSPL_TRACE_UPLOAD, trace);
+    if (!ok)
+        return false;
+
+    vspl_counter_add(VSPL_COUNTER_BYTES_UPLOADED, vspl_tex_bytes(par.tex));
+    return true;
+}
+
+// pl_upload_plane, which can't take a timer, so timed uploads set up the
+// texture and plane the same way and do the transfer themselves. The planes
+// of this plugin only have one component, so the row stride is always a
+// whole number of texels.
+static bool vspl_upload_plane_timed(pl_gpu gpu, pl_timer timer, struct pl_plane *plane, pl_tex *tex, const struct pl_plane_data *data)
+{
+    if (!timer)
+        return pl_upload_plane(gpu, plane, tex, data);
+
+    int out_map[4];
+    pl_fmt fmt = pl_plane_find_fmt(gpu, out_map, data);
+    if (!fmt)
+        return false;
+
+    bool ok = pl_tex_recreate(gpu, tex, pl_tex_params(
+        .w = data->width,
+        .h = data->height,
+        .format = fmt,
+        .sampleable = true,
+        .host_writable = true,
+        .blit_src = fmt->caps & PL_FMT_CAP_BLITTABLE,
+    ));
+
+    if (!ok)
+        return false;
+
+    plane->texture = *tex;
+    plane->components = 0;
+    for (int i = 0; i < 4; i++) {
+        plane->component_mapping[i] = out_map[i];
+        if (out_map[i] >= 0)
+            plane->components = i + 1;
+    }
+
+    return pl_tex_upload(gpu, pl_tex_transfer_params(
+        .tex = *tex,
+        .row_pitch = data->row_stride,
+        .ptr = (void *) data->pixels,
+        .buf = data->buf,
+        .buf_offset = data->buf_offset,
+        .callback = data->callback,
+        .priv = data->priv,
+        .timer = timer,
+    ));
+}
+
+bool vspl_upload_plane(pl_gpu gpu, struct vspl_xfer_batch *batch, struct pl_plane *plane, pl_tex *tex, const struct pl_plane_data *data)
+{
+    const pl_timer timer = batch->prof ? batch->prof->upload : NULL;
+    const int64_t trace = vspl_trace_begin();
+    struct pl_plane_data d = *data;
+
+    size_t offset;
+    if (!(d.row_stride % d.pixel_stride)) {
+        pl_buf buf = vspl_import_host_ptr(gpu, batch, d.pixels, d.row_stride * d.height, &offset);
+        if (buf) {
+            d.pixels = NULL;
+            d.buf = buf;
+            d.buf_offset = offset;
+        }
+    }
+
+    // Some layouts only fail once the transfer gets validated, so retry
+    // through libplacebo's own staging buffers
+    bool ok = vspl_upload_plane_timed(gpu, timer, plane, tex, &d) ||
+              (d.buf && vspl_upload_plane_timed(gpu, timer, plane, tex, data));
+    vspl_trace_end(VSPL_TRACE_UPLOAD, trace);
+    if (!ok)
+        return false;
+
+    vspl_counter_add(VSPL_COUNTER_BYTES_UPLOADED, vspl_tex_bytes(*tex));
+    return true;
+}
+
+static void vspl_download_done(void *priv)
+{
+    struct vspl_xfer_batch *batch = priv;
+    atomic_fetch_sub(&batch->pending, 1);
+}
+
+bool vspl_download_async(pl_gpu gpu, struct vspl_xfer_batch *batch, const struct pl_tex_transfer_params *params)
+{
+    struct pl_tex_transfer_params par = *params;
+    par.callback = vspl_download_done;
+    par.priv = batch;
+    if (batch->prof && !par.timer)
+        par.timer = batch->prof->download;
+    vspl_import_transfer(gpu, batch, &par);
+
+    atomic_fetch_add(&batch->pending, 1);
+    bool ok = pl_tex_download(gpu, &par);
+    if (!ok && par.buf) {
+        // See vspl_upload_plane
+        par.buf = NULL;
+        par.buf_offset = 0;
+        par.ptr = params->ptr;
+        par.row_pitch = params->row_pitch;
+        ok = pl_tex_download(gpu, &par);
+    }
+
+    if (!ok) {
+        atomic_fetch_sub(&batch->pending, 1);
+        return false;
+    }
+
+    if (batch->num_tex < MAX_PLANES)
+        batch->tex[batch->num_tex++] = par.tex;
+
+    vspl_counter_add(VSPL_COUNTER_BYTES_DOWNLOADED, vspl_tex_bytes(par.tex));
+
+    return true;
+}
+
+void vspl_download_wait(pl_gpu gpu, struct vspl_xfer_batch *batch)
+{
+    const int64_t trace = vspl_trace_begin();
+
+    // Only now kick off the work, and wait for the textures this frame
+    // actually reads back rather than for the whole GPU
+    pl_gpu_flush(gpu);
+
+    for (int i = 0; i < batch->num_tex && atomic_load(&batch->pending) > 0; i++) {
+        while (pl_tex_poll(gpu, batch->tex[i], UINT64_MAX))
+            ;
+    }
+
+    // The callbacks run from within libplacebo's polling, so in the unlikely
+    // event some are still outstanding, drain the queue. The same goes for
+    // imported memory that never got to a download, e.g. after an error.
+    if (atomic_load(&batch->pending) > 0 || (batch->num_bufs && !batch->num_tex))
+        pl_gpu_finish(gpu);
+
+    // Destruction of the imports is deferred by libplacebo until the GPU is
+    // done with them, which it now is
+    for (int i = 0; i < batch->num_bufs; i++)
+        pl_buf_destroy(gpu, &batch->bufs[i]);
+
+    atomic_store(&batch->pending, 0);
+    batch->num_tex = 0;
+    batch->num_bufs = 0;
+
+    vspl_trace_end(VSPL_TRACE_DOWNLOAD, trace);
+}
+
+bool vspl_format_supported(const VSVideoFormat *fmt)
+{
+    if (fmt->sampleType == stInteger)
+        return fmt->bitsPerSample >= 8 && fmt->bitsPerSample <= 16;
+    return fmt->bitsPerSample == 32;
+}
+
+struct pl_bit_encoding vspl_bit_encoding(const VSVideoFormat *fmt)
+{
+    // Integer samples are stored in the low bits of their container
+    return (struct pl_bit_encoding) {
+        .sample_depth = fmt->bytesPerSample * 8,
+        .color_depth = fmt->bitsPerSample,
+    };
+}
+
+pl_fmt vspl_find_plane_fmt(pl_gpu gpu, const VSVideoFormat *fmt, enum pl_fmt_caps caps)
+{
+    const enum pl_fmt_type type = fmt->sampleType == stInteger ? PL_FMT_UNORM : PL_FMT_FLOAT;
+    const int depth = fmt->bytesPerSample * 8;
+    return pl_find_fmt(gpu, type, 1, depth, depth, caps);
+}
+
+// Arguments read by vspl_init_params_read, accepted by every filter
+#define VSPL_COMMON_ARGS "log_level:int:opt;device:data:opt;inflight:int:opt;cache_dir:data:opt;resident:int:opt;" \
+                         "profile:int:opt;"
+
 VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
+    vspl_trace_init();
+
     vspapi->configPlugin(
         "com.vs.placebo",
         "placebo",
@@ -89,15 +682,15 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI
         plugin
     );
     vspapi->registerFunction("Deband", "clip:vnode;planes:int:opt;iterations:int:opt;threshold:float:opt;"
-                           "radius:float:opt;grain:float:opt;dither:int:opt;dither_algo:int:opt;"
-                           "log_level:int:opt;", "clip:vnode;", VSPlaceboDebandCreate, 0, plugin);
+                           "radius:float:opt;grain:float:opt;dither:int:opt;dither_algo:int:opt;backend:data:opt;"
+                           VSPL_COMMON_ARGS, "clip:vnode;", VSPlaceboDebandCreate, 0, plugin);
 
     vspapi->registerFunction("Resample", "clip:vnode;width:int;height:int;filter:data:opt;clamp:float:opt;blur:float:opt;"
                              "taper:float:opt;radius:float:opt;param1:float:opt;param2:float:opt;"
                              "src_width:float:opt;src_height:float:opt;sx:float:opt;sy:float:opt;antiring:float:opt;"
                              "sigmoidize:int:opt;sigmoid_center:float:opt;sigmoid_slope:float:opt;linearize:int:opt;trc:int:opt;"
-                             "min_luma:float:opt;"
-                             "log_level:int:opt;", "clip:vnode;", VSPlaceboResampleCreate, 0, plugin);
+                             "min_luma:float:opt;backend:data:opt;"
+                             VSPL_COMMON_ARGS, "clip:vnode;", VSPlaceboResampleCreate, 0, plugin);
 
     vspapi->registerFunction("Tonemap", "clip:vnode;"
                             "src_csp:int:opt;dst_csp:int:opt;"
@@ -114,12 +707,37 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI
                             "use_dovi:int:opt;"
                             "visualize_lut:int:opt;show_clipping:int:opt;"
                             "contrast_recovery:float:opt;"
-                            "log_level:int:opt;", "clip:vnode;", VSPlaceboTMCreate, 0, plugin);
+                            "format:int:opt;dst_chroma_loc:int:opt;"
+                            "stats_file:data:opt;metadata_steps:int:opt;"
+                            VSPL_COMMON_ARGS, "clip:vnode;", VSPlaceboTMCreate, 0, plugin);
 
     vspapi->registerFunction("Shader", "clip:vnode;shader:data:opt;width:int:opt;height:int:opt;chroma_loc:int:opt;matrix:int:opt;trc:int:opt;"
                            "linearize:int:opt;sigmoidize:int:opt;sigmoid_center:float:opt;sigmoid_slope:float:opt;"
                            "antiring:float:opt;"
                            "filter:data:opt;clamp:float:opt;blur:float:opt;taper:float:opt;radius:float:opt;"
                            "param1:float:opt;param2:float:opt;shader_s:data:opt;"
-                           "log_level:int:opt;", "clip:vnode;", VSPlaceboShaderCreate, 0, plugin);
+                           "format:int:opt;dst_chroma_loc:int:opt;"
+                           VSPL_COMMON_ARGS, "clip:vnode;", VSPlaceboShaderCreate, 0, plugin);
+
+    vspapi->registerFunction("Render", "clip:vnode;width:int:opt;height:int:opt;format:int:opt;dst_chroma_loc:int:opt;"
+                           "filter:data:opt;clamp:float:opt;blur:float:opt;taper:float:opt;radius:float:opt;"
+                           "param1:float:opt;param2:float:opt;antiring:float:opt;"
+                           "linearize:int:opt;sigmoidize:int:opt;"
+                           "deband:int:opt;deband_iterations:int:opt;deband_threshold:float:opt;"
+                           "deband_radius:float:opt;deband_grain:float:opt;"
+                           "src_csp:int:opt;dst_csp:int:opt;dst_prim:int:opt;"
+                           "src_max:float:opt;src_min:float:opt;dst_max:float:opt;dst_min:float:opt;"
+                           "dynamic_peak_detection:int:opt;smoothing_period:float:opt;"
+                           "scene_threshold_low:float:opt;scene_threshold_high:float:opt;percentile:float:opt;"
+                           "gamut_mapping:int:opt;tone_mapping_function:int:opt;tone_mapping_function_s:data:opt;"
+                           "tone_mapping_param:float:opt;metadata:int:opt;metadata_steps:int:opt;"
+                           "visualize_lut:int:opt;show_clipping:int:opt;contrast_recovery:float:opt;"
+                           "shader:data:opt;shader_s:data:opt;"
+                           "dither:int:opt;dither_algo:int:opt;"
+                           VSPL_COMMON_ARGS, "clip:vnode;", VSPlaceboRenderCreate, 0, plugin);
+
+    vspapi->registerFunction("Analyze", "clip:vnode;stats_file:data;src_csp:int:opt;percentile:float:opt;"
+                           VSPL_COMMON_ARGS, "clip:vnode;", VSPlaceboAnalyzeCreate, 0, plugin);
+
+    vspapi->registerFunction("Stats", "", "any", VSPlaceboStatsCreate, 0, plugin);
 }
@@ -2,15 +2,23 @@
 #define VS_PLACEBO_LIBRARY_H
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include <VapourSynth4.h>
 
 #include <libplacebo/dispatch.h>
+#include <libplacebo/shaders/custom.h>
 #include <libplacebo/shaders/sampling.h>
 #include <libplacebo/utils/upload.h>
 #include <libplacebo/vulkan.h>
 
 #include "config_vsplacebo.h"
-
-extern pthread_mutex_t vspl_vulkan_mutex;
+#include "cache.h"
+#include "counters.h"
+#include "profile.h"
+#include "texpool.h"
+#include "trace.h"
 
 struct format {
     int num_comps;
@@ -32,19 +40,155 @@ struct image {
     struct plane planes[MAX_PLANES];
 };
 
-struct priv {
+// Arguments shared by all filters
+struct vspl_init_params {
+    enum pl_log_level log_level;
+    const char *device;
+    const char *cache_dir;
+    int inflight;
+    bool resident;
+    bool profile;
+};
+
+void vspl_init_params_read(struct vspl_init_params *params, const VSMap *in, VSCore *core, const VSAPI *vsapi);
+
+// Process-wide Vulkan device, shared by every filter instance that asks for
+// the same device, log level and cache directory. Reference counted through
+// the registry in vs-placebo.c; the pl_log and pl_gpu are safe to use from any
+// thread.
+struct vspl_context {
+    struct vspl_context *next;
+    int refcount;
+
+    enum pl_log_level log_level;
+    char *device;
+    char *cache_dir;
+
     pl_log log;
     pl_vulkan vk;
     pl_gpu gpu;
+    struct vspl_cache *cache;
+    struct vspl_tex_pool *pool;
+
+    // Textures attached to frames, see resident.h
+    pthread_mutex_t resident_lock;
+    struct vspl_resident *resident;
+};
+
+struct vspl_context *vspl_context_acquire(const struct vspl_init_params *params);
+void vspl_context_ref(struct vspl_context *ctx);
+void vspl_context_release(struct vspl_context *ctx);
+
+#define MAX_INFLIGHT 16
+
+// The transfers of one frame. Downloads are all queued before waiting for any
+// of them, so the GPU can keep working on other frames' uploads and shaders
+// while this one is read back. Frame memory imported as host pointers has to
+// stay alive until then as well.
+struct vspl_xfer_batch {
+    atomic_int pending;
+    int num_tex;
+    pl_tex tex[MAX_PLANES];
+    int num_bufs;
+    pl_buf bufs[MAX_PLANES * 2];
+
+    // The slot's upload and download timers, when profiling
+    const struct vspl_profile *prof;
+};
+
+// One set of per-frame GPU objects. A frame owns its slot for its whole
+// upload/render/download cycle, so the number of slots bounds how many frames
+// of the same instance can be on the GPU at once.
+struct vspl_slot {
+    // Taken by a frame, guarded by the instance's slots_lock
+    bool in_use;
+    bool initialized;
+
     pl_dispatch dp;
     pl_shader_obj dither_state;
+    pl_shader_obj lut;
+
+    // Custom shader hooks keep per-pass state, so each renderer needs its own
+    const struct pl_hook *hook;
 
     pl_renderer rr;
+
+    // All taken from the context's texture pool
     pl_tex tex_in[MAX_PLANES];
     pl_tex tex_out[MAX_PLANES];
+    pl_tex tex_tmp[MAX_PLANES * 2];
+
+    struct vspl_xfer_batch xfer;
+
+    // Only set up with `profile`, see profile.h
+    struct vspl_profile prof;
+};
+
+struct priv {
+    struct vspl_context *ctx;
+
+    // Borrowed from ctx, for convenience
+    pl_log log;
+    pl_gpu gpu;
+    struct vspl_tex_pool *pool;
+
+    // Attach the output textures to the frames
+    bool resident;
+
+    // Write the GPU timings of the slots to the frames
+    bool profile;
+
+    int num_slots;
+    struct vspl_slot slots[MAX_INFLIGHT];
+    pthread_mutex_t slots_lock;
+    // Broadcast whenever a slot is released
+    pthread_cond_t slot_free;
 };
 
-void *VSPlaceboInit(enum pl_log_level log_level);
+void *VSPlaceboInit(const struct vspl_init_params *params);
 void VSPlaceboUninit(void *priv);
 
+// Where a filter that also has a CPU implementation runs, from its `backend`
+// argument
+enum vspl_backend {
+    VSPL_BACKEND_GPU,
+    VSPL_BACKEND_CPU,
+    // The CPU if there is no Vulkan device, or only a software one. Resample
+    // also picks the CPU for frames of at most VSPL_RESAMPLE_CPU_AUTO_PIXELS
+    // (960x540), see resample.c.
+    VSPL_BACKEND_AUTO,
+};
+
+// Returns false if the argument names no backend
+bool vspl_backend_read(enum vspl_backend *backend, const VSMap *in, const VSAPI *vsapi);
+
+// VSPlaceboInit for the GPU backend. Resolves VSPL_BACKEND_AUTO, and returns
+// NULL if the CPU ends up being used.
+void *vspl_backend_init(enum vspl_backend *backend, const struct vspl_init_params *params);
+
+// Whether the Vulkan device is a software implementation, e.g. lavapipe
+bool vspl_gpu_is_software(const struct priv *p);
+
+// Takes a free slot, waiting for one if all are in use
+struct vspl_slot *vspl_slot_acquire(struct priv *p);
+void vspl_slot_release(struct priv *p, struct vspl_slot *slot);
+
+// Makes pl_render_image report its passes to the slot, if profiling
+void vspl_slot_render_params(struct priv *p, struct vspl_slot *slot, struct pl_render_params *params);
+// Writes the slot's timings to `dst`'s props, if profiling
+void vspl_slot_profile(struct priv *p, struct vspl_slot *slot, VSFrame *dst, const VSAPI *vsapi);
+
+// Integer formats of 8 to 16 bits and 32 bit float
+bool vspl_format_supported(const VSVideoFormat *fmt);
+
+// Bit encoding and single-component texture format of a plane of the given
+// VapourSynth format, for both sides of a transfer
+struct pl_bit_encoding vspl_bit_encoding(const VSVideoFormat *fmt);
+pl_fmt vspl_find_plane_fmt(pl_gpu gpu, const VSVideoFormat *fmt, enum pl_fmt_caps caps);
+
+bool vspl_upload_async(pl_gpu gpu, struct vspl_xfer_batch *batch, const struct pl_tex_transfer_params *params);
+bool vspl_upload_plane(pl_gpu gpu, struct vspl_xfer_batch *batch, struct pl_plane *plane, pl_tex *tex, const struct pl_plane_data *data);
+bool vspl_download_async(pl_gpu gpu, struct vspl_xfer_batch *batch, const struct pl_tex_transfer_params *params);
+void vspl_download_wait(pl_gpu gpu, struct vspl_xfer_batch *batch);
+
 #endif //VS_PLACEBO_LIBRARY_H